@@ -24,6 +24,7 @@
 #include <grub/efi/misc.h>
 
 #include <shared.h>
+#include <efistubs.h>
 
 struct grub_efidisk_data
 {
@@ -31,6 +32,7 @@ struct grub_efidisk_data
   grub_efi_device_path_t *device_path;
   grub_efi_device_path_t *last_device_path;
   grub_efi_block_io_t *block_io;
+  grub_efi_block_io2_t *block_io2;	/* NULL if not supported */
   grub_efi_disk_io_t *disk_io;
   struct grub_efidisk_data *next;
 };
@@ -38,6 +40,7 @@ struct grub_efidisk_data
 /* GUIDs.  */
 static grub_efi_guid_t disk_io_guid = GRUB_EFI_DISK_IO_GUID;
 static grub_efi_guid_t block_io_guid = GRUB_EFI_BLOCK_IO_GUID;
+static grub_efi_guid_t block_io2_guid = GRUB_EFI_BLOCK_IO2_GUID;
 static grub_efi_guid_t device_path_from_text_guid = GRUB_EFI_DEVICE_PATH_FROM_TEXT_GUID;
 
 static struct grub_efidisk_data *fd_devices;
@@ -100,6 +103,8 @@ make_devices (void)
       d->device_path = dp;
       d->last_device_path = ldp;
       d->block_io = bio;
+      d->block_io2 = grub_efi_open_protocol (*handle, &block_io2_guid,
+					     GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
       d->disk_io = dio;
       d->next = devices;
       devices = d;
@@ -303,6 +308,208 @@ grub_efidisk_write (struct grub_efidisk_data *d, grub_disk_addr_t sector,
   return 0;
 }
 
+/* The asynchronous engine.  A batch of reads is sorted by sector and
+   reads of adjacent sectors into adjacent memory are merged, up to
+   EFIDISK_CHUNK bytes each.  Up to EFIDISK_QUEUE_DEPTH of them are then
+   kept in flight through BlockIo2, which is what NVMe and many SAN
+   adapters need to reach their bandwidth.  Devices without BlockIo2,
+   buffers which do not meet its alignment, and requests it refuses are
+   read one at a time through DiskIo as before.  */
+#define EFIDISK_QUEUE_DEPTH	8
+#define EFIDISK_CHUNK		0x40000
+
+static void
+sort_requests (struct grub_efidisk_request *reqs, int count)
+{
+  struct grub_efidisk_request tmp;
+  int i, j;
+
+  /* Batches are small and mostly sorted already.  */
+  for (i = 1; i < count; i++)
+    {
+      tmp = reqs[i];
+      for (j = i; j > 0 && reqs[j - 1].sector > tmp.sector; j--)
+	reqs[j] = reqs[j - 1];
+      reqs[j] = tmp;
+    }
+}
+
+static int
+merge_requests (struct grub_efidisk_request *reqs, int count, int bits)
+{
+  int i, j;
+
+  for (i = 1, j = 0; i < count; i++)
+    {
+      struct grub_efidisk_request *last = &reqs[j];
+
+      if (last->sector + last->nsec == reqs[i].sector
+	  && last->buf + (last->nsec << bits) == reqs[i].buf
+	  && ((last->nsec + reqs[i].nsec) << bits) <= EFIDISK_CHUNK)
+	last->nsec += reqs[i].nsec;
+      else
+	reqs[++j] = reqs[i];
+    }
+
+  return count ? j + 1 : 0;
+}
+
+static int
+read_requests_async (struct grub_efidisk_data *d,
+		     struct grub_efidisk_request *reqs, int count)
+{
+  grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+  grub_efi_block_io2_t *bio2 = d->block_io2;
+  grub_efi_block_io2_token_t tokens[EFIDISK_QUEUE_DEPTH];
+  grub_efi_event_t events[EFIDISK_QUEUE_DEPTH];
+  int owner[EFIDISK_QUEUE_DEPTH], slots[EFIDISK_QUEUE_DEPTH];
+  grub_efi_uint32_t align = bio2->media->io_align;
+  grub_efi_uintn_t index, waiting;
+  int bits = get_device_sector_bits (d);
+  int i, n, next = 0, inflight = 0, ret = 0;
+
+  for (i = 0; i < EFIDISK_QUEUE_DEPTH; i++)
+    {
+      owner[i] = -1;
+      if (Call_Service_5 (b->create_event, 0, GRUB_EFI_TPL_CALLBACK,
+			  NULL, NULL, &tokens[i].event) != GRUB_EFI_SUCCESS)
+	break;
+    }
+  n = i;
+
+  /* Without any event, this is the synchronous path after all.  */
+  for (; n == 0 && next < count; next++)
+    if (grub_efidisk_read (d, reqs[next].sector, reqs[next].nsec,
+			   reqs[next].buf))
+      ret = -1;
+
+  while (next < count || inflight)
+    {
+      /* Start as many requests as there are free slots.  */
+      for (i = 0; i < n && next < count; i++)
+	{
+	  struct grub_efidisk_request *r;
+
+	  if (owner[i] >= 0)
+	    continue;
+
+	  r = &reqs[next];
+	  if ((align > 1 && ((unsigned long) r->buf & (align - 1)))
+	      || Call_Service_6 (bio2->read_blocks_ex, bio2,
+				 bio2->media->media_id, r->sector,
+				 &tokens[i], (grub_efi_uintn_t) r->nsec << bits,
+				 r->buf) != GRUB_EFI_SUCCESS)
+	    {
+	      if (grub_efidisk_read (d, r->sector, r->nsec, r->buf))
+		ret = -1;
+	    }
+	  else
+	    {
+	      owner[i] = next;
+	      inflight++;
+	    }
+	  next++;
+	}
+
+      if (! inflight)
+	continue;
+
+      /* Wait for any of them to finish.  */
+      for (i = 0, waiting = 0; i < n; i++)
+	if (owner[i] >= 0)
+	  {
+	    slots[waiting] = i;
+	    events[waiting++] = tokens[i].event;
+	  }
+
+      if (Call_Service_3 (b->wait_for_event, waiting, events, &index)
+	  != GRUB_EFI_SUCCESS)
+	/* Cannot wait here, so poll.  */
+	for (index = 0;
+	     Call_Service_1 (b->check_event, events[index])
+	     != GRUB_EFI_SUCCESS;
+	     index = (index + 1) % waiting)
+	  ;
+
+      i = slots[index];
+      if (tokens[i].transaction_status != GRUB_EFI_SUCCESS)
+	{
+	  struct grub_efidisk_request *r = &reqs[owner[i]];
+
+	  if (grub_efidisk_read (d, r->sector, r->nsec, r->buf))
+	    ret = -1;
+	}
+      owner[i] = -1;
+      inflight--;
+    }
+
+  for (i = 0; i < n; i++)
+    Call_Service_1 (b->close_event, tokens[i].event);
+
+  return ret;
+}
+
+/* Read the COUNT requests in REQS from DRIVE, in whatever order suits
+   the device.  REQS is sorted and merged in place.  Returns zero on
+   success.  */
+int
+grub_efidisk_read_batch (int drive, struct grub_efidisk_request *reqs,
+			 int count)
+{
+  struct grub_efidisk_data *d;
+  int i, ret = 0;
+
+  d = get_device_from_drive (drive);
+  if (! d)
+    return -1;
+
+  sort_requests (reqs, count);
+  count = merge_requests (reqs, count, get_device_sector_bits (d));
+
+  if (d->block_io2 && count > 1)
+    return read_requests_async (d, reqs, count);
+
+  for (i = 0; i < count; i++)
+    if (grub_efidisk_read (d, reqs[i].sector, reqs[i].nsec, reqs[i].buf))
+      ret = -1;
+
+  return ret;
+}
+
+/* Read NSEC sectors from SECTOR into BUF, splitting a large read into
+   chunks for the engine so that they are in flight together.  */
+static int
+grub_efidisk_read_large (struct grub_efidisk_data *d, int drive,
+			 grub_disk_addr_t sector, int nsec, char *buf)
+{
+  struct grub_efidisk_request reqs[EFIDISK_QUEUE_DEPTH * 4];
+  int bits = get_device_sector_bits (d);
+  int chunk = EFIDISK_CHUNK >> bits;
+  int count;
+
+  if (! d->block_io2 || nsec <= chunk || chunk <= 0)
+    return grub_efidisk_read (d, sector, nsec, buf);
+
+  for (count = 0; nsec > 0; count++)
+    {
+      if (count == sizeof (reqs) / sizeof (reqs[0]))
+	{
+	  if (grub_efidisk_read_batch (drive, reqs, count))
+	    return -1;
+	  count = 0;
+	}
+
+      reqs[count].sector = sector;
+      reqs[count].nsec = nsec < chunk ? nsec : chunk;
+      reqs[count].buf = buf;
+      sector += reqs[count].nsec;
+      buf += reqs[count].nsec << bits;
+      nsec -= reqs[count].nsec;
+    }
+
+  return grub_efidisk_read_batch (drive, reqs, count);
+}
+
 void
 grub_efidisk_init (void)
 {
@@ -326,7 +533,11 @@ get_device_sector_size(struct grub_efidisk_data *device)
 int
 get_sector_size(int drive)
 {
-	struct grub_efidisk_data *device = get_device_from_drive(drive);
+	struct grub_efidisk_data *device;
+
+	if (MD_DRIVE_P(drive) || RD_DRIVE_P(drive) || LD_DRIVE_P(drive))
+		return 0x200;
+	device = get_device_from_drive(drive);
 	return get_device_sector_size(device);
 }
 
@@ -385,6 +596,13 @@ get_diskinfo (int drive, struct geometry *geometry)
 {
   struct grub_efidisk_data *d;
 
+  if (MD_DRIVE_P (drive))
+    return md_get_diskinfo (drive, geometry);
+  if (RD_DRIVE_P (drive))
+    return rd_get_diskinfo (drive, geometry);
+  if (LD_DRIVE_P (drive))
+    return ld_get_diskinfo (drive, geometry);
+
   d = get_device_from_drive (drive);
   if (!d)
     return -1;
@@ -408,6 +626,13 @@ biosdisk (int subfunc, int drive, struct geometry *geometry,
   struct grub_efidisk_data *d;
   int ret;
 
+  if (MD_DRIVE_P (drive))
+    return md_biosdisk (subfunc, drive, geometry, sector, nsec, segment);
+  if (RD_DRIVE_P (drive))
+    return rd_biosdisk (subfunc, drive, geometry, sector, nsec, segment);
+  if (LD_DRIVE_P (drive))
+    return ld_biosdisk (subfunc, drive, geometry, sector, nsec, segment);
+
   d = get_device_from_drive (drive);
   if (!d)
     return -1;
@@ -415,7 +640,7 @@ biosdisk (int subfunc, int drive, struct geometry *geometry,
   switch (subfunc)
     {
     case BIOSDISK_READ:
-      ret = grub_efidisk_read (d, sector, nsec, buf);
+      ret = grub_efidisk_read_large (d, drive, sector, nsec, buf);
       break;
     case BIOSDISK_WRITE:
       ret = grub_efidisk_write (d, sector, nsec, buf);
@@ -427,6 +652,55 @@ biosdisk (int subfunc, int drive, struct geometry *geometry,
   return 0;
 }
 
+/* Return a buffer of at least SIZE bytes for the read-ahead window of
+   rawread, below 2GB so that biosdisk can address it by segment, or
+   NULL if there is no memory for it.  The buffer is kept and only
+   reallocated when it has to grow.  */
+char *
+grub_efidisk_readahead_buffer (int size)
+{
+  static char *buf;
+  static grub_efi_uintn_t pages;
+  grub_efi_uintn_t need = (size + 0xfff) >> 12;
+
+  if (need <= pages)
+    return buf;
+
+  if (buf)
+    grub_efi_free_pages ((grub_efi_physical_address_t) (unsigned long) buf,
+			 pages);
+  pages = 0;
+  buf = grub_efi_allocate_pages (0, need);
+  if (buf)
+    pages = need;
+
+  return buf;
+}
+
+/* Return SIZE bytes of pages for the RAM disk, freeing those returned
+   before, or NULL if there is no memory for them or SIZE is zero.  */
+char *
+grub_efidisk_ramdisk_buffer (unsigned long size)
+{
+  static char *buf;
+  static grub_efi_uintn_t pages;
+
+  if (buf)
+    grub_efi_free_pages ((grub_efi_physical_address_t) (unsigned long) buf,
+			 pages);
+  buf = 0;
+  pages = 0;
+
+  if (! size)
+    return 0;
+
+  buf = grub_efi_allocate_pages (0, (size + 0xfff) >> 12);
+  if (buf)
+    pages = (size + 0xfff) >> 12;
+
+  return buf;
+}
+
 /* Some utility functions to map GRUB devices with EFI devices.  */
 grub_efi_handle_t
 grub_efidisk_get_current_bdev_handle (void)
@@ -650,12 +924,14 @@ swap_devices (struct grub_efidisk_data *d0,
   d0->device_path = d1->device_path;
   d0->last_device_path = d1->last_device_path;
   d0->block_io = d1->block_io;
+  d0->block_io2 = d1->block_io2;
   d0->disk_io = d1->disk_io;
 
   memcpy(d1->handle, tmp.handle, sizeof(tmp.handle));
   d1->device_path = tmp.device_path;
   d1->last_device_path = tmp.last_device_path;
   d1->block_io = tmp.block_io;
+  d1->block_io2 = tmp.block_io2;
   d1->disk_io = tmp.disk_io;
 }
 
@@ -91,12 +91,14 @@ struct video_mode {
     grub_efi_uint32_t number;
     grub_efi_uintn_t size;
     grub_efi_graphics_output_mode_information_t *info;
+    int failed;
 };
 
 #define MAX_PALETTE 16
 struct eg {
     struct graphics_backend *backend;
     grub_efi_graphics_output_t *output_intf;
+    /* Filled in by query_video_mode as the modes are asked about. */
     struct video_mode **modes;
     int max_mode;
     grub_efi_uint32_t text_mode;
@@ -157,18 +159,50 @@ find_bits (unsigned long mask, unsigned char *first,
   *len = bit_len;
 }
 
+static grub_efi_status_t set_video_mode(struct eg *eg, int mode);
+
+/* QueryMode is slow on some firmware, so only ask about a mode the
+ * first time we need it, and keep the answer.  If the firmware doesn't
+ * know about the mode, info is NULL. */
+static struct video_mode *
+query_video_mode(struct eg *eg, int mode)
+{
+	grub_efi_status_t efi_status;
+	struct video_mode *vm;
+
+	if (mode < 0 || mode >= eg->max_mode)
+		return NULL;
+	if (eg->modes[mode])
+		return eg->modes[mode];
+
+	vm = grub_malloc(sizeof (*vm));
+	if (!vm)
+		return NULL;
+	memset(vm, '\0', sizeof (*vm));
+	vm->number = mode;
+
+	efi_status = Call_Service_4(eg->output_intf->query_mode,
+		eg->output_intf, mode, &vm->size, &vm->info);
+	if (efi_status == GRUB_EFI_NOT_STARTED) {
+		/* The firmware didn't turn on GRAPHICS_OUTPUT_PROTOCOL, so
+		 * try to do so ourselves. Thanks, Intel. */
+		set_video_mode(eg, eg->output_intf->mode->mode);
+		efi_status = Call_Service_4(eg->output_intf->query_mode,
+			eg->output_intf, mode, &vm->size, &vm->info);
+	}
+	if (efi_status != GRUB_EFI_SUCCESS)
+		vm->info = NULL;
+
+	eg->modes[mode] = vm;
+	return vm;
+}
+
 static grub_efi_graphics_output_mode_information_t *
 get_graphics_mode_info_for_mode(struct eg *eg, int mode)
 {
-	int i;
+	struct video_mode *vm = query_video_mode(eg, mode);
 
-	for (i = 0; i < eg->max_mode; i++) {
-		if (eg->modes[i] == NULL)
-			continue;
-		if (eg->modes[i]->number == mode)
-			return eg->modes[i]->info;
-	}
-	return NULL;
+	return vm ? vm->info : NULL;
 }
 
 static grub_efi_graphics_output_mode_information_t *
@@ -1250,36 +1284,42 @@ modecmp(struct eg *eg, struct video_mode *amode, struct video_mode *bmode)
         return rc;
 }
 
-static void
-modeswap(struct video_mode *amode, struct video_mode *bmode)
+/* Find the best mode we haven't failed to switch to yet.  This asks
+ * the firmware about every mode, so it's only used when the mode the
+ * firmware picked for itself won't do. */
+static struct video_mode *
+find_best_mode(struct eg *eg)
 {
-        struct video_mode tmp;
+	struct video_mode *best = NULL, *vm;
+	int i;
 
-        memcpy(&tmp, amode, sizeof (tmp));
-        memcpy(amode, bmode, sizeof (tmp));
-        memcpy(bmode, &tmp, sizeof(tmp));
+	for (i = 0; i < eg->max_mode; i++) {
+		vm = query_video_mode(eg, i);
+		if (!vm || !vm->info || vm->failed)
+			continue;
+		if (!best || modecmp(eg, vm, best) > 0)
+			best = vm;
+	}
+	return best;
 }
 
-static void
-sort_modes(struct eg *eg, int p, int r)
+static int
+switch_to_mode(struct eg *eg, struct video_mode *vm)
 {
-	struct video_mode **modes = eg->modes;
-
-        int i, j;
-	for (i = 0; i < eg->max_mode; i++) {
-		for (j = i + 1; j < eg->max_mode; j++) {
-			if (modecmp(eg, modes[j], modes[i]) < 0)
-				modeswap(modes[j], modes[i]);
-		}
+	if (set_video_mode(eg, vm->number) != GRUB_EFI_SUCCESS) {
+		vm->failed = 1;
+		return 0;
 	}
+	eg->graphics_mode = vm->number;
+	fill_pixel_info(&eg->pixel_info, vm->info);
+	return 1;
 }
 
 static int
 try_enable(struct graphics_backend *backend)
 {
     struct eg *eg = backend->priv;
-    grub_efi_status_t efi_status = GRUB_EFI_UNSUPPORTED;
-    int i;
+    struct video_mode *vm;
 
     if (eg->text_mode == 0xffffffff) {
         grub_efi_set_text_mode(1);
@@ -1287,75 +1327,33 @@ try_enable(struct graphics_backend *backend)
     }
 
     if (eg->graphics_mode == 0xffffffff) {
-        grub_efi_graphics_output_mode_information_t *info;
-
         if (!graphics_alloc_text_buf())
             return 0;
 
+        /* Every trip through ConsoleControl or SetMode makes the screen
+         * flicker, so switch the console just once, and try the mode the
+         * firmware uses for graphics before asking about any other. */
         grub_efi_set_text_mode(0);
-        eg->graphics_mode = eg->output_intf->mode->mode;
-        grub_efi_set_text_mode(1);
-#if 0
-	dprintf("graphics mode is %d\n", eg->graphics_mode);
-	/* this is okay here because we haven't sorted yet.*/
-	print_mode_info(eg->modes[eg->graphics_mode]);
-	dprintf("text mode is %d\n", eg->text_mode);
-	print_mode_info(eg->modes[eg->text_mode]);
-#endif
-
-        sort_modes(eg, 0, eg->max_mode-1);
-
-#if 0
-        for (i = eg->max_mode - 1; i >= 0; i--)
-            print_mode_info(eg->modes[i]);
-	dbgdelay(__FILE__, __LINE__);
-#endif
-
-	efi_status = GRUB_EFI_UNSUPPORTED;
-
-        for (i = eg->max_mode - 1; i >= 0; i--) {
-            if (!eg->modes[i])
-                continue;
-
-            info = eg->modes[i]->info;
-
-#if 0
-            if (info->pixel_format != GRUB_EFI_PIXEL_RGBR_8BIT_PER_COLOR &&
-                 info->pixel_format != GRUB_EFI_PIXEL_BGRR_8BIT_PER_COLOR &&
-                 info->pixel_format != GRUB_EFI_PIXEL_BIT_MASK) {
-                continue;
-            }
-#endif
-
-            grub_efi_set_text_mode(0);
-            efi_status = set_video_mode(eg, eg->modes[i]->number);
-            if (efi_status == GRUB_EFI_SUCCESS) {
-#if 0
+        vm = query_video_mode(eg, eg->output_intf->mode->mode);
+        if (!vm || !vm->info ||
+                vm->info->pixel_format == GRUB_EFI_PIXEL_BLT_ONLY ||
+                !switch_to_mode(eg, vm)) {
+            while ((vm = find_best_mode(eg)) && !switch_to_mode(eg, vm))
+                ;
+            if (!vm) {
                 grub_efi_set_text_mode(1);
-	        dprintf("switched to mode %d successfully\n",
-		        eg->modes[i]->number);
-	        dbgdelay(__FILE__,__LINE__);
-                grub_efi_set_text_mode(0);
-#endif
-                eg->graphics_mode = eg->modes[i]->number;
-	        fill_pixel_info(&eg->pixel_info, info);
-                break;
-            } else {
-#if 0
                 set_video_mode(eg, eg->text_mode);
-                grub_efi_set_text_mode(1);
-		dprintf("return code was %d\n", efi_status);
-#endif
+                return 0;
             }
         }
-        if (efi_status != GRUB_EFI_SUCCESS) {
-#if 1
+        dprintf("graphics mode is %d\n", eg->graphics_mode);
+    } else if (eg->output_intf->mode->mode != eg->graphics_mode) {
+        /* We've picked a mode before; go straight back to it. */
+        grub_efi_set_text_mode(0);
+        if (set_video_mode(eg, eg->graphics_mode) != GRUB_EFI_SUCCESS) {
             grub_efi_set_text_mode(1);
-            set_video_mode(eg, eg->text_mode);
-#endif
             return 0;
         }
-
     }
 
     eg->current_mode = GRAPHICS;
@@ -1373,7 +1371,6 @@ enable(struct graphics_backend *backend)
             return 1;
         }
     } else {
-        grub_efi_status_t efi_status;
 	grub_efi_handle_t *handle, *handles;
 	grub_efi_uintn_t num_handles;
 	grub_efi_pci_io_t *pci_proto;
@@ -1427,32 +1424,6 @@ enable(struct graphics_backend *backend)
             goto fail;
         memset(eg->modes, '\0', eg->max_mode * sizeof (void *));
 
-        for (i = 0; i < eg->max_mode; i++) {
-            eg->modes[i] = grub_malloc(sizeof *(eg->modes[0]));
-            if (!eg->modes[i])
-                goto fail;
-            memset(eg->modes[i], '\0', sizeof *(eg->modes[0]));
-            eg->modes[i]->number = i;
-
-            efi_status = Call_Service_4(eg->output_intf->query_mode,
-                    eg->output_intf, i, &eg->modes[i]->size,
-                    &eg->modes[i]->info);
-	    if (efi_status == GRUB_EFI_NOT_STARTED) {
-		/* The firmware didn't turn on GRAPHICS_OUTPUT_PROTOCOL, so
-		 * try to do so ourselves. Thanks, Intel. */
-		set_video_mode(eg, eg->output_intf->mode->mode);
-            	efi_status = Call_Service_4(eg->output_intf->query_mode,
-                    eg->output_intf, i, &eg->modes[i]->size,
-                    &eg->modes[i]->info);
-	    }
-            if (efi_status != GRUB_EFI_SUCCESS) {
-                grub_free(eg->modes[i]);
-                eg->modes[i] = NULL;
-                //eg->max_mode = i;
-                break;
-            }
-        }
-
         backend->priv = eg;
         setup_cga_palette(eg);
         for (i = 0; i < n_cga_colors; i++) {
@@ -250,6 +250,42 @@ getrtsecs (void)
   return grub_get_rtc() / GRUB_TICKS_PER_SECOND;
 }
 
+/* The timer event used to wake up from grub_idle.  */
+static grub_efi_event_t idle_timer;
+
+/* The interval of IDLE_TIMER, in 100ns units (10ms).  */
+#define IDLE_TIMER_INTERVAL	100000
+
+void
+grub_idle (void)
+{
+  grub_efi_boot_services_t *b;
+  grub_efi_event_t events[2];
+  grub_efi_uintn_t index;
+
+  b = grub_efi_system_table->boot_services;
+
+  if (! idle_timer
+      && Call_Service_5 (b->create_event, GRUB_EFI_EVT_TIMER,
+			 GRUB_EFI_TPL_CALLBACK, NULL, NULL,
+			 &idle_timer) != GRUB_EFI_SUCCESS)
+    {
+      idle_timer = 0;
+      return;
+    }
+
+  if (Call_Service_3 (b->set_timer, idle_timer, GRUB_EFI_TIMER_RELATIVE,
+		      IDLE_TIMER_INTERVAL) != GRUB_EFI_SUCCESS)
+    return;
+
+  /* Wake up on a key stroke or when the timer expires, so that
+     terminals without an event, such as serial ones, are still
+     polled regularly.  */
+  events[0] = grub_efi_system_table->con_in->wait_for_key;
+  events[1] = idle_timer;
+  Call_Service_3 (b->wait_for_event, 2, events, &index);
+}
+
 void
 grub_reboot (void)
 {
@@ -305,7 +341,7 @@ unset_int15_handler (void)
 
 /* Copy MAP to the drive map and set up the int13 handler.  */
 void
-set_int13_handler (unsigned short *map)
+set_int13_handler (unsigned short *map, struct rd_params *rd)
 {
 }
 
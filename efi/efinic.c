@@ -0,0 +1,767 @@
+/* efinic.c - TFTP over the Simple Network Protocol of the boot card */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2006  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Rather than have the PXE base code fetch each file whole, we talk
+ * ARP, IP, UDP and TFTP to the server ourselves, through the Simple
+ * Network Protocol of the card the PXE base code was started on, with
+ * the addresses it got by DHCP.  That lets us ask for large blocks and
+ * for several blocks per acknowledgement (RFC 2348 and RFC 7440), and
+ * hand the file to the reader as it arrives.
+ *
+ * If the card has no usable SNP, the server cannot be reached this way
+ * or does not do the options, the callers go back to the PXE base code.
+ *
+ * While we run, the task priority is raised to TPL_CALLBACK, so that
+ * the firmware's own network stack, which polls the same card from a
+ * timer, does not take our packets.
+ */
+
+#include <grub/efi/efi.h>
+#include <grub/efi/api.h>
+#include <grub/efi/misc.h>
+#include <grub/misc.h>
+
+#include <shared.h>
+#include "pxe.h"
+
+#define ntohs(x)	htons(x)
+
+#define ETH_ALEN	6
+#define ETH_HLEN	14
+#define ETH_ZLEN	60
+#define ETH_FRAME_LEN	1536
+#define ETH_P_IP	0x0800
+#define ETH_P_ARP	0x0806
+
+#define ARP_REQUEST	1
+#define ARP_REPLY	2
+
+#define IP_HLEN		20
+#define IP_UDP		17
+#define IP_MF		0x2000
+#define IP_OFFSET	0x1fff
+#define UDP_HLEN	8
+
+#define TFTP_PORT	69
+#define TFTP_RRQ	1
+#define TFTP_DATA	3
+#define TFTP_ACK	4
+#define TFTP_ERROR	5
+#define TFTP_OACK	6
+
+/* The largest block that fits in an Ethernet frame, and the number of
+ * blocks we ask for per acknowledgement.  */
+#define TFTP_MAX_BLKSIZE	1468
+#define TFTP_WINDOWSIZE		16
+
+/* Milliseconds to wait for a reply, and the number of times to ask
+ * again before giving up.  */
+#define SNP_ARP_TIMEOUT		250
+#define SNP_ARP_RETRIES		4
+#define SNP_RRQ_RETRIES		4
+#define SNP_TFTP_TIMEOUT	1000
+#define SNP_TFTP_RETRIES	8
+
+struct ethhdr {
+	grub_efi_uint8_t dest[ETH_ALEN];
+	grub_efi_uint8_t src[ETH_ALEN];
+	grub_efi_uint16_t proto;
+} __attribute__ ((packed));
+
+struct arphdr {
+	grub_efi_uint16_t hwtype;
+	grub_efi_uint16_t proto;
+	grub_efi_uint8_t hwlen;
+	grub_efi_uint8_t protolen;
+	grub_efi_uint16_t opcode;
+	grub_efi_uint8_t shwaddr[ETH_ALEN];
+	grub_efi_uint8_t sipaddr[4];
+	grub_efi_uint8_t thwaddr[ETH_ALEN];
+	grub_efi_uint8_t tipaddr[4];
+} __attribute__ ((packed));
+
+struct iphdr {
+	grub_efi_uint8_t verhdrlen;
+	grub_efi_uint8_t service;
+	grub_efi_uint16_t len;
+	grub_efi_uint16_t ident;
+	grub_efi_uint16_t frags;
+	grub_efi_uint8_t ttl;
+	grub_efi_uint8_t protocol;
+	grub_efi_uint16_t chksum;
+	grub_efi_uint32_t src;
+	grub_efi_uint32_t dest;
+} __attribute__ ((packed));
+
+struct udphdr {
+	grub_efi_uint16_t src;
+	grub_efi_uint16_t dest;
+	grub_efi_uint16_t len;
+	grub_efi_uint16_t chksum;
+} __attribute__ ((packed));
+
+/* Where the UDP payload of a frame we send goes.  */
+#define UDP_PAYLOAD	(snp_tx + ETH_HLEN + IP_HLEN + UDP_HLEN)
+
+static grub_efi_simple_network_t *snp;
+/* 1 if SNP can be used, -1 if not, 0 if not tried yet.  */
+static int snp_usable;
+static grub_efi_event_t snp_timer;
+static grub_efi_uint8_t snp_rx[ETH_FRAME_LEN];
+static grub_efi_uint8_t snp_tx[ETH_FRAME_LEN];
+
+/* Our addresses, and those of the TFTP server or of the router to it.
+ * IP addresses are kept in network order.  */
+static grub_efi_uint8_t snp_mac[ETH_ALEN];
+static grub_efi_uint32_t snp_ip, snp_netmask;
+static grub_efi_uint32_t server_ip;
+static grub_efi_uint8_t server_mac[ETH_ALEN];
+static grub_efi_uint16_t snp_ident;
+static grub_efi_uint16_t snp_port;
+static int snp_blksize;
+
+/* The ARP reply being waited for.  */
+static grub_efi_uint32_t arp_ip;
+static int arp_done;
+
+/* The current transfer.  */
+static struct {
+	char *buffer;
+	grub_efi_uintn_t size;
+	grub_efi_uintn_t received;
+	grub_efi_uint16_t block;
+	grub_efi_uint16_t port;
+	grub_efi_uint16_t server_port;
+	int blksize;
+	int windowsize;
+	int active;
+} xfer;
+
+static grub_efi_uint16_t ip_checksum(void *data, int len)
+{
+	grub_efi_uint16_t *p = data;
+	grub_efi_uint32_t sum = 0;
+
+	for (; len > 1; len -= 2)
+		sum += *p++;
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum;
+}
+
+static void snp_set_timeout(int ms)
+{
+	/* The timer counts in 100ns units. */
+	Call_Service_3(grub_efi_system_table->boot_services->set_timer,
+		       snp_timer, GRUB_EFI_TIMER_RELATIVE, ms * 10000);
+}
+
+static int snp_timed_out(void)
+{
+	return Call_Service_1(grub_efi_system_table->boot_services->check_event,
+			      snp_timer) == GRUB_EFI_SUCCESS;
+}
+
+/* Send the frame in snp_tx, whose LEN bytes of payload are already
+ * there, to the card with address DEST.  Only returns once the card
+ * is done with snp_tx.
+ */
+static int snp_send(grub_efi_uint8_t *dest, grub_efi_uint16_t proto,
+		    grub_efi_uintn_t len)
+{
+	struct ethhdr *eth = (struct ethhdr *)snp_tx;
+	grub_efi_uint32_t status;
+	grub_efi_status_t rc;
+	void *txbuf;
+	int i;
+
+	memcpy(eth->dest, dest, ETH_ALEN);
+	memcpy(eth->src, snp_mac, ETH_ALEN);
+	eth->proto = htons(proto);
+	len += ETH_HLEN;
+	if (len < ETH_ZLEN) {
+		grub_memset(snp_tx + len, 0, ETH_ZLEN - len);
+		len = ETH_ZLEN;
+	}
+
+	for (i = 0; ; i++) {
+		rc = Call_Service_7(snp->transmit, snp, 0, len, snp_tx,
+				    NULL, NULL, NULL);
+		if (rc == GRUB_EFI_SUCCESS)
+			break;
+		if (rc != GRUB_EFI_NOT_READY || i == 100)
+			return 0;
+		/* The transmit queue is full: let the card recycle. */
+		Call_Service_3(snp->get_status, snp, &status, &txbuf);
+		grub_efi_stall(10);
+	}
+
+	for (i = 0; i < 1000; i++) {
+		txbuf = NULL;
+		rc = Call_Service_3(snp->get_status, snp, &status, &txbuf);
+		if (rc != GRUB_EFI_SUCCESS)
+			return 0;
+		if (txbuf == snp_tx)
+			return 1;
+		grub_efi_stall(10);
+	}
+	return 0;
+}
+
+static int snp_send_udp(grub_efi_uint16_t src_port,
+			grub_efi_uint16_t dest_port, int len)
+{
+	struct iphdr *ip = (struct iphdr *)(snp_tx + ETH_HLEN);
+	struct udphdr *udp = (struct udphdr *)(snp_tx + ETH_HLEN + IP_HLEN);
+
+	udp->src = htons(src_port);
+	udp->dest = htons(dest_port);
+	udp->len = htons(UDP_HLEN + len);
+	udp->chksum = 0;
+
+	ip->verhdrlen = 0x45;
+	ip->service = 0;
+	ip->len = htons(IP_HLEN + UDP_HLEN + len);
+	ip->ident = htons(snp_ident++);
+	ip->frags = 0;
+	ip->ttl = 64;
+	ip->protocol = IP_UDP;
+	ip->chksum = 0;
+	ip->src = snp_ip;
+	ip->dest = server_ip;
+	ip->chksum = ip_checksum(ip, IP_HLEN);
+
+	return snp_send(server_mac, ETH_P_IP, IP_HLEN + UDP_HLEN + len);
+}
+
+/* Answer ARP requests for our address, and catch the reply to ours. */
+static void snp_handle_arp(grub_efi_uintn_t size)
+{
+	struct arphdr *arp = (struct arphdr *)(snp_rx + ETH_HLEN);
+	struct arphdr *reply = (struct arphdr *)(snp_tx + ETH_HLEN);
+	grub_efi_uint8_t dest[ETH_ALEN];
+
+	if (size < ETH_HLEN + sizeof (*arp) || arp->hwtype != htons(1) ||
+	    arp->proto != htons(ETH_P_IP) || arp->hwlen != ETH_ALEN ||
+	    arp->protolen != 4)
+		return;
+
+	if (arp->opcode == htons(ARP_REPLY) &&
+	    !memcmp((char *)arp->sipaddr, (char *)&arp_ip, 4)) {
+		memcpy(server_mac, arp->shwaddr, ETH_ALEN);
+		arp_done = 1;
+	} else if (arp->opcode == htons(ARP_REQUEST) &&
+		   !memcmp((char *)arp->tipaddr, (char *)&snp_ip, 4)) {
+		memcpy(dest, arp->shwaddr, ETH_ALEN);
+		reply->hwtype = htons(1);
+		reply->proto = htons(ETH_P_IP);
+		reply->hwlen = ETH_ALEN;
+		reply->protolen = 4;
+		reply->opcode = htons(ARP_REPLY);
+		memcpy(reply->thwaddr, arp->shwaddr, ETH_ALEN);
+		memcpy(reply->tipaddr, arp->sipaddr, 4);
+		memcpy(reply->shwaddr, snp_mac, ETH_ALEN);
+		memcpy(reply->sipaddr, &snp_ip, 4);
+		snp_send(dest, ETH_P_ARP, sizeof (*reply));
+	}
+}
+
+/* Return the UDP payload of the next frame the server sent to PORT,
+ * storing its length in *LEN and its source port in *SRC_PORT, or NULL
+ * if no such frame is waiting.  The frames queued on the card before
+ * it are handled or dropped.
+ */
+static grub_efi_uint8_t *snp_recv_udp(grub_efi_uint16_t port, int *len,
+				      grub_efi_uint16_t *src_port)
+{
+	struct ethhdr *eth = (struct ethhdr *)snp_rx;
+	struct iphdr *ip = (struct iphdr *)(snp_rx + ETH_HLEN);
+	struct udphdr *udp;
+	grub_efi_uintn_t size;
+	int hlen, iplen, udplen;
+
+	for (;;) {
+		size = sizeof (snp_rx);
+		if (Call_Service_7(snp->receive, snp, NULL, &size, snp_rx,
+				   NULL, NULL, NULL) != GRUB_EFI_SUCCESS)
+			return NULL;
+
+		if (size < ETH_HLEN)
+			continue;
+		if (eth->proto == htons(ETH_P_ARP)) {
+			snp_handle_arp(size);
+			continue;
+		}
+		if (eth->proto != htons(ETH_P_IP) ||
+		    size < ETH_HLEN + IP_HLEN || (ip->verhdrlen >> 4) != 4)
+			continue;
+
+		hlen = (ip->verhdrlen & 0xf) * 4;
+		iplen = ntohs(ip->len);
+		if (hlen < IP_HLEN || iplen < hlen + UDP_HLEN ||
+		    ETH_HLEN + iplen > size || ip_checksum(ip, hlen))
+			continue;
+		if (ip->protocol != IP_UDP || ip->dest != snp_ip ||
+		    ip->src != server_ip ||
+		    (ip->frags & htons(IP_MF | IP_OFFSET)))
+			continue;
+
+		udp = (struct udphdr *)((grub_efi_uint8_t *)ip + hlen);
+		udplen = ntohs(udp->len);
+		if (udp->dest != htons(port) || udplen < UDP_HLEN ||
+		    udplen > iplen - hlen)
+			continue;
+
+		*len = udplen - UDP_HLEN;
+		*src_port = ntohs(udp->src);
+		return (grub_efi_uint8_t *)udp + UDP_HLEN;
+	}
+}
+
+/* Find the card to send to for the server: the server itself, or the
+ * router if it is on another subnet.  The ARP cache of the PXE base
+ * code usually has it already.
+ */
+static int snp_resolve(void)
+{
+	EFI_PXE_BASE_CODE_MODE *mode = tftp_info.Pxe->Mode;
+	struct arphdr *arp = (struct arphdr *)(snp_tx + ETH_HLEN);
+	grub_efi_uint8_t broadcast[ETH_ALEN];
+	grub_efi_uint32_t i;
+	int try;
+
+	arp_ip = server_ip;
+	if ((server_ip ^ snp_ip) & snp_netmask) {
+		if (!grub_efi_pxe_get_gateway(&arp_ip))
+			return 0;
+	}
+
+	for (i = 0; i < mode->ArpCacheEntries &&
+		    i < EFI_PXE_BASE_CODE_MAX_ARP_ENTRIES; i++) {
+		if (mode->ArpCache[i].IpAddr.Addr[0] == arp_ip) {
+			memcpy(server_mac, mode->ArpCache[i].MacAddr.Addr,
+			       ETH_ALEN);
+			return 1;
+		}
+	}
+
+	grub_memset(broadcast, 0xff, ETH_ALEN);
+	arp_done = 0;
+	for (try = 0; try < SNP_ARP_RETRIES; try++) {
+		arp->hwtype = htons(1);
+		arp->proto = htons(ETH_P_IP);
+		arp->hwlen = ETH_ALEN;
+		arp->protolen = 4;
+		arp->opcode = htons(ARP_REQUEST);
+		memcpy(arp->shwaddr, snp_mac, ETH_ALEN);
+		memcpy(arp->sipaddr, &snp_ip, 4);
+		grub_memset(arp->thwaddr, 0, ETH_ALEN);
+		memcpy(arp->tipaddr, &arp_ip, 4);
+		if (!snp_send(broadcast, ETH_P_ARP, sizeof (*arp)))
+			return 0;
+
+		snp_set_timeout(SNP_ARP_TIMEOUT);
+		while (!snp_timed_out()) {
+			int len;
+			grub_efi_uint16_t port;
+
+			snp_recv_udp(0, &len, &port);
+			if (arp_done)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/* Get the card and our addresses ready, the first time only. */
+static int snp_init(void)
+{
+	grub_efi_guid_t snp_guid = GRUB_EFI_SIMPLE_NETWORK_GUID;
+	grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+	EFI_PXE_BASE_CODE_MODE *mode;
+
+	if (snp_usable)
+		return snp_usable > 0;
+	snp_usable = -1;
+
+	if (!tftp_info.Pxe || !tftp_info.Handle || !tftp_info.ServerIp)
+		return 0;
+	mode = tftp_info.Pxe->Mode;
+	if (mode->UsingIpv6)
+		return 0;
+
+	snp = grub_efi_open_protocol(tftp_info.Handle, &snp_guid,
+				     GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
+	if (!snp || !snp->mode)
+		return 0;
+
+	if (snp->mode->state == GRUB_EFI_NETWORK_STOPPED)
+		Call_Service_1(snp->start, snp);
+	if (snp->mode->state == GRUB_EFI_NETWORK_STARTED)
+		Call_Service_3(snp->initialize, snp, 0, 0);
+	if (snp->mode->state != GRUB_EFI_NETWORK_INITIALIZED ||
+	    snp->mode->hw_address_size != ETH_ALEN ||
+	    snp->mode->media_header_size != ETH_HLEN)
+		return 0;
+
+	if (Call_Service_6(snp->receive_filters, snp,
+			   GRUB_EFI_SIMPLE_NETWORK_RECEIVE_UNICAST |
+			   GRUB_EFI_SIMPLE_NETWORK_RECEIVE_BROADCAST,
+			   0, 0, 0, NULL) != GRUB_EFI_SUCCESS)
+		return 0;
+
+	if (Call_Service_5(b->create_event, GRUB_EFI_EVT_TIMER,
+			   GRUB_EFI_TPL_CALLBACK, NULL, NULL,
+			   &snp_timer) != GRUB_EFI_SUCCESS)
+		return 0;
+
+	memcpy(snp_mac, snp->mode->current_address, ETH_ALEN);
+	snp_ip = mode->StationIp.Addr[0];
+	snp_netmask = mode->SubnetMask.Addr[0];
+	server_ip = tftp_info.ServerIp->Addr[0];
+
+	snp_blksize = snp->mode->max_packet_size - IP_HLEN - UDP_HLEN - 4;
+	if (snp_blksize > TFTP_MAX_BLKSIZE)
+		snp_blksize = TFTP_MAX_BLKSIZE;
+	if (snp_blksize < 512)
+		snp_blksize = 512;
+
+	/* Start the ports for our transfers somewhere random. */
+	snp_port = 49152 + (iostat_clock() & 0x3fff);
+
+	if (!snp_resolve()) {
+		grub_printf("Cannot reach the TFTP server through SNP\n");
+		return 0;
+	}
+
+	snp_usable = 1;
+	return 1;
+}
+
+static int tftp_send_ack(grub_efi_uint16_t block)
+{
+	grub_efi_uint16_t *pkt = (grub_efi_uint16_t *)UDP_PAYLOAD;
+
+	pkt[0] = htons(TFTP_ACK);
+	pkt[1] = htons(block);
+	return snp_send_udp(xfer.port, xfer.server_port, 4);
+}
+
+/* Tell the server we will not take the rest of the file. */
+static void tftp_send_error(grub_efi_uint16_t port, int code)
+{
+	grub_efi_uint16_t *pkt = (grub_efi_uint16_t *)UDP_PAYLOAD;
+
+	pkt[0] = htons(TFTP_ERROR);
+	pkt[1] = htons(code);
+	UDP_PAYLOAD[4] = '\0';
+	snp_send_udp(xfer.port, port, 5);
+}
+
+/* Parse the options the server took, from the OACK in PKT. */
+static int tftp_parse_oack(char *pkt, int len)
+{
+	char *end = pkt + len;
+	int size = -1;
+
+	xfer.blksize = 512;
+	xfer.windowsize = 1;
+
+	pkt += 2;
+	while (pkt < end) {
+		char *name = pkt, *value;
+		int val;
+
+		while (pkt < end && *pkt)
+			pkt++;
+		if (++pkt >= end)
+			break;
+		value = pkt;
+		while (pkt < end && *pkt)
+			pkt++;
+		if (pkt++ >= end)
+			break;
+
+		if (!safe_parse_maxint(&value, &val)) {
+			errnum = ERR_NONE;
+			continue;
+		}
+		if (!grub_strcmp(name, "blksize") && val >= 8 &&
+		    val <= snp_blksize)
+			xfer.blksize = val;
+		else if (!grub_strcmp(name, "windowsize") && val >= 1 &&
+			 val <= TFTP_WINDOWSIZE)
+			xfer.windowsize = val;
+		else if (!grub_strcmp(name, "tsize"))
+			size = val;
+	}
+
+	if (size < 0)
+		return 0;
+	xfer.size = size;
+	return 1;
+}
+
+/* Ask for FullPath and wait for the options the server takes.  Returns
+ * 1 once they have come, 0 if the server said no, or -1 if it cannot be
+ * used: no reply, or no support for the options.
+ */
+static int tftp_request(char *FullPath)
+{
+	char *pkt;
+	grub_efi_uint16_t port;
+	int len, try;
+
+	xfer.active = 0;
+	xfer.port = snp_port++;
+	if (snp_port < 49152)
+		snp_port = 49152;
+
+	for (try = 0; try < SNP_RRQ_RETRIES; try++) {
+		grub_efi_uint16_t *op = (grub_efi_uint16_t *)UDP_PAYLOAD;
+		char *p = (char *)UDP_PAYLOAD + 2;
+
+		if (grub_strlen(FullPath) > 255)
+			return -1;
+		*op = htons(TFTP_RRQ);
+		p += grub_sprintf(p, "%s", FullPath) + 1;
+		p += grub_sprintf(p, "octet") + 1;
+		p += grub_sprintf(p, "blksize") + 1;
+		p += grub_sprintf(p, "%d", snp_blksize) + 1;
+		p += grub_sprintf(p, "windowsize") + 1;
+		p += grub_sprintf(p, "%d", TFTP_WINDOWSIZE) + 1;
+		p += grub_sprintf(p, "tsize") + 1;
+		p += grub_sprintf(p, "0") + 1;
+		if (!snp_send_udp(xfer.port, TFTP_PORT,
+				  p - (char *)UDP_PAYLOAD))
+			return -1;
+
+		snp_set_timeout(SNP_TFTP_TIMEOUT);
+		while (!snp_timed_out()) {
+			pkt = (char *)snp_recv_udp(xfer.port, &len, &port);
+			if (!pkt || len < 2)
+				continue;
+
+			switch (ntohs(*(grub_efi_uint16_t *)pkt)) {
+			case TFTP_OACK:
+				xfer.server_port = port;
+				if (!tftp_parse_oack(pkt, len)) {
+					tftp_send_error(port, 8);
+					return -1;
+				}
+				xfer.active = 1;
+				return 1;
+			case TFTP_ERROR:
+				return 0;
+			case TFTP_DATA:
+				/* The server ignored the options. */
+				tftp_send_error(port, 8);
+				return -1;
+			}
+		}
+	}
+	return -1;
+}
+
+static void tftp_abort(void)
+{
+	if (xfer.active)
+		tftp_send_error(xfer.server_port, 0);
+	xfer.active = 0;
+}
+
+/* Receive the current transfer until at least WANT bytes of the file
+ * are in the buffer.  Blocks must come in order: after a gap we ACK the
+ * last block we have once, and the server goes on from there.
+ */
+static int tftp_receive(grub_efi_uintn_t want)
+{
+	struct iostat *st = iostat_get(IOSTAT_SERVER, server_ip);
+	unsigned long long start = iostat_clock();
+	int timeouts = 0, unacked = 0, gap = 0;
+
+	snp_set_timeout(SNP_TFTP_TIMEOUT);
+	while (xfer.active &&
+	       (xfer.received < want || xfer.received == xfer.size)) {
+		grub_efi_uint16_t port, op;
+		grub_efi_uint8_t *pkt;
+		grub_efi_uintn_t n;
+		int len;
+
+		pkt = snp_recv_udp(xfer.port, &len, &port);
+		if (!pkt) {
+			if (!snp_timed_out())
+				continue;
+			if (++timeouts > SNP_TFTP_RETRIES) {
+				iostat_done(st, start, 0, 0, 1);
+				tftp_abort();
+				return 0;
+			}
+			if (st)
+				st->retries++;
+			tftp_send_ack(xfer.block);
+			unacked = 0;
+			snp_set_timeout(SNP_TFTP_TIMEOUT);
+			continue;
+		}
+		if (port != xfer.server_port || len < 4)
+			continue;
+
+		op = ntohs(((grub_efi_uint16_t *)pkt)[0]);
+		if (op == TFTP_ERROR) {
+			xfer.active = 0;
+			iostat_done(st, start, 0, 0, 1);
+			return 0;
+		}
+		/* Our ACK of the options got lost. */
+		if (op == TFTP_OACK && xfer.received == 0) {
+			tftp_send_ack(0);
+			continue;
+		}
+		if (op != TFTP_DATA)
+			continue;
+
+		if (ntohs(((grub_efi_uint16_t *)pkt)[1]) !=
+		    (grub_efi_uint16_t)(xfer.block + 1)) {
+			if (!gap) {
+				tftp_send_ack(xfer.block);
+				unacked = 0;
+				gap = 1;
+			}
+			continue;
+		}
+
+		len -= 4;
+		n = len;
+		if (n > xfer.size - xfer.received)
+			n = xfer.size - xfer.received;
+		grub_memmove(xfer.buffer + xfer.received, pkt + 4, n);
+		xfer.received += n;
+		xfer.block++;
+		iostat_done(st, start, 0, len, 0);
+		start = iostat_clock();
+		timeouts = gap = 0;
+		snp_set_timeout(SNP_TFTP_TIMEOUT);
+
+		if (len < xfer.blksize) {
+			tftp_send_ack(xfer.block);
+			xfer.active = 0;
+		} else if (++unacked == xfer.windowsize) {
+			tftp_send_ack(xfer.block);
+			unacked = 0;
+		}
+	}
+	return xfer.received >= want;
+}
+
+/* Get the size of FullPath.  Returns 1 on success, 0 if the server
+ * does not have it, or -1 to ask the PXE base code instead.
+ */
+int efi_snp_tftp_size(char *FullPath, grub_efi_uintn_t *Size)
+{
+	grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+	grub_efi_tpl_t tpl;
+	int rc;
+
+	tpl = Call_Service_1(b->raise_tpl, GRUB_EFI_TPL_CALLBACK);
+	if (!snp_init()) {
+		Call_Service_1(b->restore_tpl, tpl);
+		return -1;
+	}
+
+	tftp_abort();
+	xfer.buffer = NULL;
+	rc = tftp_request(FullPath);
+	if (rc > 0) {
+		*Size = xfer.size;
+		tftp_abort();
+	}
+
+	Call_Service_1(b->restore_tpl, tpl);
+	return rc;
+}
+
+/* Read FullPath, of Size bytes, into Buffer, until at least the first
+ * Want bytes are there.  Returns the number of bytes there, which may
+ * be more, or -1 to ask the PXE base code instead.
+ */
+int efi_snp_tftp_read(char *FullPath, char *Buffer, grub_efi_uintn_t Size,
+		      grub_efi_uintn_t Want)
+{
+	grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+	grub_efi_tpl_t tpl;
+	int rc = -1, try;
+
+	if (xfer.buffer == Buffer && xfer.received >= Want)
+		return xfer.received;
+
+	tpl = Call_Service_1(b->raise_tpl, GRUB_EFI_TPL_CALLBACK);
+	if (!snp_init())
+		goto out;
+
+	/* If the reader stopped for long enough, the server may have given
+	 * up on a transfer half done; then start it again, once.  */
+	for (try = 0; try < 2; try++) {
+		int fresh = 0;
+
+		if (xfer.buffer != Buffer || !xfer.active) {
+			tftp_abort();
+			xfer.buffer = NULL;
+			if (tftp_request(FullPath) <= 0)
+				break;
+			if (xfer.size != Size) {
+				tftp_abort();
+				break;
+			}
+			xfer.buffer = Buffer;
+			xfer.received = 0;
+			xfer.block = 0;
+			if (!tftp_send_ack(0))
+				break;
+			fresh = 1;
+		}
+
+		if (tftp_receive(Want)) {
+			rc = xfer.received;
+			break;
+		}
+		if (fresh)
+			break;
+	}
+
+out:
+	Call_Service_1(b->restore_tpl, tpl);
+	return rc;
+}
+
+void efi_snp_tftp_close(void)
+{
+	grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+	grub_efi_tpl_t tpl;
+
+	if (xfer.active) {
+		tpl = Call_Service_1(b->raise_tpl, GRUB_EFI_TPL_CALLBACK);
+		tftp_abort();
+		Call_Service_1(b->restore_tpl, tpl);
+	}
+	xfer.buffer = NULL;
+	xfer.received = 0;
+}
@@ -0,0 +1,225 @@
+/* efiprof.c - sampling profiler driven by an EFI timer event */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2006  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* A periodic timer event samples where GRUB is.  The notify function
+   is called by the firmware from its timer interrupt, so the
+   interrupted instruction pointer is on the stack above it, but EFI
+   does not say where.  Instead the stack is searched upwards for the
+   first word that points into the code of GRUB: that is the
+   interrupted instruction pointer when GRUB itself was interrupted, or
+   the return address of the call into the firmware when the firmware
+   was, which charges firmware time to the GRUB code calling it (on
+   x86_64, to the x64_call wrappers).  A saved register holding a code
+   address may occasionally be taken instead.
+
+   The addresses are turned into functions with a table made from the
+   symbols of grub.so by mkprofsyms.sh and linked in as profsyms.o.  */
+
+#include <grub/efi/efi.h>
+#include <grub/efi/misc.h>
+#include <grub/misc.h>
+
+#include <shared.h>
+#include "efistubs.h"
+
+/* How far up the stack to look, in words.  */
+#define PROFILE_SCAN	2048
+
+/* Made by mkprofsyms.sh: the sorted function addresses relative to
+   ImageBase, the offsets of their names in the name strings, and the
+   end of the code as the last address.  */
+extern const unsigned long grub_efi_profile_addrs[];
+extern const unsigned int grub_efi_profile_names[];
+extern const char grub_efi_profile_strings[];
+extern const int grub_efi_profile_nsymbols;
+
+extern char ImageBase[];
+
+static grub_efi_event_t profile_event;
+static unsigned long *profile_counts;
+static unsigned long profile_samples;
+static unsigned long profile_outside;
+
+/* Return the function containing the code at OFFSET from ImageBase, or
+   -1 if it is not in GRUB.  */
+static int
+profile_lookup (unsigned long offset)
+{
+  int lo = 0, hi = grub_efi_profile_nsymbols;
+
+  if (offset < grub_efi_profile_addrs[0]
+      || offset >= grub_efi_profile_addrs[hi])
+    return -1;
+
+  while (hi - lo > 1)
+    {
+      int mid = (lo + hi) / 2;
+
+      if (grub_efi_profile_addrs[mid] <= offset)
+	lo = mid;
+      else
+	hi = mid;
+    }
+
+  return lo;
+}
+
+static void
+profile_tick (grub_efi_event_t event, void *context)
+{
+  unsigned long *sp = (unsigned long *) __builtin_frame_address (0) + 2;
+  int i;
+
+#ifdef EFI_FUNCTION_WRAPPER
+  /* Skip efi_notify_thunk.  */
+  sp += EFI_NOTIFY_FRAME / sizeof (unsigned long) + 1;
+#endif
+
+  profile_samples++;
+  for (i = 0; i < PROFILE_SCAN; i++)
+    {
+      int sym = profile_lookup (sp[i] - (unsigned long) ImageBase);
+
+      if (sym >= 0)
+	{
+	  profile_counts[sym]++;
+	  return;
+	}
+    }
+
+  profile_outside++;
+}
+
+/* Start sampling HZ times a second, forgetting the samples so far.  */
+int
+grub_efi_profile_start (int hz)
+{
+  grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+  void *notify, *context;
+
+  if (! grub_efi_profile_nsymbols)
+    {
+      grub_printf ("No symbol table was built into this image.\n");
+      return 0;
+    }
+
+  grub_efi_profile_stop ();
+
+  if (! profile_counts)
+    {
+      profile_counts = grub_malloc (grub_efi_profile_nsymbols
+				    * sizeof (*profile_counts));
+      if (! profile_counts)
+	{
+	  errnum = ERR_WONT_FIT;
+	  return 0;
+	}
+    }
+
+  grub_memset (profile_counts, 0,
+	       grub_efi_profile_nsymbols * sizeof (*profile_counts));
+  profile_samples = profile_outside = 0;
+
+#ifdef EFI_FUNCTION_WRAPPER
+  notify = efi_notify_thunk;
+  context = profile_tick;
+#else
+  notify = profile_tick;
+  context = 0;
+#endif
+
+  /* TPL_NOTIFY, so that callbacks are sampled too.  */
+  if (Call_Service_5 (b->create_event,
+		      GRUB_EFI_EVT_TIMER | GRUB_EFI_EVT_NOTIFY_SIGNAL,
+		      GRUB_EFI_TPL_NOTIFY, notify, context,
+		      &profile_event) != GRUB_EFI_SUCCESS)
+    {
+      grub_printf ("Cannot create the timer event.\n");
+      profile_event = 0;
+      return 0;
+    }
+
+  /* The timer counts in 100ns units.  */
+  if (Call_Service_3 (b->set_timer, profile_event, GRUB_EFI_TIMER_PERIODIC,
+		      10000000 / hz) != GRUB_EFI_SUCCESS)
+    {
+      grub_printf ("Cannot start the timer.\n");
+      grub_efi_profile_stop ();
+      return 0;
+    }
+
+  return 1;
+}
+
+void
+grub_efi_profile_stop (void)
+{
+  grub_efi_boot_services_t *b = grub_efi_system_table->boot_services;
+
+  if (! profile_event)
+    return;
+
+  Call_Service_3 (b->set_timer, profile_event, GRUB_EFI_TIMER_CANCEL, 0);
+  Call_Service_1 (b->close_event, profile_event);
+  profile_event = 0;
+}
+
+/* Print the COUNT functions with the most samples.  */
+void
+grub_efi_profile_dump (int count)
+{
+  unsigned long total = profile_samples;
+  int i;
+
+  if (! profile_counts || ! total)
+    {
+      grub_printf ("No samples.\n");
+      return;
+    }
+
+  grub_printf ("%lu samples, %lu outside GRUB%s\n", total, profile_outside,
+	       profile_event ? " (still sampling)" : "");
+
+  /* Pick the largest counts one by one, marking those printed by
+     setting their top bit.  */
+  while (count-- > 0)
+    {
+      unsigned long best = 0;
+      int sym = -1;
+
+      for (i = 0; i < grub_efi_profile_nsymbols; i++)
+	if ((long) profile_counts[i] > (long) best)
+	  {
+	    best = profile_counts[i];
+	    sym = i;
+	  }
+
+      if (sym < 0)
+	break;
+
+      grub_printf (" %lu.%lu%%  %lu  %s\n",
+		   best * 100 / total, best * 1000 / total % 10, best,
+		   grub_efi_profile_strings + grub_efi_profile_names[sym]);
+      profile_counts[sym] |= ~(~0UL >> 1);
+    }
+
+  for (i = 0; i < grub_efi_profile_nsymbols; i++)
+    profile_counts[i] &= ~0UL >> 1;
+}
@@ -9,11 +9,18 @@
 
 struct tftp_info tftp_info = {
 	.LoadedImage = NULL,
+	.Handle = NULL,
 	.Pxe = NULL,
 	.ServerIp = NULL,
-	.BasePath = NULL
+	.BasePath = NULL,
+	.MtftpInfo = NULL
 };
 
+static EFI_PXE_BASE_CODE_MTFTP_INFO mtftp_info;
+
+/* How much of the open file is in tftp_info.Buffer. */
+static grub_efi_uintn_t received;
+
 /*
  * CLIENT MAC ADDR: 00 15 17 4C E6 74
  * CLIENT IP: 10.16.52.158  MASK: 255.255.255.0  DHCP IP: 10.16.52.16
@@ -29,6 +36,22 @@ struct tftp_info tftp_info = {
  * BootpBootFile: X86PC/UNDI/pxelinux/bootx64.efi
  */
 
+static char *get_full_path(char *Filename)
+{
+	char *FullPath;
+
+	if (tftp_info.BasePath) {
+		int PathSize = 0;
+		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
+		FullPath = grub_malloc(PathSize);
+		grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath, Filename);
+	} else {
+		FullPath = grub_malloc(strlen(Filename) + 1);
+		strcpy(FullPath, Filename);
+	}
+	return FullPath;
+}
+
 static grub_efi_status_t tftp_get_file_size_defective_buffer_fallback(
 	char *Filename,
 	grub_efi_uintn_t *Size)
@@ -90,15 +113,15 @@ grub_efi_status_t tftp_get_file_size(
 	grub_efi_uintn_t BlockSize = 512;
 	grub_efi_status_t rc;
 	char *FullPath = NULL;
+	int found;
 
-	if (tftp_info.BasePath) {
-		int PathSize = 0;
-		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
-		FullPath = grub_malloc(PathSize);
-		grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath, Filename);
-	} else {
-		FullPath = grub_malloc(strlen(Filename));
-		strcpy(FullPath, Filename);
+	FullPath = get_full_path(Filename);
+
+	/* Our own stack first, then the PXE base code's. */
+	found = efi_snp_tftp_size(FullPath, Size);
+	if (found >= 0) {
+		grub_free(FullPath);
+		return found ? GRUB_EFI_SUCCESS : GRUB_EFI_NOT_FOUND;
 	}
 
 	rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe, OpCode,
@@ -112,6 +135,39 @@ grub_efi_status_t tftp_get_file_size(
 	return rc;
 }
 
+/* Fetch FullPath over the multicast group in tftp_info.MtftpInfo.  The
+ * PXE base code only hands us datagrams for the addresses in its IP
+ * filter, so the group is added there for the duration of the transfer.
+ */
+static grub_efi_status_t mtftp_read_file(
+	char *FullPath,
+	char *Buffer,
+	grub_efi_uint64_t BufferSize)
+{
+	EFI_PXE_BASE_CODE *Pxe = tftp_info.Pxe;
+	EFI_PXE_BASE_CODE_IP_FILTER Saved, Filter;
+	grub_efi_uintn_t BlockSize = 512;
+	grub_efi_status_t rc;
+
+	Saved = Pxe->Mode->IpFilter;
+	Filter = Saved;
+	Filter.Filters |= EFI_PXE_BASE_CODE_IP_FILTER_STATION_IP;
+	if (Filter.IpCnt < EFI_PXE_BASE_CODE_MAX_IPCNT)
+		Filter.IpList[Filter.IpCnt++] = tftp_info.MtftpInfo->MCastIp;
+
+	rc = Call_Service_2(Pxe->SetIpFilter, Pxe, &Filter);
+	if (rc != GRUB_EFI_SUCCESS)
+		return rc;
+
+	rc = Call_Service_10(Pxe->Mtftp, Pxe,
+		EFI_PXE_BASE_CODE_MTFTP_READ_FILE, Buffer, 0, &BufferSize,
+		&BlockSize, tftp_info.ServerIp, FullPath, tftp_info.MtftpInfo,
+		0);
+
+	Call_Service_2(Pxe->SetIpFilter, Pxe, &Saved);
+	return rc;
+}
+
 static grub_efi_status_t tftp_read_file(
 	char *Filename,
 	char *Buffer,
@@ -123,21 +179,34 @@ static grub_efi_status_t tftp_read_file(
 	grub_efi_uintn_t BlockSize = 512;
 	grub_efi_status_t rc;
 	char *FullPath = NULL;
+	struct iostat *st;
+	unsigned long long start;
 
-	if (tftp_info.BasePath) {
-		int PathSize = 0;
-		PathSize = strlen(tftp_info.BasePath) + 2 + strlen(Filename);
-		FullPath = grub_malloc(PathSize);
-		grub_sprintf(FullPath, "%s/%s", tftp_info.BasePath, Filename);
-	} else {
-		FullPath = grub_malloc(strlen(Filename));
-		strcpy(FullPath, Filename);
+	st = iostat_get(IOSTAT_SERVER,
+			tftp_info.ServerIp ? tftp_info.ServerIp->Addr[0] : 0);
+	start = iostat_clock();
+
+	FullPath = get_full_path(Filename);
+
+	if (tftp_info.MtftpInfo) {
+		rc = mtftp_read_file(FullPath, Buffer, BufferSize);
+		if (rc == GRUB_EFI_SUCCESS) {
+			grub_free(FullPath);
+			iostat_done(st, start, 0, BufferSize, 0);
+			return rc;
+		}
+		/* Whatever the group missed, we get by plain TFTP. */
+		grub_printf("MTFTP read failed (%d), falling back to TFTP\n",
+			    rc);
+		if (st)
+			st->retries++;
 	}
 
 	rc = Call_Service_10(tftp_info.Pxe->Mtftp, tftp_info.Pxe, OpCode,
 		Buffer, Overwrite, &BufferSize, &BlockSize, tftp_info.ServerIp,
 		FullPath, NULL, DontUseBuffer);
 	grub_free(FullPath);
+	iostat_done(st, start, 0, BufferSize, rc != GRUB_EFI_SUCCESS);
 	return rc;
 }
 
@@ -167,9 +236,28 @@ efi_tftp_read (char *addr, int size)
 		grub_printf(" = 0 (file not found)\n");
 		return 0;
 	}
-	if (filepos == 0) {
-		rc = tftp_read_file(tftp_info.LastPath, tftp_info.Buffer,
-				    filemax);
+	if (filepos + size > received) {
+		int got = -1;
+
+		/* Multicast is left to the PXE base code. */
+		if (!tftp_info.MtftpInfo) {
+			char *FullPath = get_full_path(tftp_info.LastPath);
+
+			got = efi_snp_tftp_read(FullPath, tftp_info.Buffer,
+						filemax, filepos + size);
+			grub_free(FullPath);
+		}
+		if (got >= 0) {
+			received = got;
+		} else {
+			rc = tftp_read_file(tftp_info.LastPath,
+					    tftp_info.Buffer, filemax);
+			if (rc != GRUB_EFI_SUCCESS) {
+				errnum = ERR_READ;
+				return 0;
+			}
+			received = filemax;
+		}
 	}
 
 	grub_memmove(addr, tftp_info.Buffer+filepos, size);
@@ -208,6 +296,7 @@ efi_tftp_dir (char *dirname)
 		sprintf(tftp_info.LastPath, "%s", name);
 		filemax = size;
 		filepos = 0;
+		received = 0;
 
 		tftp_info.Buffer = grub_malloc(filemax);
 
@@ -216,9 +305,77 @@ efi_tftp_dir (char *dirname)
 	return 0;
 }
 
+/* Configure multicast reads.  ARG is "on" to use the group given by the
+ * PXE boot server, "off", or "MCASTIP:CPORT:SPORT".
+ */
+int
+efi_tftp_multicast (char *arg)
+{
+	EFI_PXE_BASE_CODE_MTFTP_INFO info;
+	int i, val;
+
+	if (grub_memcmp(arg, "off", 3) == 0) {
+		tftp_info.MtftpInfo = NULL;
+		return 1;
+	}
+
+	grub_memset(&info, 0, sizeof (info));
+	if (grub_memcmp(arg, "on", 2) == 0) {
+		if (!grub_efi_pxe_get_mtftp_info(&info)) {
+			grub_printf("No MTFTP group from the boot server\n");
+			errnum = ERR_BAD_ARGUMENT;
+			return 0;
+		}
+	} else {
+		for (i = 0; i < 4; i++) {
+			if (!safe_parse_maxint(&arg, &val))
+				return 0;
+			if (val < 0 || val > 255 || *arg++ != (i < 3 ? '.' : ':')) {
+				errnum = ERR_BAD_ARGUMENT;
+				return 0;
+			}
+			info.MCastIp.v4.Addr[i] = val;
+		}
+		if (info.MCastIp.v4.Addr[0] < 224 ||
+		    info.MCastIp.v4.Addr[0] > 239) {
+			errnum = ERR_BAD_ARGUMENT;
+			return 0;
+		}
+		for (i = 0; i < 2; i++) {
+			if (i && *arg++ != ':') {
+				errnum = ERR_BAD_ARGUMENT;
+				return 0;
+			}
+			if (!safe_parse_maxint(&arg, &val))
+				return 0;
+			if (val <= 0 || val > 65535) {
+				errnum = ERR_BAD_ARGUMENT;
+				return 0;
+			}
+			if (i)
+				info.SPort = val;
+			else
+				info.CPort = val;
+		}
+	}
+
+	/* Seconds to listen for a transfer already running, and to wait
+	 * before opening our own. */
+	if (!info.ListenTimeout)
+		info.ListenTimeout = 1;
+	if (!info.TransmitTimeout)
+		info.TransmitTimeout = 2;
+
+	mtftp_info = info;
+	tftp_info.MtftpInfo = &mtftp_info;
+	return 1;
+}
+
 void
 efi_tftp_close (void)
 {
+	efi_snp_tftp_close();
+	received = 0;
 	filepos = 0;
 	filemax = -1;
 	grub_free(tftp_info.LastPath);
@@ -95,6 +95,11 @@
     { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } \
   }
 
+#define GRUB_EFI_BLOCK_IO2_GUID	\
+  { 0xa77b2472, 0xe282, 0x4e9f, \
+    { 0xa2, 0x45, 0xc2, 0xc0, 0xe2, 0x7b, 0xbc, 0xc1 } \
+  }
+
 #define GRUB_EFI_DEVICE_PATH_GUID	\
   { 0x09576e91, 0x6d3f, 0x11d2, \
     { 0x8e, 0x39, 0x00, 0xa0, 0xc9, 0x69, 0x72, 0x3b } \
@@ -130,6 +135,11 @@
     { 0x9a, 0x0c, 0x00, 0x90, 0x27, 0x3F, 0xc1, 0xfd } \
   }
 
+#define GRUB_EFI_SIMPLE_NETWORK_GUID	\
+  { 0xa19832b9, 0xac25, 0x11d3, \
+    { 0x9a, 0x2d, 0x00, 0x90, 0x27, 0x3f, 0xc1, 0x4d } \
+  }
+
 /* Enumerations.  */
 enum grub_efi_timer_delay
 {
@@ -1136,6 +1146,120 @@ struct grub_efi_block_io
 };
 typedef struct grub_efi_block_io grub_efi_block_io_t;
 
+struct grub_efi_block_io2_token
+{
+  grub_efi_event_t event;
+  grub_efi_status_t transaction_status;
+};
+typedef struct grub_efi_block_io2_token grub_efi_block_io2_token_t;
+
+struct grub_efi_block_io2
+{
+  grub_efi_block_io_media_t *media;
+    grub_efi_status_t (*reset) (struct grub_efi_block_io2 * this,
+				grub_efi_boolean_t extended_verification);
+    grub_efi_status_t (*read_blocks_ex) (struct grub_efi_block_io2 * this,
+					 grub_efi_uint32_t media_id,
+					 grub_efi_lba_t lba,
+					 grub_efi_block_io2_token_t * token,
+					 grub_efi_uintn_t buffer_size,
+					 void *buffer);
+    grub_efi_status_t (*write_blocks_ex) (struct grub_efi_block_io2 * this,
+					  grub_efi_uint32_t media_id,
+					  grub_efi_lba_t lba,
+					  grub_efi_block_io2_token_t * token,
+					  grub_efi_uintn_t buffer_size,
+					  void *buffer);
+    grub_efi_status_t (*flush_blocks_ex) (struct grub_efi_block_io2 * this,
+					  grub_efi_block_io2_token_t * token);
+};
+typedef struct grub_efi_block_io2 grub_efi_block_io2_t;
+
+enum grub_efi_simple_network_state
+{
+  GRUB_EFI_NETWORK_STOPPED,
+  GRUB_EFI_NETWORK_STARTED,
+  GRUB_EFI_NETWORK_INITIALIZED
+};
+typedef enum grub_efi_simple_network_state grub_efi_simple_network_state_t;
+
+#define GRUB_EFI_SIMPLE_NETWORK_RECEIVE_UNICAST		0x01
+#define GRUB_EFI_SIMPLE_NETWORK_RECEIVE_MULTICAST	0x02
+#define GRUB_EFI_SIMPLE_NETWORK_RECEIVE_BROADCAST	0x04
+#define GRUB_EFI_SIMPLE_NETWORK_RECEIVE_PROMISCUOUS	0x08
+#define GRUB_EFI_SIMPLE_NETWORK_RECEIVE_PROMISCUOUS_MULTICAST	0x10
+
+#define GRUB_EFI_MAX_MCAST_FILTER_CNT	16
+
+struct grub_efi_simple_network_mode
+{
+  grub_efi_uint32_t state;
+  grub_efi_uint32_t hw_address_size;
+  grub_efi_uint32_t media_header_size;
+  grub_efi_uint32_t max_packet_size;
+  grub_efi_uint32_t nv_ram_size;
+  grub_efi_uint32_t nv_ram_access_size;
+  grub_efi_uint32_t receive_filter_mask;
+  grub_efi_uint32_t receive_filter_setting;
+  grub_efi_uint32_t max_mcast_filter_count;
+  grub_efi_uint32_t mcast_filter_count;
+  grub_efi_mac_address_t mcast_filter[GRUB_EFI_MAX_MCAST_FILTER_CNT];
+  grub_efi_mac_address_t current_address;
+  grub_efi_mac_address_t broadcast_address;
+  grub_efi_mac_address_t permanent_address;
+  grub_efi_uint8_t if_type;
+  grub_efi_boolean_t mac_address_changeable;
+  grub_efi_boolean_t multiple_tx_supported;
+  grub_efi_boolean_t media_present_supported;
+  grub_efi_boolean_t media_present;
+};
+typedef struct grub_efi_simple_network_mode grub_efi_simple_network_mode_t;
+
+/* Only the functions used are declared in full.  */
+struct grub_efi_simple_network
+{
+  grub_efi_uint64_t revision;
+    grub_efi_status_t (*start) (struct grub_efi_simple_network * this);
+    grub_efi_status_t (*stop) (struct grub_efi_simple_network * this);
+    grub_efi_status_t (*initialize) (struct grub_efi_simple_network * this,
+				     grub_efi_uintn_t extra_rx_buffer_size,
+				     grub_efi_uintn_t extra_tx_buffer_size);
+  void (*reset) (void);
+  void (*shutdown) (void);
+    grub_efi_status_t (*receive_filters) (struct grub_efi_simple_network *
+					  this,
+					  grub_efi_uint32_t enable,
+					  grub_efi_uint32_t disable,
+					  grub_efi_boolean_t reset_mcast_filter,
+					  grub_efi_uintn_t mcast_filter_count,
+					  grub_efi_mac_address_t *
+					  mcast_filter);
+  void (*station_address) (void);
+  void (*statistics) (void);
+  void (*mcast_ip_to_mac) (void);
+  void (*nvdata) (void);
+    grub_efi_status_t (*get_status) (struct grub_efi_simple_network * this,
+				     grub_efi_uint32_t * interrupt_status,
+				     void **tx_buf);
+    grub_efi_status_t (*transmit) (struct grub_efi_simple_network * this,
+				   grub_efi_uintn_t header_size,
+				   grub_efi_uintn_t buffer_size,
+				   void *buffer,
+				   grub_efi_mac_address_t * src_addr,
+				   grub_efi_mac_address_t * dest_addr,
+				   grub_efi_uint16_t * protocol);
+    grub_efi_status_t (*receive) (struct grub_efi_simple_network * this,
+				  grub_efi_uintn_t * header_size,
+				  grub_efi_uintn_t * buffer_size,
+				  void *buffer,
+				  grub_efi_mac_address_t * src_addr,
+				  grub_efi_mac_address_t * dest_addr,
+				  grub_efi_uint16_t * protocol);
+  grub_efi_event_t wait_for_packet;
+  grub_efi_simple_network_mode_t *mode;
+};
+typedef struct grub_efi_simple_network grub_efi_simple_network_t;
+
 struct grub_efi_pixel_bitmask
 {
   grub_efi_uint32_t red_mask;
@@ -31,6 +31,11 @@
 #ifdef  EFI_FUNCTION_WRAPPER
 typedef long EFI_STATUS;
 
+/* Pass this as the notify function of an event, and an ELF function
+   taking the event and the context as the context.  */
+void efi_notify_thunk (void *event, void *context);
+#define EFI_NOTIFY_FRAME	184
+
 EFI_STATUS x64_call0 (unsigned long func);
 EFI_STATUS x64_call1 (unsigned long func, unsigned long a);
 EFI_STATUS x64_call2 (unsigned long func, unsigned long a, unsigned long b);
@@ -0,0 +1,74 @@
+#! /bin/sh
+#
+# mkprofsyms.sh - make the symbol table of the EFI profiler
+#
+# Usage: mkprofsyms.sh [NM SHARED-OBJECT]
+#
+# Print the C source of a table of the functions in SHARED-OBJECT, as
+# listed by NM, sorted by address.  Without arguments, print an empty
+# table, to link the shared object with the first time.
+
+echo "/* Generated by mkprofsyms.sh.  Do not edit.  */"
+echo
+
+if test $# -lt 2; then
+  cat <<EOF
+const unsigned long grub_efi_profile_addrs[] = { 0 };
+const unsigned int grub_efi_profile_names[] = { 0 };
+const char grub_efi_profile_strings[] = "";
+const int grub_efi_profile_nsymbols = 0;
+EOF
+  exit 0
+fi
+
+$1 -n -S "$2" | awk '
+BEGIN { n = 0; end = 0 }
+
+function hex(s,    i, n) {
+  n = 0
+  s = tolower(s)
+  for (i = 1; i <= length(s); i++)
+    n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+  return n
+}
+
+# Symbols defined in assembly have no size.
+NF == 4 { size = $2; type = $3; sym = $4 }
+NF == 3 { size = "0"; type = $2; sym = $3 }
+NF < 3 || (type != "t" && type != "T") { next }
+
+{
+  a = hex($1)
+  e = a + (size == "0" ? 1 : hex(size))
+  if (e > end)
+    end = e
+  if (n > 0 && a == last)
+    next
+  last = a
+  addr[n] = $1
+  name[n] = sym
+  n++
+}
+
+END {
+  printf "const unsigned long grub_efi_profile_addrs[] = {\n"
+  for (i = 0; i < n; i++)
+    printf "  0x%s,\n", addr[i]
+  printf "  0x%x\n};\n\n", end
+
+  printf "const unsigned int grub_efi_profile_names[] = {\n"
+  off = 0
+  for (i = 0; i < n; i++)
+    {
+      printf "  %d,\n", off
+      off += length(name[i]) + 1
+    }
+  printf "  0\n};\n\n"
+
+  printf "const char grub_efi_profile_strings[] =\n"
+  for (i = 0; i < n; i++)
+    printf "  \"%s\\0\"\n", name[i]
+  printf "  \"\";\n\n"
+
+  printf "const int grub_efi_profile_nsymbols = %d;\n", n
+}'
@@ -323,10 +323,126 @@ static char *get_pxe_file_dir(EFI_PXE_BASE_CODE *pxe)
 	return FileDir;
 }
 
+/* Return in *Gateway the router to reach other subnets through, from the
+ * route table of the PXE base code or else from option 3 of the DHCP
+ * ACK.  Returns 0 if there is none.
+ */
+int grub_efi_pxe_get_gateway(grub_efi_uint32_t *Gateway)
+{
+	EFI_PXE_BASE_CODE *pxe = tftp_info.Pxe;
+	EFI_PXE_BASE_CODE_PACKET *packet;
+	dhcp_option_parser parser;
+	EFI_DHCP4_PACKET_OPTION *option;
+	grub_efi_uint32_t i;
+
+	if (!pxe)
+		return 0;
+
+	for (i = 0; i < pxe->Mode->RouteTableEntries &&
+		    i < EFI_PXE_BASE_CODE_MAX_ROUTE_ENTRIES; i++) {
+		if (pxe->Mode->RouteTable[i].GwAddr.Addr[0]) {
+			*Gateway = pxe->Mode->RouteTable[i].GwAddr.Addr[0];
+			return 1;
+		}
+	}
+
+	packet = &pxe->Mode->DhcpAck;
+	if (memcmp((char *)&packet->Dhcpv4.DhcpMagik, DHCPMAGIK, 4))
+		return 0;
+
+	dhcp_option_parser_reset(&parser, packet);
+	while (dhcp_option_parser_next(&parser, &option)) {
+		if (option->OpCode != 3 || option->Length < 4)
+			continue;
+		memcpy(Gateway, option->Data, 4);
+		return 1;
+	}
+	return 0;
+}
+
+/* The PXE boot server hands out the MTFTP group and ports as PXE vendor
+ * options 1 to 5, encapsulated in option 43 of the proxy offer or of
+ * the DHCP ACK.  Returns 1 if they named a multicast group.
+ */
+int grub_efi_pxe_get_mtftp_info(EFI_PXE_BASE_CODE_MTFTP_INFO *Info)
+{
+	EFI_PXE_BASE_CODE *pxe = tftp_info.Pxe;
+	EFI_PXE_BASE_CODE_PACKET *packets[2];
+	int i;
+
+	if (!pxe)
+		return 0;
+
+	packets[0] = pxe->Mode->ProxyOfferReceived ?
+			&pxe->Mode->ProxyOffer : NULL;
+	packets[1] = &pxe->Mode->DhcpAck;
+
+	for (i = 0; i < 2; i++) {
+		dhcp_option_parser parser;
+		EFI_DHCP4_PACKET_OPTION *option;
+
+		if (!packets[i] || memcmp((char *)&packets[i]->Dhcpv4.DhcpMagik,
+					  DHCPMAGIK, 4))
+			continue;
+
+		dhcp_option_parser_reset(&parser, packets[i]);
+		while (dhcp_option_parser_next(&parser, &option)) {
+			grub_efi_uint8_t *sub = option->Data;
+			grub_efi_uint8_t *end = sub + option->Length;
+			int found = 0;
+
+			if (option->OpCode != 43)
+				continue;
+
+			memset(Info, '\0', sizeof (*Info));
+			while (sub + 2 <= end && sub[0] != 255) {
+				if (sub[0] == 0) {
+					sub++;
+					continue;
+				}
+				if (sub + 2 + sub[1] > end)
+					break;
+
+				switch (sub[0]) {
+				case 1: /* PXE_MTFTP_IP */
+					if (sub[1] == 4) {
+						memcpy(Info->MCastIp.v4.Addr,
+						       sub + 2, 4);
+						found = 1;
+					}
+					break;
+				case 2: /* PXE_MTFTP_CPORT */
+					if (sub[1] == 2)
+						Info->CPort = sub[2] << 8 | sub[3];
+					break;
+				case 3: /* PXE_MTFTP_SPORT */
+					if (sub[1] == 2)
+						Info->SPort = sub[2] << 8 | sub[3];
+					break;
+				case 4: /* PXE_MTFTP_TMOUT */
+					if (sub[1] == 1)
+						Info->ListenTimeout = sub[2];
+					break;
+				case 5: /* PXE_MTFTP_DELAY */
+					if (sub[1] == 1)
+						Info->TransmitTimeout = sub[2];
+					break;
+				}
+				sub += 2 + sub[1];
+			}
+
+			if (found && Info->CPort && Info->SPort)
+				return 1;
+		}
+	}
+	return 0;
+}
+
 static void set_pxe_info(grub_efi_loaded_image_t *LoadedImage,
-			EFI_PXE_BASE_CODE *pxe)
+			grub_efi_handle_t Handle, EFI_PXE_BASE_CODE *pxe)
 {
 	tftp_info.LoadedImage = LoadedImage;
+	tftp_info.Handle = Handle;
 	tftp_info.Pxe = pxe;
 	get_pxe_server(pxe, &tftp_info.ServerIp);
 	tftp_info.BasePath = get_pxe_file_dir(pxe);
@@ -346,7 +462,7 @@ char *grub_efi_pxe_get_config_path(grub_efi_loaded_image_t *LoadedImage)
 	char hexip[9];
 	int hexiplen;
 
-	grub_efi_handle_t *handle, *handles;
+	grub_efi_handle_t *handle, *handles, nic = NULL;
 	grub_efi_uintn_t num_handles;
 
 	handles = grub_efi_locate_handle(GRUB_EFI_BY_PROTOCOL,
@@ -361,15 +477,17 @@ char *grub_efi_pxe_get_config_path(grub_efi_loaded_image_t *LoadedImage)
 			GRUB_EFI_OPEN_PROTOCOL_GET_PROTOCOL);
 		if (!pxe || !pxe->Mode)
 			continue;
-		if (pxe->Mode->Started && pxe->Mode->DhcpAckReceived)
+		if (pxe->Mode->Started && pxe->Mode->DhcpAckReceived) {
+			nic = *handle;
 			break;
+		}
 	}
 	grub_free(handles);
 
 	if (!pxe)
 		return NULL;
 
-	set_pxe_info(LoadedImage, pxe);
+	set_pxe_info(LoadedImage, nic, pxe);
 
 	FileName = grub_malloc(strlen("1902dcf5-7190-d811-bbd6-6ef21c690030"));
 
@@ -222,16 +222,28 @@ typedef struct {
 
 struct tftp_info {
 	grub_efi_loaded_image_t *LoadedImage;
+	/* The card the PXE base code runs on. */
+	grub_efi_handle_t Handle;
 	EFI_PXE_BASE_CODE *Pxe;
 	EFI_IP_ADDRESS *ServerIp;
 	char *BasePath;
 	char *LastPath;
 	char *Buffer;
+	/* Non-NULL if files are to be fetched by multicast. */
+	EFI_PXE_BASE_CODE_MTFTP_INFO *MtftpInfo;
 };
 
 extern struct tftp_info tftp_info;
 extern grub_efi_status_t tftp_get_file_size(
 	char *Filename,
 	grub_efi_uintn_t *Size);
+extern int grub_efi_pxe_get_mtftp_info(EFI_PXE_BASE_CODE_MTFTP_INFO *Info);
+extern int grub_efi_pxe_get_gateway(grub_efi_uint32_t *Gateway);
+
+/* efinic.c */
+extern int efi_snp_tftp_size(char *FullPath, grub_efi_uintn_t *Size);
+extern int efi_snp_tftp_read(char *FullPath, char *Buffer,
+			     grub_efi_uintn_t Size, grub_efi_uintn_t Want);
+extern void efi_snp_tftp_close(void);
 
 #endif /* PXE_H */
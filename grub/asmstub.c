@@ -43,6 +43,7 @@ int grub_stage2 (void);
 #include <termios.h>
 #include <signal.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
 
 #ifdef __linux__
 # include <sys/ioctl.h>		/* ioctl */
@@ -348,6 +349,117 @@ assign_device_name (int drive, const char *device)
     device_map[drive] = strdup (device);
 }
 
+/* The maximum number of jobs running at the same time.  */
+#define JOB_MAX	16
+
+/* A child process started by job_start, and the file which holds its
+   output until job_wait prints it.  */
+static struct job
+{
+  pid_t pid;
+  FILE *out;
+}
+jobs[JOB_MAX];
+
+/* Run FUNC (DATA) in a child process, and return its process ID, or
+   zero if it cannot be started. The exit status of the child is the
+   return value of FUNC, which must be in the range from 0 to 255.  */
+int
+job_start (int (*func) (void *), void *data)
+{
+  struct job *job = 0;
+  pid_t pid;
+  int i;
+
+  for (i = 0; i < JOB_MAX; i++)
+    if (! jobs[i].pid)
+      {
+	job = &jobs[i];
+	break;
+      }
+
+  if (! job)
+    return 0;
+
+  job->out = tmpfile ();
+  if (! job->out)
+    return 0;
+
+  fflush (stdout);
+  pid = fork ();
+  if (pid < 0)
+    {
+      fclose (job->out);
+      job->out = 0;
+      return 0;
+    }
+
+  if (pid == 0)
+    {
+      int status;
+
+      /* The disks opened by the parent share their file offsets with
+	 it, so open them again. Use the same descriptors, which the
+	 geometry cached in stage2 refers to.  */
+      for (i = 0; i < NUM_DISKS; i++)
+	if (disks[i].flags != -1 && device_map[i])
+	  {
+	    int mode = fcntl (disks[i].flags, F_GETFL);
+	    int fd = open (device_map[i], mode & (O_ACCMODE | O_DIRECT));
+
+	    if (fd < 0 || dup2 (fd, disks[i].flags) < 0)
+	      _exit (ERR_DEV_VALUES);
+	    close (fd);
+	  }
+
+      dup2 (fileno (job->out), STDOUT_FILENO);
+      status = func (data);
+      fflush (stdout);
+      _exit (status & 0xFF);
+    }
+
+  job->pid = pid;
+  return pid;
+}
+
+/* Wait for any job to finish, and print its output. Set *STATUS to its
+   exit status, or -1 if it was killed. Return its process ID, or zero
+   if there is no job.  */
+int
+job_wait (int *status)
+{
+  struct job *job = 0;
+  pid_t pid;
+  int wstatus;
+  int c, i;
+
+  while (! job)
+    {
+      pid = waitpid (-1, &wstatus, 0);
+      if (pid < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  return 0;
+	}
+
+      for (i = 0; i < JOB_MAX; i++)
+	if (jobs[i].pid == pid)
+	  job = &jobs[i];
+    }
+
+  rewind (job->out);
+  while ((c = getc (job->out)) != EOF)
+    grub_putchar (c);
+
+  fclose (job->out);
+  job->out = 0;
+  job->pid = 0;
+
+  *status = WIFEXITED (wstatus) ? WEXITSTATUS (wstatus) : -1;
+  return pid;
+}
+
 void
 stop (void)
 {
@@ -438,7 +550,7 @@ unsigned short ascii_key_map[KEY_MAP_SIZE + 1];
 
 /* Copy MAP to the drive map and set up the int13 handler.  */
 void
-set_int13_handler (unsigned short *map)
+set_int13_handler (unsigned short *map, struct rd_params *rd)
 {
   /* Nothing to do in the simulator.  */
 }
@@ -586,6 +698,14 @@ getrtsecs (void)
   return time (0);
 }
 
+/* Don't spin while polling for input. With curses, checkkey already
+   waits for a while, but other terminals do not.  */
+void
+grub_idle (void)
+{
+  usleep (10000);
+}
+
 int
 currticks (void)
 {
@@ -866,6 +986,13 @@ get_diskinfo (int drive, struct geometry *geometry)
      descriptor to biosdisk.  Thank God nobody's looking at this comment,
      or my reputation would be ruined. --Gord */
 
+  if (MD_DRIVE_P (drive))
+    return md_get_diskinfo (drive, geometry);
+  if (RD_DRIVE_P (drive))
+    return rd_get_diskinfo (drive, geometry);
+  if (LD_DRIVE_P (drive))
+    return ld_get_diskinfo (drive, geometry);
+
   /* See if we have a cached device. */
   if (disks[drive].flags == -1)
     {
@@ -1052,6 +1179,46 @@ hex_dump (void *buf, size_t size)
   grub_printf ("\n");
 }
 
+/* Wait as long as the slow media modeled for DRIVE would take to
+   transfer NSEC sectors from SECTOR, and count the time for iostat.  The
+   jitter comes from a seeded generator, so that a run takes as long on
+   the model every time.  */
+static void
+model_disk (int drive, int sector, int nsec)
+{
+  struct disk_model *model = &disk_models[drive];
+  struct iostat *st;
+  unsigned long long usec;
+
+  if (! model->latency && ! model->rate && ! model->seek && ! model->jitter)
+    return;
+
+  usec = model->latency;
+  if (model->rate)
+    usec += ((unsigned long long) nsec * get_sector_size (drive) * 1000000
+	     / ((unsigned long long) model->rate << 10));
+  if ((unsigned long) sector != model->next)
+    usec += model->seek;
+  if (model->jitter)
+    {
+      model->seed = (model->seed * 1103515245 + 12345) & 0xffffffff;
+      usec += ((model->seed >> 16) & 0x7fff) % (model->jitter + 1);
+    }
+  model->next = sector + nsec;
+
+  st = iostat_get (IOSTAT_DISK, drive);
+  if (st)
+    st->modeled += usec;
+
+  while (usec > 0)
+    {
+      unsigned long part = usec > 1000000 ? 1000000 : usec;
+
+      usleep (part);
+      usec -= part;
+    }
+}
+
 int
 biosdisk (int subfunc, int drive, struct geometry *geometry,
 	  int sector, int nsec, int segment)
@@ -1059,10 +1226,19 @@ biosdisk (int subfunc, int drive, struct geometry *geometry,
   char *buf;
   int fd = geometry->flags;
 
+  if (MD_DRIVE_P (drive))
+    return md_biosdisk (subfunc, drive, geometry, sector, nsec, segment);
+  if (RD_DRIVE_P (drive))
+    return rd_biosdisk (subfunc, drive, geometry, sector, nsec, segment);
+  if (LD_DRIVE_P (drive))
+    return ld_biosdisk (subfunc, drive, geometry, sector, nsec, segment);
+
   /* Get the file pointer from the geometry, and make sure it matches. */
   if (fd == -1 || fd != disks[drive].flags)
     return BIOSDISK_ERROR_GEOMETRY;
 
+  model_disk (drive, sector, nsec);
+
   /* Seek to the specified location. */
 #if defined(__linux__) && (!defined(__GLIBC__) || \
 	((__GLIBC__ < 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ < 1))))
@@ -650,6 +650,8 @@ check_device (const char *device)
   return 1;
 }
 
+struct disk_model disk_models[NUM_DISKS];
+
 /* Read mapping information from FP, and write it to MAP.  */
 static void rdm_show_error (const char *map_file, int no, const char *msg)
 {
@@ -666,6 +668,47 @@ static void rdm_show_warning (const char *map_file,int no, const char *msg, ...)
   va_end (ap);
 }
 
+/* Read the media model in the rest of a line of the device map, like
+   "latency=800 rate=20000 seek=8000 jitter=200 seed=1", into MODEL.  */
+static int
+read_disk_model (char *ptr, struct disk_model *model)
+{
+  memset (model, 0, sizeof (*model));
+
+  while (1)
+    {
+      unsigned long *field;
+      int len;
+
+      while (*ptr && isspace (*ptr))
+	ptr++;
+      if (! *ptr || *ptr == '#')
+	return 1;
+
+      for (len = 0; ptr[len] && ptr[len] != '='; len++)
+	;
+      if (len == 7 && ! strncmp (ptr, "latency", len))
+	field = &model->latency;
+      else if (len == 4 && ! strncmp (ptr, "rate", len))
+	field = &model->rate;
+      else if (len == 4 && ! strncmp (ptr, "seek", len))
+	field = &model->seek;
+      else if (len == 6 && ! strncmp (ptr, "jitter", len))
+	field = &model->jitter;
+      else if (len == 4 && ! strncmp (ptr, "seed", len))
+	field = &model->seed;
+      else
+	return 0;
+
+      ptr += len;
+      if (*ptr++ != '=' || ! isdigit (*ptr))
+	return 0;
+      *field = strtoul (ptr, &ptr, 0);
+      if (*ptr && ! isspace (*ptr))
+	return 0;
+    }
+}
+
 static int
 read_device_map (FILE *fp, char **map, const char *map_file)
 {
@@ -751,7 +794,8 @@ read_device_map (FILE *fp, char **map, const char *map_file)
       eptr = ptr;
       while (*eptr && ! isspace (*eptr))
 	eptr++;
-      *eptr = 0;
+      if (*eptr)
+	*eptr++ = 0;
 
       /* Multiple entries for a given drive is not allowed.  */
       if (map[drive])
@@ -762,6 +806,12 @@ read_device_map (FILE *fp, char **map, const char *map_file)
       
       map[drive] = strdup (ptr);
       assert (map[drive]);
+
+      if (! read_disk_model (eptr, &disk_models[drive]))
+	{
+	  rdm_show_error (map_file, line_number, "Bad media model");
+	  return 0;
+	}
     }
   
   return 1;
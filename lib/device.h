@@ -32,6 +32,22 @@
 #define DEFAULT_HD_HEADS	128
 #define DEFAULT_HD_SECTORS	63
 
+/* A model of slow media for a drive of the device map, given after its
+   file name, as in "latency=800 rate=20000".  All zero for a drive read
+   at the speed of its file.  */
+struct disk_model
+{
+  unsigned long latency;	/* microseconds per request */
+  unsigned long rate;		/* kilobytes per second, 0 for no limit */
+  unsigned long seek;		/* microseconds more for a request which
+				   does not follow the last one */
+  unsigned long jitter;		/* up to as many microseconds more */
+  unsigned long seed;		/* of the jitter */
+  unsigned long next;		/* the sector after the last request */
+};
+
+extern struct disk_model disk_models[NUM_DISKS];
+
 /* Function prototypes.  */
 extern void get_drive_geometry (struct geometry *geom, char **map, int drive);
 extern int check_device (const char *device);
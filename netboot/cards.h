@@ -70,6 +70,11 @@ extern struct nic	*eepro_probe(struct nic *, unsigned short *
 	PCI_ARG(struct pci_device *));
 #endif
 
+#ifdef	INCLUDE_E1000
+extern struct nic	*e1000_probe(struct nic *, unsigned short *
+	PCI_ARG(struct pci_device *));
+#endif
+
 #ifdef	INCLUDE_EEPRO100
 extern struct nic	*eepro100_probe(struct nic *, unsigned short *
 	PCI_ARG(struct pci_device *));
@@ -180,4 +185,9 @@ extern struct nic	*tlan_probe(struct nic *, unsigned short *
         PCI_ARG(struct pci_device *));
 #endif
 
+#ifdef	INCLUDE_VIRTIO_NET
+extern struct nic	*virtio_net_probe(struct nic *, unsigned short *
+	PCI_ARG(struct pci_device *));
+#endif
+
 #endif	/* CARDS_H */
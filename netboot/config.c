@@ -31,7 +31,7 @@
 #include <nic.h>
 
 #undef	INCLUDE_PCI
-#if	defined(INCLUDE_NS8390) || defined(INCLUDE_EEPRO100) || defined(INCLUDE_LANCE) || defined(INCLUDE_EPIC100) || defined(INCLUDE_TULIP) || defined(INCLUDE_OTULIP) || defined(INCLUDE_3C90X) ||  defined(INCLUDE_3C595) || defined(INCLUDE_RTL8139) || defined(INCLUDE_VIA_RHINE) || defined(INCLUDE_W89C840) || defined(INCLUDE_DAVICOM) || defined(INCLUDE_SIS900) || defined(INCLUDE_NATSEMI) || defined(INCLUDE_TLAN)
+#if	defined(INCLUDE_NS8390) || defined(INCLUDE_EEPRO100) || defined(INCLUDE_LANCE) || defined(INCLUDE_EPIC100) || defined(INCLUDE_TULIP) || defined(INCLUDE_OTULIP) || defined(INCLUDE_3C90X) ||  defined(INCLUDE_3C595) || defined(INCLUDE_RTL8139) || defined(INCLUDE_VIA_RHINE) || defined(INCLUDE_W89C840) || defined(INCLUDE_DAVICOM) || defined(INCLUDE_SIS900) || defined(INCLUDE_NATSEMI) || defined(INCLUDE_TLAN) || defined(INCLUDE_VIRTIO_NET) || defined(INCLUDE_E1000)
 	/* || others later */
 # define INCLUDE_PCI
 # include <pci.h>
@@ -113,6 +113,32 @@ static struct pci_device pci_nic_list[] =
   { PCI_VENDOR_ID_3COM,		0x7646,
     "3CSOHO100-TX", 0, 0, 0, 0},
 #endif
+#ifdef	INCLUDE_E1000
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82540EM,
+    "Intel PRO/1000 82540EM", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82540EM_LOM,
+    "Intel PRO/1000 82540EM LOM", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82544GC,
+    "Intel PRO/1000 82544GC", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82545EM,
+    "Intel PRO/1000 82545EM", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82546EB,
+    "Intel PRO/1000 82546EB", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82541GI,
+    "Intel PRO/1000 82541GI", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82547GI,
+    "Intel PRO/1000 82547GI", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82571EB,
+    "Intel PRO/1000 82571EB", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82572EI,
+    "Intel PRO/1000 82572EI", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82573L,
+    "Intel PRO/1000 82573L", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82574L,
+    "Intel 82574L Gigabit", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82583V,
+    "Intel 82583V Gigabit", 0, 0, 0, 0},
+#endif
 #ifdef	INCLUDE_EEPRO100
   { PCI_VENDOR_ID_INTEL,	PCI_DEVICE_ID_INTEL_82557,
     "Intel EtherExpressPro100", 0, 0, 0, 0},
@@ -218,6 +244,13 @@ static struct pci_device pci_nic_list[] =
     "OC2326", 0, 0, 0, 0},
 #endif
 
+#ifdef INCLUDE_VIRTIO_NET
+  { PCI_VENDOR_ID_REDHAT_QUMRANET,	PCI_DEVICE_ID_VIRTIO_NET,
+    "Virtio network device", 0, 0, 0, 0},
+  { PCI_VENDOR_ID_REDHAT_QUMRANET,	PCI_DEVICE_ID_VIRTIO_NET_MODERN,
+    "Virtio 1.0 network device", 0, 0, 0, 0},
+#endif
+
   /* other PCI NICs go here */
   {0, 0, NULL, 0, 0, 0, 0}
 };
@@ -276,6 +309,20 @@ static struct pci_dispatch_table PCI_NIC[] =
   { PCI_VENDOR_ID_3COM,     0x9805,                        t595_probe },
   { PCI_VENDOR_ID_3COM,     0x7646,                        t595_probe },
 # endif /* INCLUDE_3C595 */
+# ifdef	INCLUDE_E1000
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82540EM,   e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82540EM_LOM, e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82544GC,   e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82545EM,   e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82546EB,   e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82541GI,   e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82547GI,   e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82571EB,   e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82572EI,   e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82573L,    e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82574L,    e1000_probe },
+  { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82583V,    e1000_probe },
+# endif /* INCLUDE_E1000 */
 # ifdef	INCLUDE_EEPRO100
   { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82557,     eepro100_probe },
   { PCI_VENDOR_ID_INTEL,    PCI_DEVICE_ID_INTEL_82559ER,   eepro100_probe },
@@ -339,6 +386,10 @@ static struct pci_dispatch_table PCI_NIC[] =
 # ifdef INCLUDE_TLAN
   { PCI_VENDOR_ID_OLICOM,   PCI_DEVICE_ID_OLICOM_OC2326,   tlan_probe },
 # endif /* INCLUDE_TLAN */
+# ifdef INCLUDE_VIRTIO_NET
+  { PCI_VENDOR_ID_REDHAT_QUMRANET, PCI_DEVICE_ID_VIRTIO_NET, virtio_net_probe },
+  { PCI_VENDOR_ID_REDHAT_QUMRANET, PCI_DEVICE_ID_VIRTIO_NET_MODERN, virtio_net_probe },
+# endif /* INCLUDE_VIRTIO_NET */
   { 0,                      0,                             0 }
 };
 #endif /* GRUB && INCLUDE_PCI */
@@ -395,6 +446,9 @@ static struct dispatch_table	NIC[] =
 #ifdef	INCLUDE_EEPRO
   { "EEPRO", eepro_probe, 0 },
 #endif
+#ifdef	INCLUDE_E1000
+  { "E1000", e1000_probe, pci_ioaddrs },
+#endif
 #ifdef	INCLUDE_EEPRO100
   { "EEPRO100", eepro100_probe, pci_ioaddrs },
 #endif
@@ -457,6 +511,9 @@ static struct dispatch_table	NIC[] =
 #endif
 #ifdef	INCLUDE_TLAN
   { "Olicom 2326", tlan_probe, pci_ioaddrs },
+#endif
+#ifdef	INCLUDE_VIRTIO_NET
+  { "Virtio", virtio_net_probe, pci_ioaddrs },
 #endif
   /* this entry must always be last to mark the end of list */
   { 0, 0, 0 }
@@ -470,7 +527,8 @@ eth_dummy (struct nic *dummy)
   return 0;
 }
 
-static char	packet[ETH_FRAME_LEN];
+/* One spare byte, for padding an odd-sized packet when checksumming it.  */
+static char	packet[ETH_FRAME_LEN + 1];
 
 struct nic	nic =
 {
@@ -514,6 +572,8 @@ eth_probe (void)
   /* Clear the ARP table.  */
   grub_memset ((char *) arptable, 0,
 	       MAX_ARP * sizeof (struct arptable_t));
+  /* Free the IP reassembly slots, which are not in the BSS.  */
+  grub_memset ((char *) IP_REASM_BUF, 0, IP_REASM_BUFLEN);
   
   p = 0;
   
@@ -534,6 +594,11 @@ eth_probe (void)
 	  break;
 	}
     }
+  /* Otherwise, try a device which has only memory mapped registers.  */
+  if (p->vendor == 0)
+    for (p = pci_nic_list; p->vendor != 0; ++p)
+      if (p->membase != 0)
+	break;
 #endif
   
   etherboot_printf("Probing...");
@@ -580,6 +645,8 @@ eth_probe (void)
 int
 eth_poll (void)
 {
+  /* NIC.PACKET may point to a datagram put together from fragments.  */
+  nic.packet = packet;
   return ((*nic.poll) (&nic));
 }
 
@@ -0,0 +1,447 @@
+/* e1000.c - etherboot driver for Intel PRO/1000 network controllers
+
+  This software may be used and distributed according to the terms
+  of the GNU Public License, incorporated herein by reference.
+
+  Supports the 8254x family (e1000) and the 8257x/82583 family (e1000e),
+  including the 82540EM and 82574L emulated by QEMU, through the memory
+  mapped registers of BAR 0.  Only the legacy descriptor formats are
+  used, and the device is polled: interrupts are masked for good.
+
+  All receive descriptors are kept owned by the device, so that a burst
+  of TFTP data packets is taken in without the driver.  Descriptors are
+  handed back in batches with a single write of the tail register.
+  Transmit descriptors are reclaimed lazily, so the driver does not wait
+  for each frame to leave before returning.
+
+*/
+
+#include "etherboot.h"
+#include "nic.h"
+#include "pci.h"
+#include "cards.h"
+#include "timer.h"
+
+#undef DEBUG_E1000
+
+#define E1000_TIMEOUT		(1*TICKS_PER_SEC)
+#define E1000_LINK_TIMEOUT	(3*TICKS_PER_SEC)
+
+/* Both rings must be a multiple of 128 bytes, i.e. of 8 descriptors.
+   Every transmit descriptor points at the one transmit buffer.  */
+#define NUM_RX_DESC		8
+#define NUM_TX_DESC		8
+/* Hand consumed receive descriptors back after this many.  */
+#define RX_REFILL_BATCH		(NUM_RX_DESC / 4)
+
+/* The receive buffer size set in RCTL; a frame always fits in one.  */
+#define E1000_RX_BUF_SIZE	2048
+#define E1000_TX_BUF_SIZE	(ETH_FRAME_LEN + 2)
+
+/* Register offsets.  The queue 0 registers are at their 8254x places,
+   which the 8257x keep as aliases.  */
+enum e1000_registers {
+	E1000_CTRL=0x0000, E1000_STATUS=0x0008, E1000_EERD=0x0014,
+	E1000_ICR=0x00C0, E1000_IMC=0x00D8, E1000_RCTL=0x0100,
+	E1000_TCTL=0x0400, E1000_TIPG=0x0410,
+	E1000_RDBAL=0x2800, E1000_RDBAH=0x2804, E1000_RDLEN=0x2808,
+	E1000_RDH=0x2810, E1000_RDT=0x2818,
+	E1000_TDBAL=0x3800, E1000_TDBAH=0x3804, E1000_TDLEN=0x3808,
+	E1000_TDH=0x3810, E1000_TDT=0x3818,
+	E1000_MTA=0x5200, E1000_RAL=0x5400, E1000_RAH=0x5404,
+};
+
+#define E1000_MTA_SIZE		128
+
+/* CTRL bits.  */
+#define CTRL_ASDE		0x00000020
+#define CTRL_SLU		0x00000040
+#define CTRL_RST		0x04000000
+/* STATUS bits.  */
+#define STATUS_LU		0x00000002
+/* RCTL bits; a buffer size of 2048 is all zeroes.  */
+#define RCTL_EN			0x00000002
+#define RCTL_MPE		0x00000010
+#define RCTL_BAM		0x00008000
+#define RCTL_SECRC		0x04000000
+/* TCTL bits.  */
+#define TCTL_EN			0x00000002
+#define TCTL_PSP		0x00000008
+#define TCTL_CT			(0x0F << 4)
+#define TCTL_COLD		(0x40 << 12)
+/* The inter packet gap recommended for copper.  */
+#define TIPG_DEFAULT		0x0060200A
+/* RAH bits.  */
+#define RAH_AV			0x80000000
+
+/* EERD: where the address and the done bit are varies by family.  */
+#define EERD_START		0x00000001
+#define EERD_DONE		0x00000010
+#define EERD_ADDR_SHIFT		8
+#define EERD_DONE_E1000E	0x00000002
+#define EERD_ADDR_SHIFT_E1000E	2
+#define EERD_DATA_SHIFT		16
+
+/* Descriptor bits.  */
+#define RXD_STAT_DD		0x01
+#define RXD_STAT_EOP		0x02
+#define TXD_CMD_EOP		0x01
+#define TXD_CMD_IFCS		0x02
+#define TXD_CMD_RS		0x08
+#define TXD_STAT_DD		0x01
+
+struct e1000_rx_desc {
+	unsigned int addr_lo, addr_hi;
+	unsigned short length;
+	unsigned short csum;
+	volatile unsigned char status;
+	unsigned char errors;
+	unsigned short special;
+};
+
+struct e1000_tx_desc {
+	unsigned int addr_lo, addr_hi;
+	unsigned short length;
+	unsigned char cso;
+	unsigned char cmd;
+	volatile unsigned char status;
+	unsigned char css;
+	unsigned short special;
+};
+
+/* Only x86 is supported, where stores are not reordered against each
+   other, so keeping the compiler from doing it is enough.  */
+#define e1000_barrier()	__asm__ __volatile__ ("" : : : "memory")
+
+static unsigned long membase;
+static int e1000e;
+
+static unsigned int rx_next;		/* the next descriptor to look at */
+static unsigned int rx_pending;		/* consumed, not yet handed back */
+static unsigned int tx_tail;		/* the next descriptor to fill */
+static unsigned int tx_clean;		/* the oldest descriptor in flight */
+
+/* The rings and buffers are too large for the Stage 2 image, so they
+   live in NIC_BUF, which is page aligned.  */
+struct e1000_mem {
+	struct e1000_rx_desc rx_ring[NUM_RX_DESC];
+	struct e1000_tx_desc tx_ring[NUM_TX_DESC];
+	unsigned char rx_buffer[NUM_RX_DESC][E1000_RX_BUF_SIZE];
+	unsigned char tx_buffer[E1000_TX_BUF_SIZE];
+};
+#define emem	((struct e1000_mem *) NIC_BUF)
+
+/* The devices known, and whether each is of the 8257x family.  */
+static const struct {
+	unsigned short dev_id;
+	unsigned char e1000e;
+} e1000_devices[] = {
+	{ PCI_DEVICE_ID_INTEL_82540EM, 0 },
+	{ PCI_DEVICE_ID_INTEL_82540EM_LOM, 0 },
+	{ PCI_DEVICE_ID_INTEL_82544GC, 0 },
+	{ PCI_DEVICE_ID_INTEL_82545EM, 0 },
+	{ PCI_DEVICE_ID_INTEL_82546EB, 0 },
+	{ PCI_DEVICE_ID_INTEL_82541GI, 0 },
+	{ PCI_DEVICE_ID_INTEL_82547GI, 0 },
+	{ PCI_DEVICE_ID_INTEL_82571EB, 1 },
+	{ PCI_DEVICE_ID_INTEL_82572EI, 1 },
+	{ PCI_DEVICE_ID_INTEL_82573L, 1 },
+	{ PCI_DEVICE_ID_INTEL_82574L, 1 },
+	{ PCI_DEVICE_ID_INTEL_82583V, 1 },
+	{ 0, 0 }
+};
+
+struct nic *e1000_probe(struct nic *nic, unsigned short *probeaddrs,
+	struct pci_device *pci);
+static unsigned long e1000_bar0(struct pci_device *pci);
+static int e1000_read_mac(struct nic *nic);
+static void e1000_hw_reset(void);
+static void e1000_reset(struct nic *nic);
+static void e1000_transmit(struct nic *nic, const char *destaddr,
+	unsigned int type, unsigned int len, const char *data);
+static int e1000_poll(struct nic *nic);
+static void e1000_disable(struct nic *nic);
+
+#define e1000_read(reg)		readl(membase + (reg))
+#define e1000_write(val, reg)	writel((val), membase + (reg))
+
+
+struct nic *e1000_probe(struct nic *nic, unsigned short *probeaddrs,
+	struct pci_device *pci)
+{
+	unsigned short cmd;
+	unsigned long to;
+	int i;
+
+	/* The generic dispatch table may hand us someone else's card.  */
+	if (!pci || pci->vendor != PCI_VENDOR_ID_INTEL)
+		return 0;
+	for (i = 0; e1000_devices[i].dev_id != 0; i++)
+		if (e1000_devices[i].dev_id == pci->dev_id)
+			break;
+	if (e1000_devices[i].dev_id == 0)
+		return 0;
+	e1000e = e1000_devices[i].e1000e;
+
+	printf(" - ");
+
+	membase = e1000_bar0(pci);
+	if (!membase) {
+		printf("no usable memory BAR\n");
+		return 0;
+	}
+
+	adjust_pci_device(pci);
+	pcibios_read_config_word(pci->bus, pci->devfn, PCI_COMMAND, &cmd);
+	pcibios_write_config_word(pci->bus, pci->devfn, PCI_COMMAND,
+		cmd | PCI_COMMAND_MEM);
+
+	/* The reset reloads the address from the EEPROM.  */
+	e1000_hw_reset();
+	if (!e1000_read_mac(nic)) {
+		printf("device has no MAC address\n");
+		return 0;
+	}
+
+	printf("membase %#X, addr %!\n", (unsigned int) membase,
+		nic->node_addr);
+
+	e1000_reset(nic);
+
+	/* Give autonegotiation some time, but carry on without a link: the
+	   first packets will be retransmitted anyway.  */
+	to = currticks() + E1000_LINK_TIMEOUT;
+	while (!(e1000_read(E1000_STATUS) & STATUS_LU) && currticks() < to)
+		/* wait */;
+	if (!(e1000_read(E1000_STATUS) & STATUS_LU))
+		printf("e1000: no link\n");
+
+	nic->reset = e1000_reset;
+	nic->poll = e1000_poll;
+	nic->transmit = e1000_transmit;
+	nic->disable = e1000_disable;
+
+	return nic;
+}
+
+/* Return the address of the registers in BAR 0, or zero if they cannot
+   be reached from 32-bit code.  */
+static unsigned long e1000_bar0(struct pci_device *pci)
+{
+	unsigned int lo, hi = 0;
+
+	pcibios_read_config_dword(pci->bus, pci->devfn, PCI_BASE_ADDRESS_0,
+		&lo);
+	if (lo & PCI_BASE_ADDRESS_SPACE_IO)
+		return 0;
+	if ((lo & 0x06) == 0x04)
+		pcibios_read_config_dword(pci->bus, pci->devfn,
+			PCI_BASE_ADDRESS_0 + 4, &hi);
+	if (hi)
+		return 0;
+	return lo & ~0x0f;
+}
+
+/* Read the station address into NIC, from the receive address registers
+   or else from the EEPROM.  Return zero if there is none.  */
+static int e1000_read_mac(struct nic *nic)
+{
+	unsigned int ral, rah, done, shift, val;
+	unsigned long to;
+	int i;
+
+	ral = e1000_read(E1000_RAL);
+	rah = e1000_read(E1000_RAH);
+	if (rah & RAH_AV) {
+		for (i = 0; i < 4; i++)
+			nic->node_addr[i] = ral >> (8 * i);
+		nic->node_addr[4] = rah;
+		nic->node_addr[5] = rah >> 8;
+		return 1;
+	}
+
+	done = e1000e ? EERD_DONE_E1000E : EERD_DONE;
+	shift = e1000e ? EERD_ADDR_SHIFT_E1000E : EERD_ADDR_SHIFT;
+	for (i = 0; i < 3; i++) {
+		e1000_write(EERD_START | (i << shift), E1000_EERD);
+		to = currticks() + E1000_TIMEOUT;
+		while (!((val = e1000_read(E1000_EERD)) & done)
+		       && currticks() < to)
+			/* wait */;
+		if (!(val & done))
+			return 0;
+		nic->node_addr[2 * i] = val >> EERD_DATA_SHIFT;
+		nic->node_addr[2 * i + 1] = val >> (EERD_DATA_SHIFT + 8);
+	}
+
+	/* An erased EEPROM reads as all ones.  */
+	return (nic->node_addr[0] & 1) == 0;
+}
+
+/* Reset the whole device, which stops it from touching our rings, and
+   mask every interrupt.  */
+static void e1000_hw_reset(void)
+{
+	e1000_write(0xFFFFFFFF, E1000_IMC);
+	e1000_write(0, E1000_RCTL);
+	e1000_write(TCTL_PSP, E1000_TCTL);
+	e1000_read(E1000_STATUS);
+
+	e1000_write(e1000_read(E1000_CTRL) | CTRL_RST, E1000_CTRL);
+	/* The reset bit clears itself; give the EEPROM time to load.  */
+	load_timer2(10*TICKS_PER_MS);
+	while (timer2_running())
+		/* wait */;
+	load_timer2(10*TICKS_PER_MS);
+	while ((e1000_read(E1000_CTRL) & CTRL_RST) && timer2_running())
+		/* wait */;
+
+	e1000_write(0xFFFFFFFF, E1000_IMC);
+	e1000_read(E1000_ICR);
+}
+
+static void e1000_reset(struct nic *nic)
+{
+	unsigned int i;
+
+	e1000_hw_reset();
+	e1000_write(e1000_read(E1000_CTRL) | CTRL_SLU | CTRL_ASDE, E1000_CTRL);
+
+	e1000_write(nic->node_addr[0] | (nic->node_addr[1] << 8)
+		| (nic->node_addr[2] << 16) | (nic->node_addr[3] << 24),
+		E1000_RAL);
+	e1000_write(nic->node_addr[4] | (nic->node_addr[5] << 8) | RAH_AV,
+		E1000_RAH);
+	for (i = 0; i < E1000_MTA_SIZE; i++)
+		e1000_write(0, E1000_MTA + 4 * i);
+
+	/* Every receive descriptor but one belongs to the device: the tail
+	   stops one short of the head.  */
+	memset(emem->rx_ring, 0, sizeof(emem->rx_ring));
+	for (i = 0; i < NUM_RX_DESC; i++)
+		emem->rx_ring[i].addr_lo = (unsigned long) emem->rx_buffer[i];
+	rx_next = 0;
+	rx_pending = 0;
+	e1000_write((unsigned long) emem->rx_ring, E1000_RDBAL);
+	e1000_write(0, E1000_RDBAH);
+	e1000_write(sizeof(emem->rx_ring), E1000_RDLEN);
+	e1000_write(0, E1000_RDH);
+	e1000_write(NUM_RX_DESC - 1, E1000_RDT);
+
+	memset(emem->tx_ring, 0, sizeof(emem->tx_ring));
+	for (i = 0; i < NUM_TX_DESC; i++) {
+		emem->tx_ring[i].addr_lo = (unsigned long) emem->tx_buffer;
+		emem->tx_ring[i].status = TXD_STAT_DD;
+	}
+	tx_tail = 0;
+	tx_clean = 0;
+	e1000_write((unsigned long) emem->tx_ring, E1000_TDBAL);
+	e1000_write(0, E1000_TDBAH);
+	e1000_write(sizeof(emem->tx_ring), E1000_TDLEN);
+	e1000_write(0, E1000_TDH);
+	e1000_write(0, E1000_TDT);
+
+	e1000_write(TIPG_DEFAULT, E1000_TIPG);
+	e1000_write(TCTL_EN | TCTL_PSP | TCTL_CT | TCTL_COLD, E1000_TCTL);
+	/* Multicast TFTP needs the group traffic.  */
+	e1000_write(RCTL_EN | RCTL_MPE | RCTL_BAM | RCTL_SECRC, E1000_RCTL);
+}
+
+/* Reclaim the transmit descriptors the device has finished with.  */
+static void e1000_tx_reclaim(void)
+{
+	while (tx_clean != tx_tail
+		&& (emem->tx_ring[tx_clean].status & TXD_STAT_DD))
+		tx_clean = (tx_clean + 1) % NUM_TX_DESC;
+}
+
+static void e1000_transmit(struct nic *nic, const char *destaddr,
+	unsigned int type, unsigned int len, const char *data)
+{
+	struct e1000_tx_desc *desc;
+	unsigned char *buf = emem->tx_buffer;
+	unsigned int nstype;
+	unsigned long to;
+
+	/* The buffer is shared, so the last frame must be out first.  */
+	e1000_tx_reclaim();
+	if (tx_clean != tx_tail) {
+		to = currticks() + E1000_TIMEOUT;
+		do {
+			e1000_tx_reclaim();
+		} while (tx_clean != tx_tail && currticks() < to);
+		if (tx_clean != tx_tail) {
+#ifdef	DEBUG_E1000
+			printf("tx timeout\n");
+#endif
+			e1000_reset(nic);
+		}
+	}
+
+	desc = &emem->tx_ring[tx_tail];
+
+	memcpy(buf, destaddr, ETH_ALEN);
+	memcpy(buf + ETH_ALEN, nic->node_addr, ETH_ALEN);
+	nstype = htons(type);
+	memcpy(buf + 2 * ETH_ALEN, (char *) &nstype, 2);
+	memcpy(buf + ETH_HLEN, data, len);
+	len += ETH_HLEN;
+	while (len < ETH_ZLEN)
+		buf[len++] = '\0';
+
+#ifdef	DEBUG_E1000
+	printf("sending %d bytes ethtype %hX\n", len, type);
+#endif
+	desc->length = len;
+	desc->cmd = TXD_CMD_EOP | TXD_CMD_IFCS | TXD_CMD_RS;
+	desc->status = 0;
+	tx_tail = (tx_tail + 1) % NUM_TX_DESC;
+	e1000_barrier();
+	e1000_write(tx_tail, E1000_TDT);
+}
+
+static int e1000_poll(struct nic *nic)
+{
+	struct e1000_rx_desc *desc = &emem->rx_ring[rx_next];
+	unsigned int len;
+	int ok;
+
+	if (!(desc->status & RXD_STAT_DD))
+		return 0;
+	e1000_barrier();
+
+	/* A frame spread over several buffers is too large for us, and one
+	   with errors is of no use; drop both.  */
+	len = desc->length;
+	ok = (desc->status & RXD_STAT_EOP) && !desc->errors
+		&& len >= ETH_HLEN;
+	if (ok) {
+		if (len > ETH_FRAME_LEN)
+			len = ETH_FRAME_LEN;
+		memcpy(nic->packet, emem->rx_buffer[rx_next], len);
+		nic->packetlen = len;
+#ifdef	DEBUG_E1000
+		printf("rx packet %d bytes in descriptor %d\n", len, rx_next);
+#endif
+	}
+
+	/* Give the descriptor back.  Moving the tail to it returns it and
+	   all those consumed before, so do so once per batch: the device
+	   still has the rest of the ring to receive into meanwhile.  */
+	desc->status = 0;
+	rx_pending++;
+	if (rx_pending >= RX_REFILL_BATCH) {
+		e1000_barrier();
+		e1000_write(rx_next, E1000_RDT);
+		rx_pending = 0;
+	}
+	rx_next = (rx_next + 1) % NUM_RX_DESC;
+
+	return ok;
+}
+
+static void e1000_disable(struct nic *nic)
+{
+	/* Stop the device from touching our buffers.  */
+	e1000_hw_reset();
+}
@@ -78,6 +78,10 @@ Author: Martin Renters
 #define TFTP_TIMEOUT		(30 * TICKS_PER_SEC)
 /* packet retransmission timeout in ticks */
 #define TFTP_REXMT		(3 * TICKS_PER_SEC)
+/* give up on a stalled multicast TFTP transfer and go unicast, in ticks */
+#define TFTP_MCAST_STALL	(10 * TICKS_PER_SEC)
+/* drop the fragments of an IP datagram still incomplete after this, in ticks */
+#define IP_REASM_TIMEOUT	(2 * TICKS_PER_SEC)
 
 #ifndef	NULL
 # define NULL			((void *) 0)
@@ -110,7 +114,8 @@ Author: Martin Renters
 #define ARP_GATEWAY	2
 #define ARP_ROOTSERVER	3
 #define ARP_SWAPSERVER	4
-#define MAX_ARP		ARP_SWAPSERVER+1
+#define ARP_HTTPSERVER	5
+#define MAX_ARP		ARP_HTTPSERVER+1
 
 #define	RARP_REQUEST	3
 #define	RARP_REPLY	4
@@ -122,12 +127,22 @@ Author: Martin Renters
 #define BOOTP_SERVER	67
 #define BOOTP_CLIENT	68
 #define TFTP_PORT	69
+#define HTTP_PORT	80
 #define SUNRPC_PORT	111
 
+#define IP_IGMP		2
+#define IP_TCP		6
 #define IP_UDP		17
 /* Same after going through htonl */
 #define IP_BROADCAST	0xFFFFFFFF
 
+/* Class D addresses, in network byte order.  */
+#define IP_MULTICAST(a)	((ntohl (a) & 0xF0000000) == 0xE0000000)
+#define IP_ALLROUTERS	htonl (0xE0000002)
+
+#define IGMP_V2_REPORT	0x16
+#define IGMP_LEAVE	0x17
+
 #define ARP_REQUEST	1
 #define ARP_REPLY	2
 
@@ -223,6 +238,20 @@ Author: Martin Renters
 
 #define	TFTP_DEFAULTSIZE_PACKET	512
 #define	TFTP_MAX_PACKET		1432 /* 512 */
+/* The block size asked for by the tftp filesystem.  Blocks larger than
+   a frame come in fragments, and must fit in FSYS_BUF.  */
+#ifndef	TFTP_MAX_BLKSIZE
+# define TFTP_MAX_BLKSIZE	8192
+#endif
+
+/* The largest datagram put together from fragments, and how many can be
+   under way at once.  The slots live in IP_REASM_BUF.  */
+#define IP_REASM_MAX		(sizeof (struct iphdr) + sizeof (struct udphdr) \
+				 + 4 + TFTP_MAX_BLKSIZE)
+#define IP_REASM_SLOTS		1
+#if TFTP_MAX_BLKSIZE > 0x3800
+# error "TFTP_MAX_BLKSIZE is too large for IP_REASM_BUF"
+#endif
 
 #define TFTP_RRQ	1
 #define TFTP_WRQ	2
@@ -243,6 +272,7 @@ Author: Martin Renters
 #define AWAIT_RARP	3
 #define AWAIT_RPC	4
 #define AWAIT_QDRAIN	5	/* drain queue, process ARP requests */
+#define AWAIT_TCP	6
 
 typedef struct
 {
@@ -295,6 +325,34 @@ struct udphdr
   unsigned short chksum;
 };
 
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PSH		0x08
+#define TCP_ACK		0x10
+
+struct tcphdr
+{
+  unsigned short src;
+  unsigned short dest;
+  unsigned int seq;
+  unsigned int ack;
+  /* Header length in 32-bit words in the top 4 bits, and the flags.  */
+  unsigned short ctrl;
+  unsigned short window;
+  unsigned short chksum;
+  unsigned short urgent;
+};
+
+struct igmp_t
+{
+  struct iphdr ip;
+  unsigned char type;
+  unsigned char maxresp;
+  unsigned short chksum;
+  in_addr group;
+};
+
 /* Format of a bootp packet.  */
 struct bootp_t
 {
@@ -498,6 +556,8 @@ extern void print_network_configuration (void);
 extern int ifconfig (char *ip, char *sm, char *gw, char *svr);
 extern int udp_transmit (unsigned long destip, unsigned int srcsock,
 			 unsigned int destsock, int len, const void *buf);
+extern int tcp_transmit (unsigned long destip, int len, void *buf);
+extern int igmp_report (unsigned long group, int join);
 extern int await_reply (int type, int ival, void *ptr, int timeout);
 extern int decode_rfc1533 (unsigned char *, int, int, int);
 extern long rfc2131_sleep_interval (int base, int exp);
@@ -536,6 +596,13 @@ extern struct arptable_t arptable[MAX_ARP];
 /* config.c */
 extern struct nic nic;
 
+/* fsys_http.c */
+extern int http_port;
+extern in_addr http_server;
+
+/* fsys_tftp.c */
+extern int tftp_multicast;
+
 /* Local hack - define some macros to use etherboot source files "as is".  */
 #ifndef GRUB
 # undef printf
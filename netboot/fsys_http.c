@@ -0,0 +1,676 @@
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2000,2001,2002,2004  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Read files on the network drive with HTTP/1.1 GET requests instead of
+   TFTP.  This is selected with the command "httpserver".
+
+   The TCP below is only what a single client connection needs: it never
+   sends more than one request, keeps the data it receives in FSYS_BUF and
+   advertises the free space there as its window, acknowledges every
+   second full-sized segment (or after a short delay) and retransmits its
+   SYN and its request until they are acknowledged.  Out-of-order data is
+   dropped and answered with a duplicate ACK, which makes the server
+   retransmit quickly.  Seeking backwards, or far forwards, reconnects
+   with a Range request.  */
+
+/* #define HTTP_DEBUG	1 */
+
+#include <filesys.h>
+
+#define GRUB	1
+#include <etherboot.h>
+#include <nic.h>
+
+/* The TCP port of the HTTP server, or zero if the network drive is read
+   with TFTP.  */
+int http_port;
+/* The HTTP server, or zero to use the TFTP server (ARP_SERVER).  */
+in_addr http_server;
+
+#define TCP_MSS		((int) (ETH_FRAME_LEN - ETH_HLEN - sizeof (struct iphdr) \
+			        - sizeof (struct tcphdr)))
+/* Acknowledge every second full-sized segment...  */
+#define TCP_ACK_SEGMENTS	2
+/* ... or this many ticks after unacknowledged data arrived.  */
+#define TCP_ACK_DELAY		2
+/* Retransmission timeout, doubled on each retry.  */
+#define TCP_RTO			TICKS_PER_SEC
+#define TCP_MAX_RETRIES		6
+/* The first local port.  Each connection uses the next one.  */
+#define TCP_FIRST_PORT		2048
+
+/* Reconnect with a Range request instead of skipping more than this.  */
+#define HTTP_MAX_SKIP		(4 * FSYS_BUFLEN)
+/* The longest path we can send, after escaping it.  */
+#define HTTP_MAX_PATH		1024
+
+#define TCP_CLOSED	0
+#define TCP_SYN_SENT	1
+#define TCP_ESTABLISHED	2
+#define TCP_CLOSE_WAIT	3
+
+struct tcp_segment
+{
+  struct iphdr ip;
+  struct tcphdr tcp;
+  /* The request, or the MSS option of a SYN.  One spare byte for the
+     checksum of an odd-sized segment.  */
+  char data[TCP_MSS + 1];
+};
+
+/* REQUEST is kept until the server acknowledges it, control segments go
+   out in CONTROL.  */
+static struct tcp_segment request, control;
+static int request_len;
+
+static unsigned short lport = TCP_FIRST_PORT;
+static int tcp_state;
+static unsigned long snd_una, snd_nxt, rcv_nxt;
+static int rcv_adv;
+static int ack_pending;
+static unsigned long ack_due;
+static int retry;
+
+static char path[HTTP_MAX_PATH];
+static char *buf;
+static int buf_read, buf_eof;
+static int saved_filepos;
+/* Non-zero once BUF holds the body rather than the response header.  */
+static int in_body;
+
+/* The window is the free space in the buffer.  */
+static int
+tcp_window (void)
+{
+  return FSYS_BUFLEN - buf_read;
+}
+
+/* The address of the HTTP server.  A server of its own gets the
+   ARP_HTTPSERVER entry, so that ip_transmit can find its hardware
+   address.  */
+static unsigned long
+http_server_addr (void)
+{
+  if (! http_server.s_addr)
+    return arptable[ARP_SERVER].ipaddr.s_addr;
+
+  if (arptable[ARP_HTTPSERVER].ipaddr.s_addr != http_server.s_addr)
+    {
+      arptable[ARP_HTTPSERVER].ipaddr = http_server;
+      grub_memset (arptable[ARP_HTTPSERVER].node, 0, ETH_ALEN);
+    }
+
+  return http_server.s_addr;
+}
+
+/* Send SEG with FLAGS, sequence number SEQ and LEN bytes of data.  */
+static int
+tcp_send (struct tcp_segment *seg, int flags, unsigned long seq, int len)
+{
+  int hlen = sizeof (struct tcphdr);
+
+  if (flags & TCP_SYN)
+    {
+      /* Our maximum segment size.  */
+      seg->data[0] = 2;
+      seg->data[1] = 4;
+      seg->data[2] = TCP_MSS >> 8;
+      seg->data[3] = TCP_MSS & 0xff;
+      hlen += 4;
+      len = 0;
+    }
+
+  seg->tcp.src = htons (lport);
+  seg->tcp.dest = htons (http_port);
+  seg->tcp.seq = htonl (seq);
+  seg->tcp.ack = (flags & TCP_ACK) ? htonl (rcv_nxt) : 0;
+  seg->tcp.ctrl = htons (((hlen / 4) << 12) | flags);
+  rcv_adv = tcp_window ();
+  seg->tcp.window = htons (rcv_adv);
+  seg->tcp.urgent = 0;
+
+  if (flags & TCP_ACK)
+    ack_pending = 0;
+
+  return tcp_transmit (http_server_addr (),
+		       sizeof (struct iphdr) + hlen + len, seg);
+}
+
+static int
+tcp_ack (void)
+{
+  return tcp_send (&control, TCP_ACK, snd_nxt, 0);
+}
+
+/* Process the segment in NIC.PACKET.  Return 1 if it belonged to our
+   connection, 0 if it did not, and -1 if the connection was reset.  */
+static int
+tcp_input (void)
+{
+  struct iphdr *ip = (struct iphdr *) &nic.packet[ETH_HLEN];
+  struct tcphdr *tcp = (struct tcphdr *) &nic.packet[ETH_HLEN
+						      + sizeof (struct iphdr)];
+  int ctrl = ntohs (tcp->ctrl);
+  int hlen = (ctrl >> 12) * 4;
+  int len = ntohs (ip->len) - sizeof (struct iphdr) - hlen;
+  unsigned long seq = ntohl (tcp->seq);
+  unsigned long ack = ntohl (tcp->ack);
+
+  if (ip->src.s_addr != http_server_addr ()
+      || ntohs (tcp->src) != http_port
+      || hlen < (int) sizeof (struct tcphdr)
+      || len < 0 || tcp_state == TCP_CLOSED)
+    return 0;
+
+  if (ctrl & TCP_RST)
+    {
+      if (tcp_state == TCP_SYN_SENT
+	  ? (! (ctrl & TCP_ACK) || ack != snd_nxt)
+	  : seq != rcv_nxt)
+	return 0;
+
+      grub_printf ("HTTP connection reset\n");
+      tcp_state = TCP_CLOSED;
+      return -1;
+    }
+
+  if (tcp_state == TCP_SYN_SENT)
+    {
+      if ((ctrl & (TCP_SYN | TCP_ACK)) != (TCP_SYN | TCP_ACK)
+	  || ack != snd_nxt)
+	return 0;
+
+      snd_una = snd_nxt;
+      rcv_nxt = seq + 1;
+      tcp_state = TCP_ESTABLISHED;
+      retry = 0;
+      tcp_ack ();
+      return 1;
+    }
+
+  if ((ctrl & TCP_ACK)
+      && (long) (ack - snd_una) > 0 && (long) (ack - snd_nxt) <= 0)
+    {
+      snd_una = ack;
+      retry = 0;
+    }
+
+  if (! len && ! (ctrl & TCP_FIN))
+    return 1;
+
+  if (seq != rcv_nxt || tcp_state != TCP_ESTABLISHED)
+    {
+      /* A retransmission, or something after a lost segment.  Tell the
+	 server what we are waiting for.  */
+      tcp_ack ();
+      return 1;
+    }
+
+  /* Keep what fits; the server will send the rest again.  */
+  if (len > tcp_window ())
+    {
+      len = tcp_window ();
+      ctrl &= ~TCP_FIN;
+    }
+
+  grub_memmove (buf + buf_read, (char *) tcp + hlen, len);
+  buf_read += len;
+  rcv_nxt += len;
+  if (len)
+    retry = 0;
+
+  if (ctrl & TCP_FIN)
+    {
+      rcv_nxt++;
+      tcp_state = TCP_CLOSE_WAIT;
+      buf_eof = 1;
+      tcp_ack ();
+    }
+  else if (len && ++ack_pending >= TCP_ACK_SEGMENTS)
+    tcp_ack ();
+  else if (ack_pending == 1)
+    ack_due = currticks () + TCP_ACK_DELAY;
+
+  return 1;
+}
+
+/* Wait for a segment of our connection until DEADLINE, and process it.
+   Send a delayed ACK when it is due.  Return 1 if a segment was
+   processed, 0 on timeout and -1 if the connection failed.  */
+static int
+tcp_poll (unsigned long deadline)
+{
+  for (;;)
+    {
+      unsigned long now = currticks ();
+      unsigned long until = deadline;
+      int ret;
+
+      if (ack_pending && ack_due < until)
+	until = ack_due;
+
+      if (now >= until)
+	{
+	  if (ack_pending && now >= ack_due)
+	    {
+	      tcp_ack ();
+	      continue;
+	    }
+
+	  return 0;
+	}
+
+      if (! await_reply (AWAIT_TCP, lport, NULL, until - now))
+	{
+	  if (ip_abort)
+	    return -1;
+
+	  continue;
+	}
+
+      ret = tcp_input ();
+      if (ret)
+	return ret;
+    }
+}
+
+/* Open a new connection to the server.  */
+static int
+tcp_connect (void)
+{
+  if (++lport < TCP_FIRST_PORT)
+    lport = TCP_FIRST_PORT;
+
+  snd_una = (currticks () << 16) ^ lport;
+  snd_nxt = snd_una + 1;
+  rcv_nxt = 0;
+  ack_pending = 0;
+  tcp_state = TCP_SYN_SENT;
+
+  /* See send_rrq in fsys_tftp.c.  */
+  await_reply (AWAIT_QDRAIN, 0, NULL, 0);
+
+  for (retry = 0; retry < TCP_MAX_RETRIES; retry++)
+    {
+      unsigned long deadline;
+
+      if (! tcp_send (&control, TCP_SYN, snd_una, 0))
+	break;
+
+      deadline = currticks () + rfc2131_sleep_interval (TCP_RTO, retry);
+      while (tcp_state == TCP_SYN_SENT)
+	if (tcp_poll (deadline) <= 0)
+	  break;
+
+      if (tcp_state == TCP_ESTABLISHED)
+	return 1;
+
+      if (tcp_state == TCP_CLOSED || ip_abort)
+	break;
+    }
+
+  tcp_state = TCP_CLOSED;
+  return 0;
+}
+
+/* Shut the connection down without waiting for the server.  */
+static void
+tcp_close (void)
+{
+  if (tcp_state == TCP_ESTABLISHED)
+    /* We do not want the rest of the data.  */
+    tcp_send (&control, TCP_RST, snd_nxt, 0);
+  else if (tcp_state == TCP_CLOSE_WAIT)
+    tcp_send (&control, TCP_FIN | TCP_ACK, snd_nxt, 0);
+
+  tcp_state = TCP_CLOSED;
+}
+
+/* Receive data until WANT bytes are buffered, the buffer cannot take
+   another full-sized segment or the body is complete.  */
+static int
+buf_fill (int want)
+{
+#ifdef HTTP_DEBUG
+  grub_printf ("buf_fill (%d)\n", want);
+#endif
+
+  /* Tell the server about the space the reader has made, unless it is
+     too little to bother.  */
+  if (tcp_state == TCP_ESTABLISHED && tcp_window () >= rcv_adv + 2 * TCP_MSS)
+    tcp_ack ();
+
+  while (! buf_eof && buf_read < want && tcp_window () >= TCP_MSS)
+    {
+      int ret;
+
+      if (tcp_state != TCP_ESTABLISHED)
+	return 0;
+
+      ret = tcp_poll (currticks () + rfc2131_sleep_interval (TCP_RTO, retry));
+      if (ret < 0)
+	return 0;
+
+      if (ret == 0)
+	{
+	  if (++retry > TCP_MAX_RETRIES)
+	    {
+	      grub_printf ("HTTP connection timed out\n");
+	      return 0;
+	    }
+
+	  /* Our request or our last ACK may have been lost.  */
+	  if (snd_una != snd_nxt)
+	    tcp_send (&request, TCP_ACK | TCP_PSH, snd_una, request_len);
+	  else
+	    tcp_ack ();
+	}
+
+      if (in_body && saved_filepos + buf_read >= filemax)
+	buf_eof = 1;
+    }
+
+  if (ack_pending)
+    tcp_ack ();
+
+  return 1;
+}
+
+/* Return the value of the header field NAME in the response header which
+   ends at END, or zero if there is no such field.  */
+static char *
+http_header (char *end, const char *name)
+{
+  char *p = buf;
+  int len = grub_strlen (name);
+
+  while (p < end)
+    {
+      int i;
+
+      /* Skip to the next line.  */
+      while (p < end && *p++ != '\n')
+	;
+
+      for (i = 0; i < len && p + i < end; i++)
+	if (grub_tolower (p[i]) != name[i])
+	  break;
+
+      if (i == len && p + len < end && p[len] == ':')
+	{
+	  p += len + 1;
+	  while (*p == ' ' || *p == '\t')
+	    p++;
+	  return p;
+	}
+    }
+
+  return 0;
+}
+
+/* Connect to the server and request PATH from OFFSET on.  On success, the
+   buffer holds the start of the body and FILEMAX is set.  */
+static int
+http_open (int offset)
+{
+  unsigned long addr = http_server_addr ();
+  unsigned char *server = (unsigned char *) &addr;
+  char *end = 0, *p;
+  int status;
+
+  buf = (char *) FSYS_BUF;
+  buf_read = 0;
+  buf_eof = 0;
+  in_body = 0;
+  saved_filepos = 0;
+
+#ifdef HTTP_DEBUG
+  grub_printf ("http_open (%s, %d)\n", path, offset);
+#endif
+
+  if (! tcp_connect ())
+    return 0;
+
+  p = request.data;
+  p += grub_sprintf (p, "GET %s HTTP/1.1\r\nHost: %d.%d.%d.%d",
+		     path, server[0], server[1], server[2], server[3]);
+  if (http_port != HTTP_PORT)
+    p += grub_sprintf (p, ":%d", http_port);
+  p += grub_sprintf (p, "\r\nUser-Agent: GRUB\r\nConnection: close\r\n");
+  if (offset)
+    p += grub_sprintf (p, "Range: bytes=%d-\r\n", offset);
+  p += grub_sprintf (p, "\r\n");
+  request_len = p - request.data;
+
+  snd_nxt = snd_una + request_len;
+  if (! tcp_send (&request, TCP_ACK | TCP_PSH, snd_una, request_len))
+    goto fail;
+
+  /* Read the whole response header.  */
+  for (;;)
+    {
+      for (p = buf; p + 4 <= buf + buf_read; p++)
+	if (! grub_memcmp (p, "\r\n\r\n", 4))
+	  {
+	    end = p + 4;
+	    break;
+	  }
+
+      if (end)
+	break;
+
+      if (buf_eof || tcp_window () < TCP_MSS || ! buf_fill (buf_read + 1))
+	goto fail;
+    }
+
+  if (grub_memcmp (buf, "HTTP/1.", 7) || buf[8] != ' ')
+    goto fail;
+  p = buf + 9;
+  status = getdec (&p);
+
+#ifdef HTTP_DEBUG
+  grub_printf ("HTTP status %d\n", status);
+#endif
+
+  if (status == 206 && (p = http_header (end, "content-range")))
+    {
+      /* bytes FIRST-LAST/TOTAL */
+      while (p < end && *p != '/')
+	p++;
+      p++;
+      saved_filepos = offset;
+    }
+  else if (status == 200 && (p = http_header (end, "content-length")))
+    /* The server sends the whole file even if we asked for a range; the
+       reader skips the part before OFFSET.  */
+    saved_filepos = 0;
+  else
+    {
+      if (status == 200 || status == 206)
+	grub_printf ("HTTP server did not send the file size\n");
+      else if (status != 404)
+	grub_printf ("HTTP error %d\n", status);
+      errnum = ERR_FILE_NOT_FOUND;
+      goto fail;
+    }
+
+  if ((filemax = getdec (&p)) < 0)
+    {
+      filemax = -1;
+      goto fail;
+    }
+
+  /* Move the start of the body to the start of the buffer.  */
+  buf_read -= end - buf;
+  grub_memmove (buf, end, buf_read);
+  in_body = 1;
+  if (saved_filepos + buf_read >= filemax)
+    buf_eof = 1;
+
+  return 1;
+
+ fail:
+  tcp_close ();
+  return 0;
+}
+
+/* Mount the network drive, if HTTP is selected.  */
+int
+http_mount (void)
+{
+  if (current_drive != NETWORK_DRIVE || ! network_ready || ! http_port)
+    return 0;
+
+  return 1;
+}
+
+/* Read up to SIZE bytes, returned in ADDR.  */
+int
+http_read (char *addr, int size)
+{
+  int ret = 0;
+
+#ifdef HTTP_DEBUG
+  grub_printf ("http_read (0x%x, %d)\n", (int) addr, size);
+#endif
+
+  if (filepos < saved_filepos
+      || filepos > saved_filepos + buf_read + HTTP_MAX_SKIP)
+    {
+      /* Ask for the data from FILEPOS on instead.  */
+      tcp_close ();
+      if (! http_open (filepos))
+	{
+	  errnum = ERR_READ;
+	  return 0;
+	}
+    }
+
+  while (size > 0)
+    {
+      int amt = buf_read + saved_filepos - filepos;
+
+      /* If the length that can be copied from the buffer is over the
+	 requested size, cut it down.  */
+      if (amt > size)
+	amt = size;
+
+      if (amt > 0)
+	{
+	  /* Copy the buffer to the supplied memory space.  */
+	  grub_memmove (addr, buf + filepos - saved_filepos, amt);
+	  size -= amt;
+	  addr += amt;
+	  filepos += amt;
+	  ret += amt;
+
+	  /* If the size of the empty space becomes small, move the unused
+	     data forwards.  */
+	  if (filepos - saved_filepos > FSYS_BUFLEN / 2)
+	    {
+	      grub_memmove (buf, buf + FSYS_BUFLEN / 2, FSYS_BUFLEN / 2);
+	      buf_read -= FSYS_BUFLEN / 2;
+	      saved_filepos += FSYS_BUFLEN / 2;
+	    }
+	}
+      else
+	{
+	  /* Skip the whole buffer.  */
+	  saved_filepos += buf_read;
+	  buf_read = 0;
+	}
+
+      /* Read the data.  */
+      if (size > 0 && ! buf_fill (FSYS_BUFLEN))
+	{
+	  errnum = ERR_READ;
+	  return 0;
+	}
+
+      /* Sanity check.  */
+      if (size > 0 && buf_read == 0)
+	{
+	  errnum = ERR_READ;
+	  return 0;
+	}
+    }
+
+  return ret;
+}
+
+/* Check if the file DIRNAME really exists, and get its size.  */
+int
+http_dir (char *dirname)
+{
+  char *p, *q;
+
+#ifdef HTTP_DEBUG
+  grub_printf ("http_dir (%s)\n", dirname);
+#endif
+
+  /* There is no way to list a directory.  */
+  if (print_possibilities)
+    return 1;
+
+  filemax = -1;
+  tcp_close ();
+
+  /* Copy the path, escaping what may not appear in a URL.  */
+  for (p = dirname, q = path;
+       *p && *p != ' ' && *p != '\t' && *p != '\n';
+       p++)
+    {
+      if (q - path > (int) sizeof (path) - 4)
+	{
+	  errnum = ERR_FILELENGTH;
+	  return 0;
+	}
+
+      if (*p == '\\' && p[1])
+	p++;
+
+      if ((unsigned char) *p <= ' ' || (unsigned char) *p >= 0x7f
+	  || *p == '%' || *p == '?' || *p == '#')
+	q += grub_sprintf (q, "%%%02x", (unsigned char) *p);
+      else
+	*q++ = *p;
+    }
+  *q = 0;
+
+  if (! http_open (0))
+    {
+      if (! errnum)
+	errnum = ERR_FILE_NOT_FOUND;
+      return 0;
+    }
+
+  return 1;
+}
+
+/* Close the file.  */
+void
+http_close (void)
+{
+#ifdef HTTP_DEBUG
+  grub_printf ("http_close ()\n");
+#endif
+
+  tcp_close ();
+  buf_read = 0;
+}
@@ -46,18 +46,270 @@ static int saved_filepos;
 static unsigned short len, saved_len;
 static char *buf;
 
+/* Ask the server for an RFC 2090 multicast transfer.  */
+int tftp_multicast;
+
+/* The number of blocks a multicast client can hold ahead of PREVBLOCK.  */
+#define MCAST_WINDOW	(FSYS_BUFLEN / TFTP_DEFAULTSIZE_PACKET)
+
+/* The state of a multicast transfer.  MCAST is set once the server has
+   accepted the option and we have joined MCAST_ADDR.  Only the master
+   client sends ACKs; the others just pick blocks off the group.  */
+static int mcast, mcast_master;
+static unsigned long mcast_addr;
+static unsigned short mcast_port;
+static unsigned long mcast_deadline;
+/* Bit I is set if block PREVBLOCK + 1 + I is already in the buffer.  */
+static unsigned int ahead[(MCAST_WINDOW + 31) / 32];
+/* The short last block, if it arrived out of order.  */
+static unsigned short ahead_eof, ahead_eof_len;
+/* After falling back to unicast, the transfer restarts from the beginning
+   of the file and everything before RESUME_POS is thrown away.  */
+static int stream_pos, resume_pos;
+
+/* The block size to ask for.  It drops to one frame, for all later
+   files as well, once a larger one has failed.  */
+static int blksize = TFTP_MAX_BLKSIZE;
+
+static int send_rrq (void);
+
+/* Build a read request for NAME in TP, and set LEN.  */
+static void
+make_rrq (const char *name, int multicast)
+{
+  tp.opcode = htons (TFTP_RRQ);
+  /* Make the request string (octet, blksize and tsize).  */
+  len = (grub_sprintf ((char *) tp.u.rrq,
+		       "%s%coctet%cblksize%c%d%ctsize%c0",
+		       name, 0, 0, 0, blksize, 0, 0)
+	 + sizeof (tp.ip) + sizeof (tp.udp) + sizeof (tp.opcode) + 1);
+  /* RFC 2090: the multicast option is sent with an empty value.  */
+  if (multicast)
+    len += grub_sprintf ((char *) &tp + len, "multicast%c", 0) + 1;
+}
+
+/* Send an ACK for PREVBLOCK, or an error if ABORT.  */
+static void
+send_ack (int abort)
+{
+  tp.opcode = abort ? htons (TFTP_ERROR) : htons (TFTP_ACK);
+  tp.u.ack.block = htons (prevblock);
+  udp_transmit (arptable[ARP_SERVER].ipaddr.s_addr, iport,
+		oport, TFTP_MIN_PACKET, &tp);
+}
+
+/* Leave the multicast group, if we are in one.  */
+static void
+mcast_leave (void)
+{
+  if (! mcast)
+    return;
+
+  igmp_report (mcast_addr, 0);
+  mcast = 0;
+  mcast_master = 0;
+}
+
+/* Parse the value of the multicast option at *PTR, "ADDR,PORT,MC".  The
+   address and the port may be left out after the first OACK.  */
+static int
+mcast_option (char **ptr)
+{
+  char *p = *ptr;
+  unsigned long addr = 0;
+  int port, i;
+
+  if (*p != ',')
+    {
+      for (i = 0; i < 4; i++)
+	{
+	  int val = getdec (&p);
+
+	  if (val < 0 || val > 255 || (i != 3 && *p++ != '.'))
+	    return 0;
+
+	  addr = (addr << 8) | val;
+	}
+
+      addr = htonl (addr);
+      if (! IP_MULTICAST (addr) || (mcast && addr != mcast_addr))
+	return 0;
+    }
+  else if (! mcast)
+    return 0;
+
+  if (*p++ != ',')
+    return 0;
+
+  if (*p != ',')
+    {
+      if ((port = getdec (&p)) <= 0 || port > 0xFFFF
+	  || (mcast && port != mcast_port))
+	return 0;
+
+      mcast_port = port;
+    }
+  else if (! mcast)
+    return 0;
+
+  if (*p++ != ',' || (*p != '0' && *p != '1'))
+    return 0;
+
+  mcast_master = *p++ == '1';
+  *ptr = p;
+
+  if (! mcast)
+    {
+#ifdef TFTP_DEBUG
+      etherboot_printf ("multicast %@:%d\n", addr, mcast_port);
+#endif
+      if (! igmp_report (addr, 1))
+	return 0;
+
+      mcast_addr = addr;
+      mcast = 1;
+      mcast_deadline = currticks () + TFTP_MCAST_STALL;
+    }
+
+  return 1;
+}
+
+/* Store the multicast data block in TR, which is LEN bytes long, and
+   move PREVBLOCK past every block that is now contiguous.  Blocks that
+   do not fit in the buffer yet are dropped: either a later round of the
+   server brings them again, or we fetch them ourselves once we become
+   master.  */
+static void
+mcast_data (struct tftp_t *tr)
+{
+  unsigned short diff = ntohs (tr->u.data.block) - prevblock - 1;
+  int offset = buf_read + diff * packetsize;
+
+  if (diff >= MCAST_WINDOW || offset + packetsize > FSYS_BUFLEN
+      || (ahead[diff / 32] & (1U << (diff % 32))))
+    return;
+
+  grub_memmove (buf + offset, tr->u.data.download, len);
+  ahead[diff / 32] |= 1U << (diff % 32);
+  if (len < packetsize)
+    {
+      ahead_eof = diff + 1;
+      ahead_eof_len = len;
+    }
+
+  while (ahead[0] & 1)
+    {
+      int i;
+
+      for (i = 0; i < (int) (sizeof (ahead) / sizeof (ahead[0])) - 1; i++)
+	ahead[i] = (ahead[i] >> 1) | (ahead[i + 1] << 31);
+      ahead[i] >>= 1;
+
+      prevblock++;
+      bcounter++;
+      retry = 0;
+      mcast_deadline = currticks () + TFTP_MCAST_STALL;
+
+      if (ahead_eof && --ahead_eof == 0)
+	{
+	  buf_read += ahead_eof_len;
+	  buf_eof = 1;
+	  break;
+	}
+
+      buf_read += packetsize;
+    }
+}
+
+/* The multicast transfer has made no progress for TFTP_MCAST_STALL, most
+   likely because the NIC or the switch does not pass the group traffic
+   to us.  Drop out of the group and read the rest of the file by plain
+   unicast TFTP, skipping what we already have.  */
+static int
+mcast_fallback (void)
+{
+  int saved_read = buf_read, saved_pos = saved_filepos;
+
+  grub_printf ("Multicast TFTP stalled, falling back to unicast\n");
+  send_ack (1);
+  mcast_leave ();
+
+  make_rrq ((char *) saved_tp.u.rrq, 0);
+  grub_memmove ((char *) &saved_tp, (char *) &tp, len);
+  saved_len = len;
+  if (! send_rrq ())
+    return 0;
+
+  buf_read = saved_read;
+  saved_filepos = saved_pos;
+  resume_pos = saved_filepos + buf_read;
+  return 1;
+}
+
+/* The server agreed to blocks larger than a frame, but the first never
+   came, most likely because something on the way drops IP fragments.
+   Stop that transfer, and ask again for blocks that fit in a frame.  */
+static int
+blksize_fallback (void)
+{
+  int saved_read = buf_read, saved_pos = saved_filepos;
+  int saved_resume = resume_pos;
+
+  grub_printf ("TFTP blksize %d got no data, falling back to %d\n",
+	       packetsize, TFTP_MAX_PACKET);
+  send_ack (1);
+  blksize = TFTP_MAX_PACKET;
+
+  make_rrq ((char *) saved_tp.u.rrq, 0);
+  grub_memmove ((char *) &saved_tp, (char *) &tp, len);
+  saved_len = len;
+  if (! send_rrq ())
+    return 0;
+
+  /* Keep what an abandoned multicast transfer left in the buffer.  */
+  buf_read = saved_read;
+  saved_filepos = saved_pos;
+  resume_pos = saved_resume;
+  return 1;
+}
+
 /* Fill the buffer by receiving the data via the TFTP protocol.  */
 static int
 buf_fill (int abort)
 {
+  struct iostat *st = iostat_get (IOSTAT_SERVER,
+				  arptable[ARP_SERVER].ipaddr.s_addr);
+
 #ifdef TFTP_DEBUG
   grub_printf ("buf_fill (%d)\n", abort);
 #endif
+
+  if (abort && mcast)
+    {
+      /* Have the server drop us from the list of clients.  */
+      send_ack (1);
+      mcast_leave ();
+      buf_eof = 1;
+      return 1;
+    }
+
+  /* Time spent by our caller away from the network is not a stall.  */
+  if (mcast)
+    mcast_deadline = currticks () + TFTP_MCAST_STALL;
   
   while (! buf_eof && (buf_read + packetsize <= FSYS_BUFLEN))
     {
       struct tftp_t *tr;
       long timeout;
+      unsigned long long start;
+
+      if (mcast && currticks () > mcast_deadline)
+	{
+	  if (! mcast_fallback ())
+	    return 0;
+
+	  continue;
+	}
 
 #ifdef CONGESTED
       timeout = rfc2131_sleep_interval (block ? TFTP_REXMT : TIMEOUT, retry);
@@ -65,11 +317,34 @@ buf_fill (int abort)
       timeout = rfc2131_sleep_interval (TIMEOUT, retry);
 #endif
   
-      if (! await_reply (AWAIT_TFTP, iport, NULL, timeout))
+      start = iostat_clock ();
+      if (! await_reply (AWAIT_TFTP, iport, mcast ? &mcast_port : NULL,
+			 timeout))
 	{
 	  if (ip_abort)
 	    return 0;
 
+	  if (mcast)
+	    {
+	      /* Only the master may prod the server.  The others keep
+		 listening until TFTP_MCAST_STALL runs out.  */
+	      if (mcast_master)
+		send_ack (0);
+
+	      continue;
+	    }
+
+	  if (st)
+	    st->retries++;
+
+	  if (! prevblock && packetsize > TFTP_MAX_PACKET)
+	    {
+	      if (! blksize_fallback ())
+		return 0;
+
+	      continue;
+	    }
+
 	  if (! block && retry++ < MAX_TFTP_RETRIES)
 	    {
 	      /* Maybe initial request was lost.  */
@@ -97,15 +372,22 @@ buf_fill (int abort)
 	    }
 #endif
 	  /* Timeout.  */
+	  iostat_done (st, start, 0, 0, 1);
 	  return 0;
 	}
 
       tr = (struct tftp_t *) &nic.packet[ETH_HLEN];
+      /* Another group may be using the same port.  */
+      if (mcast && ntohs (tr->udp.dest) == mcast_port
+	  && tr->ip.dest.s_addr != mcast_addr)
+	continue;
+
       if (tr->opcode == ntohs (TFTP_ERROR))
 	{
 	  grub_printf ("TFTP error %d (%s)\n",
 		       ntohs (tr->u.err.errcode),
 		       tr->u.err.errmsg);
+	  mcast_leave ();
 	  return 0;
 	}
       
@@ -116,8 +398,9 @@ buf_fill (int abort)
 #ifdef TFTP_DEBUG
 	  grub_printf ("OACK ");
 #endif
-	  /* Shouldn't happen.  */
-	  if (prevblock)
+	  /* Shouldn't happen, except when a multicast server hands the
+	     master role over.  */
+	  if (prevblock && ! mcast)
 	    {
 	      /* Ignore it.  */
 	      grub_printf ("%s:%d: warning: PREVBLOCK != 0 (0x%x)\n",
@@ -135,7 +418,8 @@ buf_fill (int abort)
 	      if (! grub_strcmp ("blksize", p))
 		{
 		  p += 8;
-		  if ((packetsize = getdec (&p)) < TFTP_DEFAULTSIZE_PACKET)
+		  if ((packetsize = getdec (&p)) < TFTP_DEFAULTSIZE_PACKET
+		      || packetsize > TFTP_MAX_BLKSIZE)
 		    goto noak;
 #ifdef TFTP_DEBUG
 		  grub_printf ("blksize = %d\n", packetsize);
@@ -153,12 +437,19 @@ buf_fill (int abort)
 		  grub_printf ("tsize = %d\n", filemax);
 #endif
 		}
+	      else if (tftp_multicast && ! grub_strcmp ("multicast", p))
+		{
+		  p += 10;
+		  if (! mcast_option (&p))
+		    goto noak;
+		}
 	      else
 		{
 		noak:
 #ifdef TFTP_DEBUG
 		  grub_printf ("NOAK\n");
 #endif
+		  mcast_leave ();
 		  tp.opcode = htons (TFTP_ERROR);
 		  tp.u.err.errcode = 8;
 		  len = (grub_sprintf ((char *) tp.u.err.errmsg,
@@ -181,6 +472,16 @@ buf_fill (int abort)
 	  
 	  if (p > e)
 	    goto noak;
+
+	  if (mcast)
+	    {
+	      /* The OACK tells us whether we are the master now.  */
+	      oport = ntohs (tr->udp.src);
+	      if (mcast_master)
+		send_ack (0);
+
+	      continue;
+	    }
 	  
 	  /* This ensures that the packet does not get processed as
 	     data!  */
@@ -201,6 +502,22 @@ buf_fill (int abort)
 			   __FILE__, __LINE__, len, packetsize);
 	      continue;
 	    }
+
+	  iostat_done (st, start, 0, len, 0);
+
+	  if (mcast)
+	    {
+	      mcast_data (tr);
+	      /* Everyone acknowledges the last block, so that the server
+		 can forget about us.  */
+	      if (mcast_master || buf_eof)
+		send_ack (0);
+
+	      if (buf_eof)
+		mcast_leave ();
+
+	      continue;
+	    }
 	  
 	  block = ntohs (tp.u.ack.block = tr->u.data.block);
 	}
@@ -242,9 +559,17 @@ buf_fill (int abort)
 	 but use it for consistency with Etherboot.  */
       bcounter++;
       
-      /* Copy the downloaded data to the buffer.  */
-      grub_memmove (buf + buf_read, tr->u.data.download, len);
-      buf_read += len;
+      /* Copy the downloaded data to the buffer, less what is already
+	 there from an abandoned multicast transfer.  */
+      if (stream_pos + len > resume_pos)
+	{
+	  int skip = stream_pos < resume_pos ? resume_pos - stream_pos : 0;
+
+	  grub_memmove (buf + buf_read, tr->u.data.download + skip,
+			len - skip);
+	  buf_read += len - skip;
+	}
+      stream_pos += len;
 
       /* End of data.  */
       if (len < packetsize)		
@@ -270,6 +595,12 @@ send_rrq (void)
   buf_read = 0;
   saved_filepos = 0;
 
+  mcast_leave ();
+  grub_memset ((char *) ahead, 0, sizeof (ahead));
+  ahead_eof = 0;
+  stream_pos = 0;
+  resume_pos = 0;
+
   /* Clear out the Rx queue first.  It contains nothing of interest,
    * except possibly ARP requests from the DHCP/TFTP server.  We use
    * polling throughout Etherboot, so some time may have passed since we
@@ -383,7 +714,10 @@ tftp_read (char *addr, int size)
 	}
       else
 	{
-	  /* Skip the whole buffer.  */
+	  /* Skip the whole buffer, but keep any blocks that a multicast
+	     transfer has put beyond it.  */
+	  if (mcast)
+	    grub_memmove (buf, buf + buf_read, FSYS_BUFLEN - buf_read);
 	  saved_filepos += buf_read;
 	  buf_read = 0;
 	}
@@ -425,15 +759,10 @@ tftp_dir (char *dirname)
   filemax = -1;
   
  reopen:
-  /* Construct the TFTP request packet.  */
-  tp.opcode = htons (TFTP_RRQ);
   /* Terminate the filename.  */
   ch = nul_terminate (dirname);
-  /* Make the request string (octet, blksize and tsize).  */
-  len = (grub_sprintf ((char *) tp.u.rrq,
-		       "%s%coctet%cblksize%c%d%ctsize%c0",
-		       dirname, 0, 0, 0, TFTP_MAX_PACKET, 0, 0)
-	 + sizeof (tp.ip) + sizeof (tp.udp) + sizeof (tp.opcode) + 1);
+  /* Construct the TFTP request packet.  */
+  make_rrq (dirname, tftp_multicast);
   /* Restore the original DIRNAME.  */
   dirname[grub_strlen (dirname)] = ch;
   /* Save the TFTP packet so that we can reopen the file later.  */
@@ -108,7 +108,7 @@ static const unsigned char dhcprequest[] =
 #endif /* ! NO_DHCP_SUPPORT */
 
 static unsigned short ipchksum (unsigned short *ip, int len);
-static unsigned short udpchksum (struct iphdr *packet);
+static unsigned short transport_chksum (struct iphdr *packet);
 
 void
 print_network_configuration (void)
@@ -123,6 +123,10 @@ print_network_configuration (void)
       etherboot_printf ("Netmask: %@\n", netmask);
       etherboot_printf ("Server: %@\n", arptable[ARP_SERVER].ipaddr.s_addr);
       etherboot_printf ("Gateway: %@\n", arptable[ARP_GATEWAY].ipaddr.s_addr);
+      if (http_port)
+	etherboot_printf ("HTTP server: %@\n",
+			  (http_server.s_addr ? http_server.s_addr
+			   : arptable[ARP_SERVER].ipaddr.s_addr));
     }
 }
 
@@ -192,44 +196,52 @@ ifconfig (char *ip, char *sm, char *gw, char *svr)
 
 
 /**************************************************************************
-UDP_TRANSMIT - Send a UDP datagram
+IP_HEADER - Fill in the IP header of an outgoing datagram
 **************************************************************************/
-int 
-udp_transmit (unsigned long destip, unsigned int srcsock,
-	      unsigned int destsock, int len, const void *buf)
+static void
+ip_header (struct iphdr *ip, unsigned long destip, int len, int protocol)
 {
-  struct iphdr *ip;
-  struct udphdr *udp;
-  struct arprequest arpreq;
-  int arpentry, i;
-  int retry;
-
-  ip = (struct iphdr *) buf;
-  udp = (struct udphdr *) ((unsigned long) buf + sizeof (struct iphdr));
   ip->verhdrlen = 0x45;
   ip->service = 0;
   ip->len = htons (len);
   ip->ident = 0;
   ip->frags = 0;
   ip->ttl = 60;
-  ip->protocol = IP_UDP;
+  ip->protocol = protocol;
   ip->chksum = 0;
   ip->src.s_addr = arptable[ARP_CLIENT].ipaddr.s_addr;
   ip->dest.s_addr = destip;
-  ip->chksum = ipchksum ((unsigned short *) buf, sizeof (struct iphdr));
-  udp->src = htons (srcsock);
-  udp->dest = htons (destsock);
-  udp->len = htons (len - sizeof (struct iphdr));
-  udp->chksum = 0;
-  udp->chksum = htons (udpchksum (ip));
+  ip->chksum = ipchksum ((unsigned short *) ip, sizeof (struct iphdr));
+}
+
+/**************************************************************************
+IP_TRANSMIT - Send an IP datagram, resolving the next hop if needed
+**************************************************************************/
+static int
+ip_transmit (unsigned long destip, int len, const void *buf)
+{
+  struct arprequest arpreq;
+  int arpentry, i;
+  int retry;
 
-  if (udp->chksum == 0)
-    udp->chksum = 0xffff;
-  
   if (destip == IP_BROADCAST)
     {
       eth_transmit (broadcast, IP, len, buf);
     }
+  else if (IP_MULTICAST (destip))
+    {
+      /* RFC 1112: the low 23 bits of the group go into 01:00:5e.  */
+      unsigned char *group = (unsigned char *) &destip;
+      char node[ETH_ALEN];
+
+      node[0] = 0x01;
+      node[1] = 0x00;
+      node[2] = 0x5e;
+      node[3] = group[1] & 0x7f;
+      node[4] = group[2];
+      node[5] = group[3];
+      eth_transmit (node, IP, len, buf);
+    }
   else
     {
       if (((destip & netmask)
@@ -293,6 +305,74 @@ udp_transmit (unsigned long destip, unsigned int srcsock,
   return 1;
 }
 
+/**************************************************************************
+UDP_TRANSMIT - Send a UDP datagram
+**************************************************************************/
+int 
+udp_transmit (unsigned long destip, unsigned int srcsock,
+	      unsigned int destsock, int len, const void *buf)
+{
+  struct iphdr *ip;
+  struct udphdr *udp;
+
+  ip = (struct iphdr *) buf;
+  udp = (struct udphdr *) ((unsigned long) buf + sizeof (struct iphdr));
+  ip_header (ip, destip, len, IP_UDP);
+  udp->src = htons (srcsock);
+  udp->dest = htons (destsock);
+  udp->len = htons (len - sizeof (struct iphdr));
+  udp->chksum = 0;
+  udp->chksum = htons (transport_chksum (ip));
+
+  if (udp->chksum == 0)
+    udp->chksum = 0xffff;
+
+  return ip_transmit (destip, len, buf);
+}
+
+/**************************************************************************
+TCP_TRANSMIT - Send a TCP segment whose TCP header is already filled in
+**************************************************************************/
+int
+tcp_transmit (unsigned long destip, int len, void *buf)
+{
+  struct iphdr *ip;
+  struct tcphdr *tcp;
+
+  ip = (struct iphdr *) buf;
+  tcp = (struct tcphdr *) ((unsigned long) buf + sizeof (struct iphdr));
+  ip_header (ip, destip, len, IP_TCP);
+  tcp->chksum = 0;
+  tcp->chksum = htons (transport_chksum (ip));
+
+  return ip_transmit (destip, len, buf);
+}
+
+/**************************************************************************
+IGMP_REPORT - Join (JOIN != 0) or leave the multicast group GROUP
+**************************************************************************/
+int
+igmp_report (unsigned long group, int join)
+{
+  struct igmp_t igmp;
+  unsigned long destip = join ? group : IP_ALLROUTERS;
+
+  ip_header (&igmp.ip, destip, sizeof (igmp), IP_IGMP);
+  /* Group management traffic must not leave the local network.  */
+  igmp.ip.ttl = 1;
+  igmp.ip.chksum = 0;
+  igmp.ip.chksum = ipchksum ((unsigned short *) &igmp.ip,
+			     sizeof (struct iphdr));
+  igmp.type = join ? IGMP_V2_REPORT : IGMP_LEAVE;
+  igmp.maxresp = 0;
+  igmp.chksum = 0;
+  igmp.group.s_addr = group;
+  igmp.chksum = ipchksum ((unsigned short *) &igmp.type,
+			  sizeof (igmp) - sizeof (struct iphdr));
+
+  return ip_transmit (destip, sizeof (igmp), &igmp);
+}
+
 /**************************************************************************
 TFTP - Download extended BOOTP data, or kernel image
 **************************************************************************/
@@ -681,14 +761,14 @@ bootp (void)
 }
 
 /**************************************************************************
-UDPCHKSUM - Checksum UDP Packet (one of the rare cases when assembly is
-            actually simpler...)
+TRANSPORT_CHKSUM - Checksum UDP or TCP Packet (one of the rare cases
+            when assembly is actually simpler...)
  RETURNS: checksum, 0 on checksum error. This
           allows for using the same routine for RX and TX summing:
-          RX  if (packet->udp.chksum && udpchksum(packet))
+          RX  if (packet->udp.chksum && transport_chksum(packet))
                   error("checksum error");
           TX  packet->udp.chksum=0;
-              if (0==(packet->udp.chksum=udpchksum(packet)))
+              if (0==(packet->udp.chksum=transport_chksum(packet)))
                   packet->upd.chksum=0xffff;
 **************************************************************************/
 static inline void
@@ -707,17 +787,17 @@ dosum (unsigned short *start, unsigned int len, unsigned short *sum)
      );
 }
 
-/* UDP sum:
- * proto, src_ip, dst_ip, udp_dport, udp_sport, 2*udp_len, payload
+/* UDP and TCP sum:
+ * proto, src_ip, dst_ip, dport, sport, 2*len, payload
  */
 static unsigned short
-udpchksum (struct iphdr *packet)
+transport_chksum (struct iphdr *packet)
 {
   int len = ntohs (packet->len);
   unsigned short rval;
   
-  /* add udplength + protocol number */
-  rval = (len - sizeof (struct iphdr)) + IP_UDP;
+  /* add length + protocol number */
+  rval = (len - sizeof (struct iphdr)) + packet->protocol;
   
   /* pad to an even number of bytes */
   if (len % 2) {
@@ -732,6 +812,110 @@ udpchksum (struct iphdr *packet)
   return ~rval;
 }
 
+/* A datagram being put together from its fragments, kept as a frame
+   with one spare byte for transport_chksum.  */
+struct ip_reasm
+{
+  unsigned long expire;		/* zero if the slot is free */
+  unsigned long src;
+  unsigned short ident;
+  unsigned char protocol;
+  unsigned int total;		/* the payload length, once known */
+  unsigned int units;		/* 8-byte units of the payload received */
+  unsigned char have[(IP_REASM_MAX / 8 + 7) / 8];
+  char packet[ETH_HLEN + IP_REASM_MAX + 1];
+};
+
+/* Each slot is over 8K, too much for the Stage 2 image.  */
+#define reasm_slots	((struct ip_reasm *) IP_REASM_BUF)
+
+/**************************************************************************
+IP_REASSEMBLE - Add the fragment IP in NIC.PACKET to its datagram
+ RETURNS: 1 if the datagram is now whole, and then NIC.PACKET points to it
+          until the next eth_poll, 0 otherwise
+**************************************************************************/
+static int
+ip_reassemble (struct iphdr *ip)
+{
+  struct ip_reasm *r, *slot = 0, *oldest = reasm_slots;
+  unsigned long now = currticks ();
+  unsigned int frags = ntohs (ip->frags);
+  unsigned int offset = (frags & 0x1FFF) << 3;
+  unsigned int len = ntohs (ip->len);
+  unsigned int i;
+
+  if (len <= sizeof (struct iphdr)
+      || nic.packetlen < ETH_HLEN + len)
+    return 0;
+
+  /* All but the last fragment come in whole units.  */
+  len -= sizeof (struct iphdr);
+  if (((frags & 0x2000) && (len & 7))
+      || offset + len > IP_REASM_MAX - sizeof (struct iphdr))
+    return 0;
+
+  for (r = reasm_slots; r < reasm_slots + IP_REASM_SLOTS; r++)
+    {
+      if (r->expire && now > r->expire)
+	r->expire = 0;
+
+      if (r->expire && r->src == ip->src.s_addr && r->ident == ip->ident
+	  && r->protocol == ip->protocol)
+	slot = r;
+
+      if (r->expire < oldest->expire)
+	oldest = r;
+    }
+
+  if (! slot)
+    {
+      /* Make room by giving up on the datagram which has waited
+	 longest.  */
+      slot = oldest;
+      slot->expire = now + IP_REASM_TIMEOUT;
+      slot->src = ip->src.s_addr;
+      slot->ident = ip->ident;
+      slot->protocol = ip->protocol;
+      slot->total = 0;
+      slot->units = 0;
+      grub_memset (slot->have, 0, sizeof (slot->have));
+    }
+
+  if (slot->total && offset + len > slot->total)
+    {
+      slot->expire = 0;
+      return 0;
+    }
+
+  grub_memmove (slot->packet + ETH_HLEN + sizeof (struct iphdr) + offset,
+		(char *) (ip + 1), len);
+  for (i = offset >> 3; i < (offset + len + 7) >> 3; i++)
+    if (! (slot->have[i >> 3] & (1 << (i & 7))))
+      {
+	slot->have[i >> 3] |= 1 << (i & 7);
+	slot->units++;
+      }
+
+  if (! (frags & 0x2000))
+    slot->total = offset + len;
+
+  if (! slot->total || slot->units != (slot->total + 7) >> 3)
+    return 0;
+
+  /* Whole: give it the headers of an unfragmented datagram.  */
+  grub_memmove (slot->packet, nic.packet, ETH_HLEN + sizeof (struct iphdr));
+  ip = (struct iphdr *) &slot->packet[ETH_HLEN];
+  ip->len = htons (sizeof (struct iphdr) + slot->total);
+  ip->frags = 0;
+  ip->chksum = 0;
+  ip->chksum = ipchksum ((unsigned short *) ip, sizeof (struct iphdr));
+
+  nic.packet = slot->packet;
+  nic.packetlen = ETH_HLEN + sizeof (struct iphdr) + slot->total;
+  slot->expire = 0;
+  return 1;
+}
+
 /**************************************************************************
 AWAIT_REPLY - Wait until we get a response for our request
 **************************************************************************/
@@ -741,6 +925,7 @@ await_reply (int type, int ival, void *ptr, int timeout)
   unsigned long time;
   struct iphdr *ip;
   struct udphdr *udp;
+  struct tcphdr *tcp;
   struct arprequest *arpreply;
   struct bootp_t *bootpreply;
   unsigned short ptype;
@@ -848,28 +1033,51 @@ await_reply (int type, int ival, void *ptr, int timeout)
 	  ip = (struct iphdr *) &nic.packet[ETH_HLEN];
 	  if (ip->verhdrlen != 0x45
 	      || ipchksum ((unsigned short *) ip, sizeof (struct iphdr))
-	      || ip->protocol != IP_UDP)
+	      || (ip->protocol != IP_UDP
+		  && ! (type == AWAIT_TCP && ip->protocol == IP_TCP)))
 	    continue;
 	  
 	  /*
 	    - Till Straumann <Till.Straumann@TU-Berlin.de>
 	    added udp checksum (safer on a wireless link)
-	    added fragmentation check: I had a corrupted image
-	    in memory due to fragmented TFTP packets - took me
-	    3 days to find the cause for this :-(
 	  */
 	  
 	  /* If More Fragments bit and Fragment Offset field
-	     are non-zero then packet is fragmented */
+	     are non-zero then packet is fragmented.  Go on with the
+	     whole datagram once the last piece is in.  */
 	  if (ip->frags & htons(0x3FFF))
 	    {
-	      grub_printf ("ALERT: got a fragmented packet - reconfigure your server\n");
+	      if (! ip_reassemble (ip))
+		continue;
+
+	      ip = (struct iphdr *) &nic.packet[ETH_HLEN];
+	    }
+	  
+	  /* TCP ?  */
+	  if (ip->protocol == IP_TCP)
+	    {
+	      tcp = (struct tcphdr *) &nic.packet[(ETH_HLEN
+						   + sizeof (struct iphdr))];
+	      if (nic.packetlen < ETH_HLEN + ntohs (ip->len)
+		  || ntohs (ip->len) < (sizeof (struct iphdr)
+					+ sizeof (struct tcphdr)))
+		continue;
+	      
+	      if (transport_chksum (ip))
+		{
+		  grub_printf ("TCP checksum error\n");
+		  continue;
+		}
+	      
+	      if (ntohs (tcp->dest) == ival)
+		return 1;
+	      
 	      continue;
 	    }
 	  
 	  udp = (struct udphdr *) &nic.packet[(ETH_HLEN
 					       + sizeof (struct iphdr))];
-	  if (udp->chksum && udpchksum (ip))
+	  if (udp->chksum && transport_chksum (ip))
 	    {
 	      grub_printf ("UDP checksum error\n");
 	      continue;
@@ -928,8 +1136,11 @@ await_reply (int type, int ival, void *ptr, int timeout)
 	      return 1;
 	    }
 	  
-	  /* TFTP ? */
-	  if (type == AWAIT_TFTP && ntohs (udp->dest) == ival)
+	  /* TFTP ?  PTR, if given, points to a second port to listen on,
+	     used for the group port of a multicast transfer.  */
+	  if (type == AWAIT_TFTP
+	      && (ntohs (udp->dest) == ival
+		  || (ptr && ntohs (udp->dest) == *(unsigned short *) ptr)))
 	    return 1;
 	}
       else
@@ -435,8 +435,6 @@ static void scan_bus(struct pci_device *pcidev)
 				if (vendor != pcidev[i].vendor
 				    || device != pcidev[i].dev_id)
 					continue;
-				pcidev[i].devfn = devfn;
-				pcidev[i].bus = bus;
 				for (reg = PCI_BASE_ADDRESS_0; reg <= PCI_BASE_ADDRESS_5; reg += 4) {
 					pcibios_read_config_dword(bus, devfn, reg, &ioaddr);
 
@@ -456,9 +454,26 @@ static void scan_bus(struct pci_device *pcidev)
 					if (pci_ioaddr == 0 || romaddr == ((unsigned long) rom.rom_segment << 4)) {
 						pcidev[i].membase = membase;
 						pcidev[i].ioaddr = ioaddr;
+						pcidev[i].devfn = devfn;
+						pcidev[i].bus = bus;
 						return;
 					}
 				}
+				/* No I/O space: remember the first such device by
+				   its memory BAR, for drivers which can do without
+				   I/O ports.  */
+				if (pcidev[i].membase != 0)
+					continue;
+				for (reg = PCI_BASE_ADDRESS_0; reg <= PCI_BASE_ADDRESS_5; reg += 4) {
+					pcibios_read_config_dword(bus, devfn, reg, &membase);
+					if ((membase & PCI_BASE_ADDRESS_SPACE_IO) == 0
+					    && (membase & ~0x0f) != 0) {
+						pcidev[i].membase = membase & ~0x0f;
+						pcidev[i].devfn = devfn;
+						pcidev[i].bus = bus;
+						break;
+					}
+				}
 			}
 		}
 	}
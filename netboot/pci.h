@@ -130,6 +130,18 @@ __asm__ __volatile__("pushl %0 ; popfl": /* no output */ :"g" (x):"memory")
 #define PCI_DEVICE_ID_INTEL_ID1029	0x1029
 #define PCI_DEVICE_ID_INTEL_ID1030	0x1030
 #define PCI_DEVICE_ID_INTEL_82562	0x2449
+#define PCI_DEVICE_ID_INTEL_82544GC	0x100C
+#define PCI_DEVICE_ID_INTEL_82540EM	0x100E
+#define PCI_DEVICE_ID_INTEL_82545EM	0x100F
+#define PCI_DEVICE_ID_INTEL_82546EB	0x1010
+#define PCI_DEVICE_ID_INTEL_82540EM_LOM	0x1015
+#define PCI_DEVICE_ID_INTEL_82547GI	0x1075
+#define PCI_DEVICE_ID_INTEL_82541GI	0x1076
+#define PCI_DEVICE_ID_INTEL_82571EB	0x105E
+#define PCI_DEVICE_ID_INTEL_82572EI	0x107D
+#define PCI_DEVICE_ID_INTEL_82573L	0x109A
+#define PCI_DEVICE_ID_INTEL_82574L	0x10D3
+#define PCI_DEVICE_ID_INTEL_82583V	0x150C
 #define PCI_VENDOR_ID_AMD		0x1022
 #define PCI_DEVICE_ID_AMD_LANCE		0x2000
 #define PCI_VENDOR_ID_AMD_HOMEPNA	0x1022
@@ -170,6 +182,9 @@ __asm__ __volatile__("pushl %0 ; popfl": /* no output */ :"g" (x):"memory")
 #define PCI_DEVICE_ID_OLICOM_OC2183	0x0013
 #define PCI_DEVICE_ID_OLICOM_OC2326	0x0014
 #define PCI_DEVICE_ID_OLICOM_OC6151	0x0021
+#define PCI_VENDOR_ID_REDHAT_QUMRANET	0x1af4
+#define PCI_DEVICE_ID_VIRTIO_NET	0x1000
+#define PCI_DEVICE_ID_VIRTIO_NET_MODERN	0x1041
 
 struct pci_device {
 	unsigned short	vendor, dev_id;
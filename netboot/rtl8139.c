@@ -321,10 +321,11 @@ static void rtl_reset(struct nic* nic)
 	/* Start the chip's Tx and Rx process. */
 	outl(0, ioaddr + RxMissed);
 	/* set_rx_mode */
-	outb(AcceptBroadcast|AcceptMyPhys, ioaddr + RxConfig);
-	/* If we add multicast support, the MAR0 register would have to be
-	 * initialized to 0xffffffffffffffff (two 32 bit accesses).  Etherboot
-	 * only needs broadcast (for ARP/RARP/BOOTP/DHCP) and unicast.  */
+	/* Accept all multicast frames too, for multicast TFTP.  The group
+	 * is checked in software, so the hash filter is left wide open.  */
+	outl(0xffffffff, ioaddr + MAR0);
+	outl(0xffffffff, ioaddr + MAR0 + 4);
+	outb(AcceptBroadcast|AcceptMulticast|AcceptMyPhys, ioaddr + RxConfig);
 	outb(CmdRxEnb | CmdTxEnb, ioaddr + ChipCmd);
 
 	/* Disable all known interrupts by setting the interrupt mask. */
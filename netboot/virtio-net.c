@@ -0,0 +1,594 @@
+/* virtio-net.c - etherboot driver for virtio network devices
+
+  This software may be used and distributed according to the terms
+  of the GNU Public License, incorporated herein by reference.
+
+  Supports both the legacy (virtio 0.9.5, I/O port) and the modern
+  (virtio 1.0, PCI capabilities and memory mapped registers) transports.
+  The device is used in polling mode: interrupts are never enabled.
+
+  Several receive buffers are kept posted to the device, so that a burst
+  of TFTP data packets does not have to wait for the driver between two
+  frames.  Consumed receive buffers are handed back to the device in
+  batches with a single notification, and notifications are skipped
+  altogether while the device says it does not need them.  Transmit
+  buffers are reclaimed lazily, so the driver does not wait for each
+  frame to leave before returning.
+
+*/
+
+#include "etherboot.h"
+#include "nic.h"
+#include "pci.h"
+#include "cards.h"
+#include "timer.h"
+
+#undef DEBUG_VIRTIO
+
+#define VIRTIO_TIMEOUT		(1*TICKS_PER_SEC)
+
+/* Largest queue we can place in NIC_BUF.  A legacy device dictates the
+   queue size, QEMU uses 256.  */
+#define VIRTIO_QUEUE_MAX	256
+
+#define NUM_RX_BUFS		4
+#define NUM_TX_BUFS		1
+/* Hand consumed receive buffers back after this many.  */
+#define RX_REFILL_BATCH		(NUM_RX_BUFS / 2)
+
+#define RX_QUEUE		0
+#define TX_QUEUE		1
+
+/* Large enough for a frame with a VLAN tag.  */
+#define VIRTIO_BUF_SIZE		(ETH_FRAME_LEN + 4)
+/* struct virtio_net_hdr, plus num_buffers for modern devices.  */
+#define VIRTIO_HDR_MAX		12
+#define VIRTIO_HDR_LEGACY	10
+
+/* Device status bits.  */
+#define VIRTIO_STATUS_ACKNOWLEDGE	0x01
+#define VIRTIO_STATUS_DRIVER		0x02
+#define VIRTIO_STATUS_DRIVER_OK		0x04
+#define VIRTIO_STATUS_FEATURES_OK	0x08
+#define VIRTIO_STATUS_FAILED		0x80
+
+/* Feature bits.  */
+#define VIRTIO_NET_F_MAC	5
+#define VIRTIO_F_VERSION_1	32
+
+/* Legacy I/O port register offsets.  */
+enum virtio_legacy_registers {
+	LegacyHostFeatures=0x00, LegacyGuestFeatures=0x04,
+	LegacyQueuePFN=0x08, LegacyQueueNum=0x0C, LegacyQueueSel=0x0E,
+	LegacyQueueNotify=0x10, LegacyStatus=0x12, LegacyISR=0x13,
+	LegacyMAC=0x14,
+};
+
+/* Modern common configuration structure offsets.  */
+enum virtio_common_registers {
+	CommonDFSelect=0x00, CommonDF=0x04, CommonGFSelect=0x08, CommonGF=0x0C,
+	CommonMSIX=0x10, CommonNumQueues=0x12, CommonStatus=0x14,
+	CommonCfgGeneration=0x15, CommonQueueSelect=0x16, CommonQueueSize=0x18,
+	CommonQueueMSIX=0x1A, CommonQueueEnable=0x1C, CommonQueueNotifyOff=0x1E,
+	CommonQueueDesc=0x20, CommonQueueAvail=0x28, CommonQueueUsed=0x30,
+};
+
+/* Virtio vendor specific PCI capability.  */
+#define PCI_STATUS			0x06
+#define PCI_STATUS_CAP_LIST		0x10
+#define PCI_CAPABILITY_LIST		0x34
+#define PCI_CAP_ID_VNDR			0x09
+
+#define VIRTIO_PCI_CAP_CFG_TYPE		3
+#define VIRTIO_PCI_CAP_BAR		4
+#define VIRTIO_PCI_CAP_OFFSET		8
+#define VIRTIO_PCI_NOTIFY_MULTIPLIER	16
+
+#define VIRTIO_PCI_CAP_COMMON_CFG	1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG	2
+#define VIRTIO_PCI_CAP_DEVICE_CFG	4
+
+#define PCI_BASE_ADDRESS_MEM_TYPE_64	0x04
+#define PCI_BASE_ADDRESS_MEM_MASK	(~0x0f)
+
+/* Split virtqueue layout.  */
+#define VRING_DESC_F_NEXT	1
+#define VRING_DESC_F_WRITE	2
+#define VRING_USED_F_NO_NOTIFY	1
+
+struct vring_desc {
+	unsigned int addr_lo, addr_hi;
+	unsigned int len;
+	unsigned short flags, next;
+};
+
+struct vring_avail {
+	unsigned short flags, idx;
+	unsigned short ring[VIRTIO_QUEUE_MAX];
+};
+
+struct vring_used_elem {
+	unsigned int id, len;
+};
+
+struct vring_used {
+	unsigned short flags;
+	volatile unsigned short idx;
+	struct vring_used_elem ring[VIRTIO_QUEUE_MAX];
+};
+
+#define VRING_ALIGN		4096
+#define VRING_ALIGN_UP(x)	(((x) + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1))
+#define VRING_USED_OFFSET(n)	VRING_ALIGN_UP (16 * (n) + 6 + 2 * (n))
+#define VRING_SIZE(n)		(VRING_USED_OFFSET (n) \
+				 + VRING_ALIGN_UP (6 + 8 * (n)))
+
+struct vring {
+	unsigned int num;
+	struct vring_desc *desc;
+	struct vring_avail *avail;
+	struct vring_used *used;
+	/* Our copy of avail->idx and the next used entry to look at.  */
+	unsigned short avail_idx, last_used;
+	/* Legacy: queue index.  Modern: notification register address.  */
+	unsigned long notify;
+};
+
+/* Only x86 is supported, where stores are not reordered against each
+   other, so keeping the compiler from doing it is enough.  */
+#define vring_barrier()	__asm__ __volatile__ ("" : : : "memory")
+
+static int ioaddr;
+static int modern;
+static unsigned long common_cfg, device_cfg, notify_base;
+static unsigned int notify_multiplier;
+static unsigned int hdr_len;
+
+static struct vring rx_vring, tx_vring;
+static unsigned int rx_pending;		/* consumed, not yet handed back */
+static unsigned int tx_free;		/* bit I set: tx buffer I is free */
+
+/* The rings and buffers are too large for the Stage 2 image, so they
+   live in NIC_BUF, which is page aligned.  */
+struct virtio_mem {
+	unsigned char vring[2][VRING_SIZE (VIRTIO_QUEUE_MAX)];
+	unsigned char rx_hdr[NUM_RX_BUFS][VIRTIO_HDR_MAX];
+	unsigned char rx_buffer[NUM_RX_BUFS][VIRTIO_BUF_SIZE];
+	unsigned char tx_hdr[VIRTIO_HDR_MAX];
+	unsigned char tx_buffer[NUM_TX_BUFS][VIRTIO_BUF_SIZE];
+};
+#define vmem	((struct virtio_mem *) NIC_BUF)
+
+struct nic *virtio_net_probe(struct nic *nic, unsigned short *probeaddrs,
+	struct pci_device *pci);
+static int vp_find_modern(struct pci_device *pci);
+static void vp_reset(void);
+static void vp_set_status(unsigned char status);
+static unsigned char vp_get_status(void);
+static int vp_setup_queue(int index, struct vring *vr);
+static void vp_notify(struct vring *vr);
+static void vring_add(struct vring *vr, unsigned short head);
+static void vring_kick(struct vring *vr);
+static void virtio_reset(struct nic *nic);
+static void virtio_transmit(struct nic *nic, const char *destaddr,
+	unsigned int type, unsigned int len, const char *data);
+static int virtio_poll(struct nic *nic);
+static void virtio_disable(struct nic *nic);
+
+
+struct nic *virtio_net_probe(struct nic *nic, unsigned short *probeaddrs,
+	struct pci_device *pci)
+{
+	int i;
+
+	printf(" - ");
+
+	ioaddr = probeaddrs[0] & ~3;
+	modern = vp_find_modern(pci);
+	if (!modern && !ioaddr) {
+		printf("no usable transport\n");
+		return 0;
+	}
+
+	adjust_pci_device(pci);
+	if (modern) {
+		unsigned short cmd;
+
+		pcibios_read_config_word(pci->bus, pci->devfn, PCI_COMMAND,
+			&cmd);
+		pcibios_write_config_word(pci->bus, pci->devfn, PCI_COMMAND,
+			cmd | PCI_COMMAND_MEM);
+	}
+
+	vp_reset();
+	vp_set_status(VIRTIO_STATUS_ACKNOWLEDGE);
+	vp_set_status(VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+	if (modern) {
+		writel(0, common_cfg + CommonDFSelect);
+		if (!(readl(common_cfg + CommonDF) & (1 << VIRTIO_NET_F_MAC)))
+			goto no_mac;
+		for (i = 0; i < ETH_ALEN; i++)
+			nic->node_addr[i] = readb(device_cfg + i);
+	} else {
+		if (!(inl(ioaddr + LegacyHostFeatures)
+		      & (1 << VIRTIO_NET_F_MAC)))
+			goto no_mac;
+		for (i = 0; i < ETH_ALEN; i++)
+			nic->node_addr[i] = inb(ioaddr + LegacyMAC + i);
+	}
+
+	printf("%s %#X, addr %!\n", modern ? "membase" : "ioaddr",
+		modern ? (unsigned int) common_cfg : ioaddr, nic->node_addr);
+
+	virtio_reset(nic);
+	if (!(vp_get_status() & VIRTIO_STATUS_DRIVER_OK))
+		return 0;
+
+	nic->reset = virtio_reset;
+	nic->poll = virtio_poll;
+	nic->transmit = virtio_transmit;
+	nic->disable = virtio_disable;
+
+	return nic;
+
+no_mac:
+	printf("device has no MAC address\n");
+	vp_set_status(VIRTIO_STATUS_FAILED);
+	return 0;
+}
+
+/* Return the address of the memory BAR number BAR, or zero if it cannot
+   be reached from 32-bit code.  */
+static unsigned long vp_bar_address(struct pci_device *pci, int bar)
+{
+	unsigned int lo, hi = 0;
+	int reg = PCI_BASE_ADDRESS_0 + bar * 4;
+
+	if (bar > 5)
+		return 0;
+	pcibios_read_config_dword(pci->bus, pci->devfn, reg, &lo);
+	if (lo & PCI_BASE_ADDRESS_SPACE_IO)
+		return 0;
+	if ((lo & 0x06) == PCI_BASE_ADDRESS_MEM_TYPE_64 && bar < 5)
+		pcibios_read_config_dword(pci->bus, pci->devfn, reg + 4, &hi);
+	if (hi)
+		return 0;
+	return lo & PCI_BASE_ADDRESS_MEM_MASK;
+}
+
+/* Look for the virtio 1.0 capabilities.  Return non-zero if the common,
+   notification and device configuration structures are all reachable.  */
+static int vp_find_modern(struct pci_device *pci)
+{
+	unsigned short status;
+	unsigned char pos, id, type, bar;
+	unsigned int offset;
+	unsigned long base;
+	int ttl = 48;
+
+	common_cfg = device_cfg = notify_base = 0;
+
+	pcibios_read_config_word(pci->bus, pci->devfn, PCI_STATUS, &status);
+	if (!(status & PCI_STATUS_CAP_LIST))
+		return 0;
+
+	pcibios_read_config_byte(pci->bus, pci->devfn, PCI_CAPABILITY_LIST,
+		&pos);
+	while (pos >= 0x40 && ttl--) {
+		pos &= ~3;
+		pcibios_read_config_byte(pci->bus, pci->devfn, pos, &id);
+		if (id == PCI_CAP_ID_VNDR) {
+			pcibios_read_config_byte(pci->bus, pci->devfn,
+				pos + VIRTIO_PCI_CAP_CFG_TYPE, &type);
+			pcibios_read_config_byte(pci->bus, pci->devfn,
+				pos + VIRTIO_PCI_CAP_BAR, &bar);
+			pcibios_read_config_dword(pci->bus, pci->devfn,
+				pos + VIRTIO_PCI_CAP_OFFSET, &offset);
+			base = vp_bar_address(pci, bar);
+			if (base) {
+				base += offset;
+				if (type == VIRTIO_PCI_CAP_COMMON_CFG
+				    && !common_cfg)
+					common_cfg = base;
+				else if (type == VIRTIO_PCI_CAP_DEVICE_CFG
+					 && !device_cfg)
+					device_cfg = base;
+				else if (type == VIRTIO_PCI_CAP_NOTIFY_CFG
+					 && !notify_base) {
+					notify_base = base;
+					pcibios_read_config_dword(pci->bus,
+						pci->devfn,
+						pos + VIRTIO_PCI_NOTIFY_MULTIPLIER,
+						&notify_multiplier);
+				}
+			}
+		}
+		pcibios_read_config_byte(pci->bus, pci->devfn, pos + 1, &pos);
+	}
+
+	return common_cfg && device_cfg && notify_base;
+}
+
+static void vp_set_status(unsigned char status)
+{
+	if (modern)
+		writeb(status, common_cfg + CommonStatus);
+	else
+		outb(status, ioaddr + LegacyStatus);
+}
+
+static unsigned char vp_get_status(void)
+{
+	if (modern)
+		return readb(common_cfg + CommonStatus);
+	return inb(ioaddr + LegacyStatus);
+}
+
+static void vp_reset(void)
+{
+	vp_set_status(0);
+
+	/* A modern device reports zero once the reset has completed.  */
+	load_timer2(10*TICKS_PER_MS);
+	while (vp_get_status() != 0 && timer2_running())
+		/* wait */;
+	if (!modern)
+		/* Reading the ISR acknowledges any pending interrupt.  */
+		inb(ioaddr + LegacyISR);
+}
+
+/* Select queue INDEX, lay out VR in our static ring memory and give it to
+   the device.  Return zero on failure.  */
+static int vp_setup_queue(int index, struct vring *vr)
+{
+	unsigned char *mem = vmem->vring[index];
+	unsigned int num;
+
+	if (modern) {
+		writew(index, common_cfg + CommonQueueSelect);
+		num = readw(common_cfg + CommonQueueSize);
+		if (num > VIRTIO_QUEUE_MAX)
+			num = VIRTIO_QUEUE_MAX;
+	} else {
+		outw(index, ioaddr + LegacyQueueSel);
+		num = inw(ioaddr + LegacyQueueNum);
+		if (num > VIRTIO_QUEUE_MAX) {
+			printf("queue %d too large (%d)\n", index, num);
+			return 0;
+		}
+	}
+	if (num < 2 * NUM_RX_BUFS || (num & (num - 1)) != 0) {
+		printf("queue %d has unusable size %d\n", index, num);
+		return 0;
+	}
+
+	memset(mem, 0, VRING_SIZE(num));
+	vr->num = num;
+	vr->desc = (struct vring_desc *) mem;
+	vr->avail = (struct vring_avail *) (mem + 16 * num);
+	vr->used = (struct vring_used *) (mem + VRING_USED_OFFSET(num));
+	vr->avail_idx = 0;
+	vr->last_used = 0;
+
+	if (modern) {
+		writew(num, common_cfg + CommonQueueSize);
+		writel((unsigned long) vr->desc, common_cfg + CommonQueueDesc);
+		writel(0, common_cfg + CommonQueueDesc + 4);
+		writel((unsigned long) vr->avail, common_cfg + CommonQueueAvail);
+		writel(0, common_cfg + CommonQueueAvail + 4);
+		writel((unsigned long) vr->used, common_cfg + CommonQueueUsed);
+		writel(0, common_cfg + CommonQueueUsed + 4);
+		vr->notify = notify_base
+			+ readw(common_cfg + CommonQueueNotifyOff)
+			* notify_multiplier;
+		writew(1, common_cfg + CommonQueueEnable);
+	} else {
+		outl((unsigned long) mem / VRING_ALIGN, ioaddr + LegacyQueuePFN);
+		vr->notify = index;
+	}
+
+	return 1;
+}
+
+static void vp_notify(struct vring *vr)
+{
+	if (modern)
+		writew(vr == &tx_vring ? TX_QUEUE : RX_QUEUE, vr->notify);
+	else
+		outw(vr->notify, ioaddr + LegacyQueueNotify);
+}
+
+/* Fill descriptor D with a buffer.  */
+static void vring_set_desc(struct vring *vr, unsigned short d,
+	void *addr, unsigned int len, unsigned short flags)
+{
+	vr->desc[d].addr_lo = (unsigned long) addr;
+	vr->desc[d].addr_hi = 0;
+	vr->desc[d].len = len;
+	vr->desc[d].flags = flags;
+	vr->desc[d].next = d + 1;
+}
+
+/* Make the chain starting at HEAD available to the device.  The device
+   only sees it once vring_kick publishes the new index.  */
+static void vring_add(struct vring *vr, unsigned short head)
+{
+	vr->avail->ring[vr->avail_idx % vr->num] = head;
+	vr->avail_idx++;
+}
+
+static void vring_kick(struct vring *vr)
+{
+	vring_barrier();
+	vr->avail->idx = vr->avail_idx;
+	vring_barrier();
+	if (!(vr->used->flags & VRING_USED_F_NO_NOTIFY))
+		vp_notify(vr);
+}
+
+static void virtio_reset(struct nic *nic)
+{
+	unsigned char status = VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER;
+	int i;
+
+	vp_reset();
+	vp_set_status(status);
+
+	/* Only ask for the MAC address; no offloads, no merged buffers.  */
+	if (modern) {
+		writel(0, common_cfg + CommonGFSelect);
+		writel(1 << VIRTIO_NET_F_MAC, common_cfg + CommonGF);
+		writel(1, common_cfg + CommonGFSelect);
+		writel(1 << (VIRTIO_F_VERSION_1 - 32), common_cfg + CommonGF);
+		status |= VIRTIO_STATUS_FEATURES_OK;
+		vp_set_status(status);
+		if (!(vp_get_status() & VIRTIO_STATUS_FEATURES_OK)) {
+			printf("virtio: features rejected\n");
+			goto fail;
+		}
+		hdr_len = VIRTIO_HDR_MAX;
+	} else {
+		outl(1 << VIRTIO_NET_F_MAC, ioaddr + LegacyGuestFeatures);
+		hdr_len = VIRTIO_HDR_LEGACY;
+	}
+
+	if (!vp_setup_queue(RX_QUEUE, &rx_vring)
+	    || !vp_setup_queue(TX_QUEUE, &tx_vring))
+		goto fail;
+
+	/* Each buffer is a chain of two descriptors: the header and the
+	   frame.  Buffer I always uses descriptors 2I and 2I+1.  */
+	for (i = 0; i < NUM_RX_BUFS; i++) {
+		vring_set_desc(&rx_vring, 2 * i, vmem->rx_hdr[i], hdr_len,
+			VRING_DESC_F_WRITE | VRING_DESC_F_NEXT);
+		vring_set_desc(&rx_vring, 2 * i + 1, vmem->rx_buffer[i],
+			VIRTIO_BUF_SIZE, VRING_DESC_F_WRITE);
+		vring_add(&rx_vring, 2 * i);
+	}
+	memset(vmem->tx_hdr, 0, sizeof(vmem->tx_hdr));
+	for (i = 0; i < NUM_TX_BUFS; i++) {
+		vring_set_desc(&tx_vring, 2 * i, vmem->tx_hdr, hdr_len,
+			VRING_DESC_F_NEXT);
+		vring_set_desc(&tx_vring, 2 * i + 1, vmem->tx_buffer[i],
+			0, 0);
+	}
+	rx_pending = 0;
+	tx_free = (1 << NUM_TX_BUFS) - 1;
+
+	vp_set_status(status | VIRTIO_STATUS_DRIVER_OK);
+	vring_kick(&rx_vring);
+	return;
+
+fail:
+	vp_set_status(VIRTIO_STATUS_FAILED);
+}
+
+/* Reclaim the transmit buffers the device has finished with.  */
+static void virtio_tx_reclaim(void)
+{
+	unsigned int id;
+
+	while (tx_vring.last_used != tx_vring.used->idx) {
+		vring_barrier();
+		id = tx_vring.used->ring[tx_vring.last_used % tx_vring.num].id;
+		if (id < 2 * NUM_TX_BUFS)
+			tx_free |= 1 << (id / 2);
+		tx_vring.last_used++;
+	}
+}
+
+static void virtio_transmit(struct nic *nic, const char *destaddr,
+	unsigned int type, unsigned int len, const char *data)
+{
+	unsigned char *buf;
+	unsigned short head;
+	unsigned int nstype, to;
+	int i;
+
+	virtio_tx_reclaim();
+	if (!tx_free) {
+		to = currticks() + VIRTIO_TIMEOUT;
+		do {
+			virtio_tx_reclaim();
+		} while (!tx_free && currticks() < to);
+		if (!tx_free) {
+#ifdef	DEBUG_VIRTIO
+			printf("tx timeout\n");
+#endif
+			virtio_reset(nic);
+			if (!tx_free)
+				return;
+		}
+	}
+
+	for (i = 0; !(tx_free & (1 << i)); i++)
+		;
+	tx_free &= ~(1 << i);
+	head = 2 * i;
+	buf = vmem->tx_buffer[i];
+
+	memcpy(buf, destaddr, ETH_ALEN);
+	memcpy(buf + ETH_ALEN, nic->node_addr, ETH_ALEN);
+	nstype = htons(type);
+	memcpy(buf + 2 * ETH_ALEN, (char *) &nstype, 2);
+	memcpy(buf + ETH_HLEN, data, len);
+	len += ETH_HLEN;
+	while (len < ETH_ZLEN)
+		buf[len++] = '\0';
+
+#ifdef	DEBUG_VIRTIO
+	printf("sending %d bytes ethtype %hX\n", len, type);
+#endif
+	tx_vring.desc[head + 1].len = len;
+	vring_add(&tx_vring, head);
+	vring_kick(&tx_vring);
+}
+
+static int virtio_poll(struct nic *nic)
+{
+	struct vring_used_elem *elem;
+	unsigned int id, len;
+
+	if (rx_vring.last_used == rx_vring.used->idx)
+		return 0;
+	vring_barrier();
+
+	elem = &rx_vring.used->ring[rx_vring.last_used % rx_vring.num];
+	id = elem->id;
+	len = elem->len;
+	rx_vring.last_used++;
+
+	if (id >= 2 * NUM_RX_BUFS || (id & 1) != 0 || len <= hdr_len) {
+		printf("virtio: bad rx descriptor %d\n", id);
+		virtio_reset(nic);
+		return 0;
+	}
+	len -= hdr_len;
+	if (len > ETH_FRAME_LEN)
+		len = ETH_FRAME_LEN;
+
+	memcpy(nic->packet, vmem->rx_buffer[id / 2], len);
+	nic->packetlen = len;
+#ifdef	DEBUG_VIRTIO
+	printf("rx packet %d bytes in buffer %d\n", len, id / 2);
+#endif
+
+	/* Give the buffer back.  Publish the whole batch at once, or now if
+	   the device has no other buffer left to receive into.  */
+	vring_add(&rx_vring, id);
+	rx_pending++;
+	if (rx_pending >= RX_REFILL_BATCH
+	    || rx_vring.used->idx == (unsigned short) (rx_vring.avail->idx)) {
+		vring_kick(&rx_vring);
+		rx_pending = 0;
+	}
+
+	return 1;
+}
+
+static void virtio_disable(struct nic *nic)
+{
+	/* Stop the device from touching our buffers.  */
+	vp_reset();
+}
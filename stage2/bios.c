@@ -51,6 +51,15 @@ biosdisk (int read, int drive, struct geometry *geometry,
 {
   int err;
   
+#ifndef STAGE1_5
+  if (MD_DRIVE_P (drive))
+    return md_biosdisk (read, drive, geometry, sector, nsec, segment);
+  if (RD_DRIVE_P (drive))
+    return rd_biosdisk (read, drive, geometry, sector, nsec, segment);
+  if (LD_DRIVE_P (drive))
+    return ld_biosdisk (read, drive, geometry, sector, nsec, segment);
+#endif
+
   if (geometry->flags & BIOSDISK_FLAG_LBA_EXTENSION)
     {
       struct disk_address_packet
@@ -185,6 +194,15 @@ get_diskinfo (int drive, struct geometry *geometry)
 {
   int err;
 
+#ifndef STAGE1_5
+  if (MD_DRIVE_P (drive))
+    return md_get_diskinfo (drive, geometry);
+  if (RD_DRIVE_P (drive))
+    return rd_get_diskinfo (drive, geometry);
+  if (LD_DRIVE_P (drive))
+    return ld_get_diskinfo (drive, geometry);
+#endif
+
   /* Clear the flags.  */
   geometry->flags = 0;
   
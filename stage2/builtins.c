@@ -22,6 +22,7 @@
    WITHOUT_LIBC_STUBS here.  */
 #ifdef GRUB_UTIL
 # include <stdio.h>
+# include <unistd.h>
 #endif
 
 #include <shared.h>
@@ -78,6 +79,8 @@ int auth = 0;
 int grub_timeout = -1;
 /* Whether to show the menu or not.  */
 int show_menu = 1;
+/* Whether to read the commands of menu entries only when needed.  */
+int lazy_menu = 0;
 /* The BIOS drive map.  */
 static unsigned short bios_drive_map[DRIVE_MAP_SIZE + 1];
 
@@ -104,6 +107,7 @@ init_config (void)
   fallback_entryno = -1;
   fallback_entries[0] = -1;
   grub_timeout = -1;
+  lazy_menu = 0;
 }
 
 /* Check a password for correctness.  Returns 0 if password was
@@ -298,6 +302,9 @@ static int
 boot_func (char *arg, int flags)
 {
   struct term_entry *prev_term = current_term;
+  struct rd_params rd;
+  int have_rd;
+
   /* Clear the int15 handler if we can boot the kernel successfully.
      This assumes that the boot code never fails only if KERNEL_TYPE is
      not KERNEL_TYPE_NONE. Is this assumption is bad?  */
@@ -345,7 +352,8 @@ boot_func (char *arg, int flags)
       /* Chainloader */
       
       /* Check if we should set the int13 handler.  */
-      if (bios_drive_map[0] != 0)
+      have_rd = rd_get_params (&rd);
+      if (bios_drive_map[0] != 0 || have_rd)
 	{
 	  int i;
 	  
@@ -363,7 +371,7 @@ boot_func (char *arg, int flags)
 	    }
 	  
 	  /* Set the handler. This is somewhat dangerous.  */
-	  set_int13_handler (bios_drive_map);
+	  set_int13_handler (bios_drive_map, have_rd ? &rd : 0);
 	}
       
       gateA20 (0);
@@ -953,6 +961,8 @@ device_func (char *arg, int flags)
     }
 
   assign_device_name (current_drive, device);
+  /* Cached path lookups may refer to the old device.  */
+  dentry_cache_flush ();
 
   return 0;
 }
@@ -1538,12 +1548,15 @@ find_func (char *arg, int flags)
 		      
 		      grub_close ();
 		      
-		      if (bsd_part == 0xFF)
-			grub_printf (" (hd%d,%d)\n",
-				     drive - 0x80, pc_slice);
+		      if (drive == RD_DRIVE)
+			grub_printf (" (rd,%d", pc_slice);
+		      else if (LD_DRIVE_P (drive))
+			grub_printf (" (ld%d,%d", drive - LD_DRIVE, pc_slice);
 		      else
-			grub_printf (" (hd%d,%d,%c)\n",
-				     drive - 0x80, pc_slice, bsd_part + 'a');
+			grub_printf (" (hd%d,%d", drive - 0x80, pc_slice);
+		      if (bsd_part != 0xFF)
+			grub_printf (",%c", bsd_part + 'a');
+		      grub_printf (")\n");
 
 		      got_file = 1;
 		    }
@@ -1761,6 +1774,109 @@ static struct builtin builtin_geometry =
   " on the C/H/S values automatically."
 };
 
+
+#ifndef NO_DECOMPRESSION
+/* gunziptest */
+
+/* Read the file ARG through in chunks and return its size, adding the
+   clock cycles spent in grub_read to *CYCLES.  If CRC is not NULL,
+   continue it over the data read.  */
+static int
+gunziptest_read (char *arg, unsigned long long *cycles, unsigned int *crc)
+{
+  char *buf = (char *) RAW_ADDR (0x100000);
+  int size = 0;
+
+  if (! grub_open (arg))
+    return -1;
+
+  while (1)
+    {
+      unsigned long long start = iostat_clock ();
+      int len = grub_read (buf, 0x10000);
+
+      *cycles += iostat_clock () - start;
+      if (len <= 0)
+	break;
+
+      if (crc)
+	*crc = gunzip_crc32 (*crc, buf, len);
+      size += len;
+    }
+
+  if (errnum)
+    size = -1;
+  else if (crc && ! compressed_file)
+    {
+      errnum = ERR_BAD_GZIP_HEADER;
+      size = -1;
+    }
+  else if (crc && (*crc != gunzip_stored_crc () || size != filemax))
+    {
+      grub_printf ("The data do not match the size and CRC stored"
+		   " in the file.\n");
+      errnum = ERR_BAD_GZIP_DATA;
+      size = -1;
+    }
+
+  grub_close ();
+  return size;
+}
+
+static int
+gunziptest_func (char *arg, int flags)
+{
+  unsigned long long raw_cycles = 0, cycles = 0;
+  unsigned long raw_us, us;
+  unsigned int crc = 0;
+  int raw_size, size;
+
+  /* Time reading the compressed data alone first, to tell the time
+     spent on the disk from the time spent inflating.  */
+  no_decompression = 1;
+  raw_size = gunziptest_read (arg, &raw_cycles, 0);
+  no_decompression = 0;
+  if (raw_size < 0)
+    return 1;
+
+  size = gunziptest_read (arg, &cycles, &crc);
+  if (size < 0)
+    return 1;
+
+  raw_us = iostat_microseconds (raw_cycles);
+  us = iostat_microseconds (cycles);
+  if (cycles > raw_cycles)
+    cycles -= raw_cycles;
+  else
+    cycles = 0;
+
+  grub_printf ("Compressed:   %d bytes, read in %lu us\n", raw_size, raw_us);
+  grub_printf ("Uncompressed: %d bytes, read in %lu us\n", size, us);
+  grub_printf ("CRC 0x%x and size match the file.\n", crc);
+
+  us = iostat_microseconds (cycles);
+  if (us && size)
+    grub_printf ("Inflating: %lu us, %lu.%lu cycles/byte, %lu KB/s\n", us,
+		 (unsigned long) (cycles / size),
+		 (unsigned long) (cycles * 10 / size % 10),
+		 (unsigned long) ((unsigned long long) size * 1000 / 1024
+				  * 1000 / us));
+
+  return 0;
+}
+
+static struct builtin builtin_gunziptest =
+{
+  "gunziptest",
+  gunziptest_func,
+  BUILTIN_CMDLINE,
+  "gunziptest FILE",
+  "Decompress the gzip file FILE, check the result against the size"
+  " and CRC stored in it, and print how long the reading and the"
+  " inflating took."
+};
+#endif /* ! NO_DECOMPRESSION */
+
 
 /* halt */
 static int
@@ -1959,6 +2075,63 @@ static struct builtin builtin_hide =
 
 
 #ifdef SUPPORT_NETBOOT
+/* httpserver */
+static int
+httpserver_func (char *arg, int flags)
+{
+  char *port;
+  int new_port = HTTP_PORT;
+  in_addr server;
+
+  if (grub_memcmp (arg, "off", 3) == 0)
+    {
+      http_port = 0;
+      http_server.s_addr = 0;
+      return 0;
+    }
+
+  server.s_addr = 0;
+  if (*arg && ! inet_aton (arg, &server))
+    {
+      errnum = ERR_BAD_ARGUMENT;
+      return 1;
+    }
+
+  for (port = arg; *port && *port != ':' && *port != ' ' && *port != '\t';
+       port++)
+    ;
+
+  if (*port == ':')
+    {
+      port++;
+      if (! safe_parse_maxint (&port, &new_port))
+	return 1;
+
+      if (new_port <= 0 || new_port > 0xFFFF)
+	{
+	  errnum = ERR_BAD_ARGUMENT;
+	  return 1;
+	}
+    }
+
+  http_port = new_port;
+  http_server = server;
+  print_network_configuration ();
+  return 0;
+}
+
+static struct builtin builtin_httpserver =
+{
+  "httpserver",
+  httpserver_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "httpserver [IPADDR[:PORT]|off]",
+  "Read files on the network drive from the HTTP server at IPADDR,"
+  " on PORT if given, instead of with TFTP. Without IPADDR, the"
+  " boot server is used. If the argument is `off', use TFTP again."
+};
+
+
 /* ifconfig */
 static int
 ifconfig_func (char *arg, int flags)
@@ -2149,6 +2322,10 @@ install_blocklist_helper (int sector, int offset, int length)
   *installaddr += 512;
 }
 
+/* If nonzero, installing a Stage 1.5 leaves the Stage 2 alone, as
+   `setup' has patched it already.  */
+static int install_keep_stage2;
+
 static int
 install_func (char *arg, int flags)
 {
@@ -2510,10 +2687,13 @@ install_func (char *arg, int flags)
 	  /* Write it to the disk.  */
 	  buf_track = -1;
 
+	  if (install_keep_stage2)
+	    /* Already written by `setup'.  */
+	    ;
 #ifdef GRUB_UTIL
 	  /* In the grub shell, access the Stage 2 via the OS filesystem
 	     service, if possible.  */
-	  if (stage2_os_file)
+	  else if (stage2_os_file)
 	    {
 	      FILE *fp;
 
@@ -2688,6 +2868,31 @@ static struct builtin builtin_ioprobe =
 };
 #endif /* ! PLATFORM_EFI */
 
+
+/* iostat */
+static int
+iostat_func (char *arg, int flags)
+{
+  iostat_print ();
+
+  if (grub_memcmp (arg, "--reset", 7) == 0)
+    iostat_reset ();
+
+  return 0;
+}
+
+static struct builtin builtin_iostat =
+{
+  "iostat",
+  iostat_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "iostat [--reset]",
+  "Print how many reads went to each drive and network server, how"
+  " many were served from a buffer instead, how many failed or were"
+  " retried, and a histogram of how long they took. If the option"
+  " `--reset' is given, start counting afresh afterwards."
+};
+
 
 /* kernel */
 static int
@@ -2778,6 +2983,27 @@ static struct builtin builtin_kernel =
 };
 
 
+/* lazymenu */
+static int
+lazymenu_func (char *arg, int flags)
+{
+  lazy_menu = 1;
+  return 0;
+}
+
+static struct builtin builtin_lazymenu =
+{
+  "lazymenu",
+  lazymenu_func,
+  BUILTIN_MENU,
+#if 0
+  "lazymenu",
+  "Read the commands of each entry from the configuration file only"
+  " when the entry is edited or booted."
+#endif
+};
+
+
 /* lock */
 static int
 lock_func (char *arg, int flags)
@@ -2801,6 +3027,49 @@ static struct builtin builtin_lock =
 };
   
 
+/* loopback */
+static int
+loopback_func (char *arg, int flags)
+{
+  char *file;
+
+  if (! *arg)
+    {
+      ld_print ();
+      return 0;
+    }
+
+  file = skip_to (0, arg);
+  set_device (arg);
+  if (errnum)
+    return 1;
+
+  if (! LD_DRIVE_P (current_drive) || current_partition != 0xFFFFFF)
+    {
+      errnum = ERR_DEV_FORMAT;
+      return 1;
+    }
+
+  if (! ld_setup ((current_drive & 0x7F) - LD_FLOPPY_DRIVE, file))
+    return 1;
+
+  ld_print ();
+  return 0;
+}
+
+static struct builtin builtin_loopback =
+{
+  "loopback",
+  loopback_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "loopback [DRIVE [FILE]]",
+  "Use FILE as the drive DRIVE, one of (ld0) to (ld3), reading it"
+  " where it is on its disk. A file with a partition table is a hard"
+  " disk, and any other a floppy. Without FILE, remove DRIVE, and"
+  " without any argument, show the loopback drives."
+};
+  
+
 /* makeactive */
 static int
 makeactive_func (char *arg, int flags)
@@ -2946,6 +3215,34 @@ static struct builtin builtin_md5crypt =
 };
 #endif /* USE_MD5_PASSWORDS */
 
+
+/* mdscan */
+static int
+mdscan_func (char *arg, int flags)
+{
+  /* Members may have failed or come back since the last scan.  */
+  if (! md_scan ())
+    {
+      grub_printf (" No RAID1 arrays found.\n");
+      return 0;
+    }
+
+  md_print ();
+  return 0;
+}
+
+static struct builtin builtin_mdscan =
+{
+  "mdscan",
+  mdscan_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "mdscan",
+  "Look for Linux md RAID1 arrays on all hard disks again, and list"
+  " the arrays found as the drives (md0) to (md3). Each array is read"
+  " through all of its members, with reads spread across them and"
+  " retried on another member if one fails."
+};
+
 #ifndef PLATFORM_EFI
 
 /* module */
@@ -3026,6 +3323,50 @@ static struct builtin builtin_modulenounzip =
 };
 #endif /* !PLATFORM_EFI */
 
+
+#if defined(SUPPORT_NETBOOT) || defined(PLATFORM_EFI)
+/* mtftp on|off|MCASTIP:CPORT:SPORT */
+static int
+mtftp_func (char *arg, int flags)
+{
+  int on = grub_memcmp (arg, "off", 3) != 0;
+
+#ifdef PLATFORM_EFI
+  if (! *arg || ! efi_tftp_multicast (arg))
+    {
+      if (errnum == ERR_NONE)
+	errnum = ERR_BAD_ARGUMENT;
+      return 1;
+    }
+#else
+  /* With RFC 2090, the server picks the group.  */
+  if (grub_memcmp (arg, "on", 2) != 0 && on)
+    {
+      errnum = ERR_BAD_ARGUMENT;
+      return 1;
+    }
+
+  tftp_multicast = on;
+#endif
+
+  grub_printf (" Multicast TFTP is now %s\n", on ? "on" : "off");
+  return 0;
+}
+
+static struct builtin builtin_mtftp =
+{
+  "mtftp",
+  mtftp_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "mtftp on|off|MCASTIP:CPORT:SPORT",
+  "Fetch files on the network drive by multicast TFTP, sharing one"
+  " transmission between all the machines that boot the same file."
+  " If the argument is `on', the server tells where the data is sent."
+  " In EFI, the multicast group and the client and server ports can"
+  " also be given. Blocks missed on the group are read by unicast."
+};
+#endif /* SUPPORT_NETBOOT || PLATFORM_EFI */
+
 
 /* pager [on|off] */
 static int
@@ -3162,8 +3503,7 @@ partnew_func (char *arg, int flags)
   PC_MBR_SIG (mbr) = PC_MBR_SIGNATURE;
   
   /* Write back the MBR to the disk.  */
-  buf_track = -1;
-  if (! rawwrite (current_drive, 0, mbr))
+  if (! rawwrite (current_drive, 0, 1, mbr))
     return 1;
 
   return 0;
@@ -3243,8 +3583,7 @@ parttype_func (char *arg, int flags)
 	  PC_SLICE_TYPE (mbr, entry) = new_type;
 	  
 	  /* Write back the MBR to the disk.  */
-	  buf_track = -1;
-	  if (! rawwrite (current_drive, offset, mbr))
+	  if (! rawwrite (current_drive, offset, 1, mbr))
 	    return 1;
 
 	  /* Succeed.  */
@@ -3368,6 +3707,62 @@ static struct builtin builtin_pause =
   "Print MESSAGE, then wait until a key is pressed."
 };
 
+#ifdef PLATFORM_EFI
+
+/* profile */
+static int
+profile_func (char *arg, int flags)
+{
+  char *cmd = arg;
+  int num;
+
+  arg = skip_to (0, arg);
+
+  if (grub_memcmp (cmd, "start", 5) == 0)
+    {
+      num = 100;
+      if (*arg && ! safe_parse_maxint (&arg, &num))
+	return 1;
+      if (num < 1 || num > 10000)
+	{
+	  errnum = ERR_BAD_ARGUMENT;
+	  return 1;
+	}
+
+      if (! grub_efi_profile_start (num))
+	return 1;
+    }
+  else if (grub_memcmp (cmd, "stop", 4) == 0)
+    grub_efi_profile_stop ();
+  else if (grub_memcmp (cmd, "dump", 4) == 0)
+    {
+      num = 20;
+      if (*arg && ! safe_parse_maxint (&arg, &num))
+	return 1;
+
+      grub_efi_profile_dump (num);
+    }
+  else
+    {
+      errnum = ERR_BAD_ARGUMENT;
+      return 1;
+    }
+
+  return 0;
+}
+
+static struct builtin builtin_profile =
+{
+  "profile",
+  profile_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "profile start [HZ] | stop | dump [COUNT]",
+  "Find out where GRUB spends its time. `start' samples where GRUB is"
+  " HZ times a second, 100 by default, until `stop'. `dump' prints the"
+  " COUNT functions with the most samples, 20 by default."
+};
+#endif /* PLATFORM_EFI */
+
 #if defined (GRUB_UTIL) || defined (PLATFORM_EFI)
 
 /* quit */
@@ -3391,6 +3786,32 @@ static struct builtin builtin_quit =
 #endif /* defined (GRUB_UTIL) || defined (PLATFORM_EFI) */
 
 
+/* ramdisk */
+static int
+ramdisk_func (char *arg, int flags)
+{
+  if (*arg && ! rd_load (arg))
+    return 1;
+
+  rd_print ();
+  return 0;
+}
+
+static struct builtin builtin_ramdisk =
+{
+  "ramdisk",
+  ramdisk_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "ramdisk [FILE]",
+  "Load the disk image FILE into memory, uncompressing it if it is"
+  " gzipped, and use it as the drive (rd) in place of any loaded"
+  " before. An image with a partition table is a hard disk, and any"
+  " other a floppy."
+  " On a PC, chain-loaded systems see (rd) as a BIOS drive too, and"
+  " `map' can swap it with (hd0). Without FILE, show the RAM disk."
+};
+
+
 #ifdef SUPPORT_NETBOOT
 /* rarp */
 static int
@@ -3443,6 +3864,56 @@ static struct builtin builtin_read =
   " display it in hex format."
 };
 
+
+/* readahead */
+static int
+readahead_func (char *arg, int flags)
+{
+  int kbytes;
+
+  if (*arg)
+    {
+      if (grub_memcmp (arg, "off", 3) == 0)
+	kbytes = 0;
+      else if (! safe_parse_maxint (&arg, &kbytes))
+	return 1;
+      else if (kbytes < 0 || kbytes > 0x4000)
+	{
+	  errnum = ERR_BAD_ARGUMENT;
+	  return 1;
+	}
+
+      readahead_max = kbytes << 10;
+      return 0;
+    }
+
+  if (readahead_max)
+    grub_printf (" Read-ahead up to %dK, the window is now %dK\n",
+		 readahead_max >> 10,
+		 (readahead_window < readahead_max
+		  ? readahead_window : readahead_max) >> 10);
+  else
+    grub_printf (" Read-ahead is off\n");
+
+  grub_printf (" %d windows read, %d sectors in them, %d reads served,"
+	       " %d streams broken\n",
+	       readahead_stats.fills, readahead_stats.sectors,
+	       readahead_stats.hits, readahead_stats.collapses);
+  return 0;
+}
+
+static struct builtin builtin_readahead =
+{
+  "readahead",
+  readahead_func,
+  BUILTIN_CMDLINE | BUILTIN_MENU | BUILTIN_HELP_LIST,
+  "readahead [KBYTES|off]",
+  "Set the largest window, in kilobytes, that disk reads which continue"
+  " where the last one ended may read ahead. `off' disables read-ahead."
+  " Without an argument, print the current window and the read-ahead"
+  " statistics."
+};
+
 
 /* reboot */
 static int
@@ -3473,10 +3944,20 @@ print_root_device (void)
       /* Network drive.  */
       grub_printf (" (nd):");
     }
+  else if (MD_DRIVE_P (saved_drive))
+    {
+      /* RAID1 array.  */
+      grub_printf (" (md%d):", saved_drive - MD_DRIVE);
+    }
   else if (saved_drive & 0x80)
     {
-      /* Hard disk drive.  */
-      grub_printf (" (hd%d", saved_drive - 0x80);
+      /* Hard disk drive, the RAM disk, or a loopback drive.  */
+      if (saved_drive == RD_DRIVE)
+	grub_printf (" (rd");
+      else if (LD_DRIVE_P (saved_drive))
+	grub_printf (" (ld%d", saved_drive - LD_DRIVE);
+      else
+	grub_printf (" (hd%d", saved_drive - 0x80);
       
       if ((saved_partition & 0xFF0000) != 0xFF0000)
 	grub_printf (",%d", saved_partition >> 16);
@@ -3488,8 +3969,13 @@ print_root_device (void)
     }
   else
     {
-      /* Floppy disk drive.  */
-      grub_printf (" (fd%d):", saved_drive);
+      /* Floppy disk drive, the RAM disk, or a loopback drive.  */
+      if (saved_drive == RD_FLOPPY_DRIVE)
+	grub_printf (" (rd):");
+      else if (LD_DRIVE_P (saved_drive))
+	grub_printf (" (ld%d):", saved_drive - LD_FLOPPY_DRIVE);
+      else
+	grub_printf (" (fd%d):", saved_drive);
     }
 
   /* Print the filesystem information.  */
@@ -3644,11 +4130,8 @@ savedefault_helper(int new_default)
       *entryno_ptr = new_default;
       
       /* Save the image in the disk.  */
-      if (! rawwrite (boot_drive, install_second_sector, buffer))
+      if (! rawwrite (boot_drive, install_second_sector, 1, buffer))
 	return 1;
-      
-      /* Clear the cache.  */
-      buf_track = -1;
     }
 
   return 0;
@@ -4200,96 +4683,383 @@ static struct builtin builtin_setkey =
 
 
 /* setup */
-static int
-setup_func (char *arg, int flags)
+
+/* The maximum number of devices that one `setup' installs GRUB into.  */
+#define SETUP_MAX_TARGETS	32
+
+/* The status of a target not installed yet, and of one being installed
+   by a job. Otherwise, the status is the error number of the
+   installation, or SETUP_DEFERRED if a job could not install it.  */
+#define SETUP_PENDING		-1
+#define SETUP_RUNNING		-2
+#define SETUP_DEFERRED		0xFF
+
+/* The GRUB images found by `setup', shared by all the targets.  */
+static struct setup_images
 {
-  /* Point to the string of the installed drive/partition.  */
-  char *install_ptr;
-  /* Point to the string of the drive/parition where the GRUB images
-     reside.  */
-  char *image_ptr;
-  unsigned long installed_drive, installed_partition;
-  unsigned long image_drive, image_partition;
-  unsigned long tmp_drive, tmp_partition;
+  unsigned long drive;
+  unsigned long partition;
   char stage1[64];
   char stage2[64];
+  /* The Stage 1.5 for the filesystem, or empty if there is none.  */
+  char stage1_5[64];
   char config_filename[64];
-  char real_config_filename[64];
-  char cmd_arg[256];
-  char device[16];
+  char *stage2_arg;
+  int is_force_lba;
+  int flags;
+  /* If running in a job, in which only the target may be written.  */
+  int in_job;
+  /* If the Stage 2 has been patched for the Stage 1.5.  The patch is
+     the same for all the targets.  */
+  int stage2_patched;
+}
+setup_images;
+
+/* A device to install GRUB into.  */
+static struct setup_target
+{
+  char *name;
+  unsigned long drive;
+  unsigned long partition;
+  int status;
+  int pid;
+}
+setup_targets[SETUP_MAX_TARGETS];
+
+/* Check if the file FILE exists like Autoconf.  */
+static int
+setup_check_file (char *file)
+{
+  int ret;
+
+  grub_printf (" Checking if \"%s\" exists... ", file);
+  ret = grub_open (file);
+  if (ret)
+    {
+      grub_close ();
+      grub_printf ("yes\n");
+    }
+  else
+    grub_printf ("no\n");
+
+  return ret;
+}
+
+/* Construct the name of the drive DRIVE and the partition PARTITION
+   in DEVICE.  */
+static void
+setup_sprint_device (char *device, int drive, int partition)
+{
+  grub_sprintf (device, "(%cd%d",
+		(drive & 0x80) ? 'h' : 'f',
+		drive & ~0x80);
+  if ((partition & 0xFF0000) != 0xFF0000)
+    {
+      char tmp[16];
+      grub_sprintf (tmp, ",%d", (partition >> 16) & 0xFF);
+      grub_strncat (device, tmp, 16);
+    }
+  if ((partition & 0x00FF00) != 0x00FF00)
+    {
+      char tmp[16];
+      grub_sprintf (tmp, ",%c", 'a' + ((partition >> 8) & 0xFF));
+      grub_strncat (device, tmp, 16);
+    }
+  grub_strncat (device, ")", 16);
+}
+
+/* Embed the Stage 1.5 STAGE1_5 in the drive DRIVE and the partition
+   PARTITION. If successful, put the blocklist of the embedded Stage 1.5
+   at RAW_ADDR (0x100000) and return true.  */
+static int
+setup_embed (char *stage1_5, int drive, int partition, int flags)
+{
+  char cmd_arg[256];
+  char device[16];
   char *buffer = (char *) RAW_ADDR (0x100000);
-  int is_force_lba = 0;
-  char *stage2_arg = 0;
-  char *prefix = 0;
 
-  auto int check_file (char *file);
-  auto void sprint_device (int drive, int partition);
-  auto int embed_stage1_5 (char * stage1_5, int drive, int partition);
-  
-  /* Check if the file FILE exists like Autoconf.  */
-  int check_file (char *file)
+  /* We install GRUB into the MBR, so try to embed the
+     Stage 1.5 in the sectors right after the MBR.  */
+  setup_sprint_device (device, drive, partition);
+  grub_sprintf (cmd_arg, "%s %s", stage1_5, device);
+
+  /* Notify what will be run.  */
+  grub_printf (" Running \"embed %s\"... ", cmd_arg);
+
+  embed_func (cmd_arg, flags);
+  if (! errnum)
     {
-      int ret;
-      
-      grub_printf (" Checking if \"%s\" exists... ", file);
-      ret = grub_open (file);
-      if (ret)
+      /* Construct the blocklist representation.  */
+      grub_sprintf (buffer, "%s%s", device, embed_info);
+      grub_printf ("succeeded\n");
+      return 1;
+    }
+  else
+    {
+      grub_printf ("failed (this is not fatal)\n");
+      return 0;
+    }
+}
+
+/* Install GRUB into the target DATA with the images in SETUP_IMAGES,
+   and return the status of the target.  */
+static int
+setup_install (void *data)
+{
+  struct setup_target *target = data;
+  char stage2[64];
+  char config_filename[64];
+  char real_config_filename[64];
+  char cmd_arg[256];
+  char device[16];
+
+  errnum = ERR_NONE;
+  grub_strcpy (stage2, setup_images.stage2);
+  grub_strcpy (config_filename, setup_images.config_filename);
+  *real_config_filename = 0;
+
+  /* Without a Stage 1.5 in the target itself, "install" patches the
+     blocklist in the Stage 2, which all the targets share, so leave
+     that to the shell.  */
+  if (setup_images.in_job && ! *setup_images.stage1_5)
+    return SETUP_DEFERRED;
+
+  if (*setup_images.stage1_5)
+    {
+      if (setup_embed (setup_images.stage1_5,
+		       target->drive, target->partition, setup_images.flags)
+	  || (! setup_images.in_job
+	      && setup_embed (setup_images.stage1_5,
+			      setup_images.drive, setup_images.partition,
+			      setup_images.flags)))
 	{
-	  grub_close ();
-	  grub_printf ("yes\n");
+	  grub_strcpy (real_config_filename, config_filename);
+	  setup_sprint_device (device,
+			       setup_images.drive, setup_images.partition);
+	  grub_sprintf (config_filename, "%s%s", device, stage2);
+	  grub_strcpy (stage2, (char *) RAW_ADDR (0x100000));
 	}
-      else
-	grub_printf ("no\n");
+      else if (setup_images.in_job)
+	return SETUP_DEFERRED;
 
-      return ret;
+      errnum = 0;
     }
-  
-  /* Construct a device name in DEVICE.  */
-  void sprint_device (int drive, int partition)
+
+  /* Construct a string that is used by the command "install" as its
+     arguments.  */
+  setup_sprint_device (device, target->drive, target->partition);
+
+#if 1
+  /* Don't embed a drive number unnecessarily.  */
+  grub_sprintf (cmd_arg, "%s%s%s%s %s%s %s p %s %s",
+		setup_images.is_force_lba? "--force-lba " : "",
+		setup_images.stage2_arg? setup_images.stage2_arg : "",
+		setup_images.stage2_arg? " " : "",
+		setup_images.stage1,
+		(target->drive != setup_images.drive) ? "d " : "",
+		device,
+		stage2,
+		config_filename,
+		real_config_filename);
+#else /* NOT USED */
+  /* This code was used, because we belived some BIOSes had a problem
+     that they didn't pass a booting drive correctly. It turned out,
+     however, stage1 could trash a booting drive when checking LBA support,
+     because some BIOSes modified the register %dx in INT 13H, AH=48H.
+     So it becamed unclear whether GRUB should use a pre-defined booting
+     drive or not. If the problem still exists, it would be necessary to
+     switch back to this code.  */
+  grub_sprintf (cmd_arg, "%s%s%s%s d %s %s p %s %s",
+		setup_images.is_force_lba? "--force-lba " : "",
+		setup_images.stage2_arg? setup_images.stage2_arg : "",
+		setup_images.stage2_arg? " " : "",
+		setup_images.stage1,
+		device,
+		stage2,
+		config_filename,
+		real_config_filename);
+#endif /* NOT USED */
+
+  /* Notify what will be run.  */
+  grub_printf (" Running \"install %s\"... ", cmd_arg);
+
+  /* Make sure that SAVED_DRIVE and SAVED_PARTITION are identical
+     with the drive and the partition of the images.  */
+  saved_drive = setup_images.drive;
+  saved_partition = setup_images.partition;
+
+  /* Run the command.  */
+  install_keep_stage2 = setup_images.in_job;
+  if (! install_func (cmd_arg, setup_images.flags))
     {
-      grub_sprintf (device, "(%cd%d",
-		    (drive & 0x80) ? 'h' : 'f',
-		    drive & ~0x80);
-      if ((partition & 0xFF0000) != 0xFF0000)
-	{
-	  char tmp[16];
-	  grub_sprintf (tmp, ",%d", (partition >> 16) & 0xFF);
-	  grub_strncat (device, tmp, 16);
-	}
-      if ((partition & 0x00FF00) != 0x00FF00)
+      if (*real_config_filename)
+	setup_images.stage2_patched = 1;
+
+      grub_printf ("succeeded\nDone.\n");
+    }
+  else
+    grub_printf ("failed\n");
+  install_keep_stage2 = 0;
+
+  return errnum;
+}
+
+#ifdef GRUB_UTIL
+/* Return true if GRUB reads the file FILE the same as the OS reads the
+   file PATH.  */
+static int
+setup_compare_file (char *file, char *path)
+{
+  char *buffer = (char *) RAW_ADDR (0x100000);
+  char *os_buffer = buffer + 0x1000;
+  FILE *fp;
+  int len = -1;
+
+  fp = fopen (path, "r");
+  if (! fp)
+    return 0;
+
+  if (grub_open (file))
+    {
+      while ((len = grub_read (buffer, 0x1000)) > 0)
+	if ((int) fread (os_buffer, 1, len, fp) != len
+	    || grub_memcmp (buffer, os_buffer, len) != 0)
+	  break;
+
+      /* Both must end at the same place.  */
+      if (len == 0 && (errnum || fgetc (fp) != EOF))
+	len = -1;
+
+      grub_close ();
+    }
+
+  fclose (fp);
+  errnum = ERR_NONE;
+  return len == 0;
+}
+
+/* Make sure that GRUB reads the image FILE the same as the OS reads the
+   file of the same name in the directory DIR. As the OS may not have
+   written it to the disk yet, try a few times.  */
+static int
+setup_verify_file (char *file, char *dir)
+{
+  char path[256];
+  char *name = file + grub_strlen (file);
+  int count;
+
+  while (name > file && name[-1] != '/')
+    name--;
+
+  snprintf (path, sizeof (path), "%s/%s", dir, name);
+  grub_printf (" Checking if \"%s\" is read correctly... ", file);
+
+  for (count = 5; count > 0; count--)
+    {
+      if (setup_compare_file (file, path))
 	{
-	  char tmp[16];
-	  grub_sprintf (tmp, ",%c", 'a' + ((partition >> 8) & 0xFF));
-	  grub_strncat (device, tmp, 16);
+	  grub_printf ("yes\n");
+	  return 1;
 	}
-      grub_strncat (device, ")", 16);
+
+      sync ();
+      sleep (1);
+      /* Read the disk again, metadata included.  */
+      buf_drive = -1;
+      dentry_cache_flush ();
+#ifdef FSYS_EXT2FS
+      ext2fs_cache_reset ();
+#endif
     }
-  
-  int embed_stage1_5 (char *stage1_5, int drive, int partition)
+
+  grub_printf ("no\n");
+  errnum = ERR_READ;
+  return 0;
+}
+
+/* Install GRUB into the pending targets of the first NTARGETS in
+   SETUP_TARGETS, running at most JOBS jobs at a time but never two
+   on the same drive.  */
+static void
+setup_run_jobs (int ntargets, int jobs)
+{
+  int running = 0;
+  int pid, status;
+  int i, j;
+
+  setup_images.in_job = 1;
+
+  while (1)
     {
-      /* We install GRUB into the MBR, so try to embed the
-	 Stage 1.5 in the sectors right after the MBR.  */
-      sprint_device (drive, partition);
-      grub_sprintf (cmd_arg, "%s %s", stage1_5, device);
-	      
-      /* Notify what will be run.  */
-      grub_printf (" Running \"embed %s\"... ", cmd_arg);
-      
-      embed_func (cmd_arg, flags);
-      if (! errnum)
+      for (i = 0; i < ntargets && running < jobs; i++)
 	{
-	  /* Construct the blocklist representation.  */
-	  grub_sprintf (buffer, "%s%s", device, embed_info);
-	  grub_printf ("succeeded\n");
-	  return 1;
+	  if (setup_targets[i].status != SETUP_PENDING)
+	    continue;
+
+	  for (j = 0; j < ntargets; j++)
+	    if (setup_targets[j].status == SETUP_RUNNING
+		&& setup_targets[j].drive == setup_targets[i].drive)
+	      break;
+
+	  if (j < ntargets)
+	    continue;
+
+	  setup_targets[i].pid = job_start (setup_install, &setup_targets[i]);
+	  if (setup_targets[i].pid <= 0)
+	    {
+	      /* Leave the rest to the shell.  */
+	      jobs = running;
+	      break;
+	    }
+
+	  setup_targets[i].status = SETUP_RUNNING;
+	  running++;
 	}
-      else
+
+      if (! running)
+	break;
+
+      pid = job_wait (&status);
+      if (! pid)
 	{
-	  grub_printf ("failed (this is not fatal)\n");
-	  return 0;
+	  for (i = 0; i < ntargets; i++)
+	    if (setup_targets[i].status == SETUP_RUNNING)
+	      setup_targets[i].status = SETUP_DEFERRED;
+	  break;
 	}
+
+      for (i = 0; i < ntargets; i++)
+	if (setup_targets[i].status == SETUP_RUNNING
+	    && setup_targets[i].pid == pid)
+	  {
+	    /* A job killed by a signal did not finish the target.  */
+	    setup_targets[i].status = (status < 0) ? SETUP_DEFERRED : status;
+	    running--;
+	    break;
+	  }
     }
-	  
+
+  /* The jobs wrote to the disks behind our back.  */
+  buf_drive = -1;
+  setup_images.in_job = 0;
+}
+#endif /* GRUB_UTIL */
+
+static int
+setup_func (char *arg, int flags)
+{
+  /* Point to the string of the drive/parition where the GRUB images
+     reside.  */
+  char *image_ptr = 0;
+  unsigned long tmp_drive, tmp_partition;
+  int ntargets = 0;
+  int i;
+  char *prefix = 0;
+#ifdef GRUB_UTIL
+  char *verify_dir = 0;
+  int jobs = 1;
+#endif /* GRUB_UTIL */
+
   struct stage1_5_map {
     char *fsys;
     char *name;
@@ -4311,12 +5081,18 @@ setup_func (char *arg, int flags)
   tmp_drive = saved_drive;
   tmp_partition = saved_partition;
 
+  setup_images.is_force_lba = 0;
+  setup_images.stage2_arg = 0;
+  setup_images.flags = flags;
+  setup_images.in_job = 0;
+  setup_images.stage2_patched = 0;
+  
   /* Check if the user specifies --force-lba.  */
   while (1)
     {
       if (grub_memcmp ("--force-lba", arg, sizeof ("--force-lba") - 1) == 0)
 	{
-	  is_force_lba = 1;
+	  setup_images.is_force_lba = 1;
 	  arg = skip_to (0, arg);
 	}
       else if (grub_memcmp ("--prefix=", arg, sizeof ("--prefix=") - 1) == 0)
@@ -4325,31 +5101,78 @@ setup_func (char *arg, int flags)
 	  arg = skip_to (0, arg);
 	  nul_terminate (prefix);
 	}
+      else if (grub_memcmp ("--image=", arg, sizeof ("--image=") - 1) == 0)
+	{
+	  image_ptr = arg + sizeof ("--image=") - 1;
+	  arg = skip_to (0, arg);
+	}
 #ifdef GRUB_UTIL
       else if (grub_memcmp ("--stage2=", arg, sizeof ("--stage2=") - 1) == 0)
 	{
-	  stage2_arg = arg;
+	  setup_images.stage2_arg = arg;
+	  arg = skip_to (0, arg);
+	  nul_terminate (setup_images.stage2_arg);
+	}
+      else if (grub_memcmp ("--jobs=", arg, sizeof ("--jobs=") - 1) == 0)
+	{
+	  char *p = arg + sizeof ("--jobs=") - 1;
+
+	  if (! safe_parse_maxint (&p, &jobs))
+	    return 1;
+
+	  arg = skip_to (0, arg);
+	}
+      else if (grub_memcmp ("--verify=", arg, sizeof ("--verify=") - 1) == 0)
+	{
+	  verify_dir = arg + sizeof ("--verify=") - 1;
 	  arg = skip_to (0, arg);
-	  nul_terminate (stage2_arg);
+	  nul_terminate (verify_dir);
 	}
 #endif /* GRUB_UTIL */
       else
 	break;
     }
-  
-  install_ptr = arg;
-  image_ptr = skip_to (0, install_ptr);
 
-  /* Make sure that INSTALL_PTR is valid.  */
-  set_device (install_ptr);
-  if (errnum)
-    return 1;
+  /* Get the install devices. If --image is not specified, the second
+     argument, if any, is the device of the images.  */
+  while (*arg)
+    {
+      char *next = skip_to (0, arg);
+
+      if (! image_ptr && ntargets == 1)
+	{
+	  image_ptr = arg;
+	  break;
+	}
+
+      if (ntargets == SETUP_MAX_TARGETS)
+	{
+	  errnum = ERR_BAD_ARGUMENT;
+	  return 1;
+	}
+
+      /* Make sure that the install device is valid.  */
+      set_device (arg);
+      if (errnum)
+	return 1;
+
+      nul_terminate (arg);
+      setup_targets[ntargets].name = arg;
+      setup_targets[ntargets].drive = current_drive;
+      setup_targets[ntargets].partition = current_partition;
+      setup_targets[ntargets].status = SETUP_PENDING;
+      ntargets++;
+      arg = next;
+    }
+
+  if (! ntargets)
+    {
+      errnum = ERR_BAD_ARGUMENT;
+      return 1;
+    }
 
-  installed_drive = current_drive;
-  installed_partition = current_partition;
-  
   /* Mount the drive pointed by IMAGE_PTR.  */
-  if (*image_ptr)
+  if (image_ptr)
     {
       /* If the drive/partition where the images reside is specified,
 	 get the drive and the partition.  */
@@ -4364,8 +5187,8 @@ setup_func (char *arg, int flags)
       current_partition = saved_partition;
     }
 
-  image_drive = saved_drive = current_drive;
-  image_partition = saved_partition = current_partition;
+  setup_images.drive = saved_drive = current_drive;
+  setup_images.partition = saved_partition = current_partition;
 
   /* Open it.  */
   if (! open_device ())
@@ -4378,35 +5201,34 @@ setup_func (char *arg, int flags)
   if (! prefix)
     {
       prefix = "/boot/grub";
-      grub_sprintf (stage1, "%s%s", prefix, "/stage1");
-      if (! check_file (stage1))
+      grub_sprintf (setup_images.stage1, "%s%s", prefix, "/stage1");
+      if (! setup_check_file (setup_images.stage1))
 	{
 	  errnum = ERR_NONE;
 	  prefix = "/grub";
-	  grub_sprintf (stage1, "%s%s", prefix, "/stage1");
-	  if (! check_file (stage1))
+	  grub_sprintf (setup_images.stage1, "%s%s", prefix, "/stage1");
+	  if (! setup_check_file (setup_images.stage1))
 	    goto fail;
 	}
     }
   else
     {
-      grub_sprintf (stage1, "%s%s", prefix, "/stage1");
-      if (! check_file (stage1))
+      grub_sprintf (setup_images.stage1, "%s%s", prefix, "/stage1");
+      if (! setup_check_file (setup_images.stage1))
 	goto fail;
     }
 
   /* The prefix was determined.  */
-  grub_sprintf (stage2, "%s%s", prefix, "/stage2");
-  grub_sprintf (config_filename, "%s%s", prefix, "/grub.conf");
-  *real_config_filename = 0;
+  grub_sprintf (setup_images.stage2, "%s%s", prefix, "/stage2");
+  grub_sprintf (setup_images.config_filename, "%s%s", prefix, "/grub.conf");
+  *setup_images.stage1_5 = 0;
 
   /* Check if stage2 exists.  */
-  if (! check_file (stage2))
+  if (! setup_check_file (setup_images.stage2))
     goto fail;
 
   {
     char *fsys = fsys_table[fsys_type].name;
-    int i;
     int size = sizeof (stage1_5_map) / sizeof (stage1_5_map[0]);
     
     /* Iterate finding the same filesystem name as FSYS.  */
@@ -4414,75 +5236,65 @@ setup_func (char *arg, int flags)
       if (grub_strcmp (fsys, stage1_5_map[i].fsys) == 0)
 	{
 	  /* OK, check if the Stage 1.5 exists.  */
-	  char stage1_5[64];
-	  
-	  grub_sprintf (stage1_5, "%s%s", prefix, stage1_5_map[i].name);
-	  if (check_file (stage1_5))
-	    {
-	      if (embed_stage1_5 (stage1_5, 
-				    installed_drive, installed_partition)
-		  || embed_stage1_5 (stage1_5, 
-				     image_drive, image_partition))
-		{
-		  grub_strcpy (real_config_filename, config_filename);
-		  sprint_device (image_drive, image_partition);
-		  grub_sprintf (config_filename, "%s%s", device, stage2);
-		  grub_strcpy (stage2, buffer);
-		}
-	    }
+	  grub_sprintf (setup_images.stage1_5, "%s%s",
+			prefix, stage1_5_map[i].name);
+	  if (! setup_check_file (setup_images.stage1_5))
+	    *setup_images.stage1_5 = 0;
+
 	  errnum = 0;
 	  break;
 	}
   }
 
-  /* Construct a string that is used by the command "install" as its
-     arguments.  */
-  sprint_device (installed_drive, installed_partition);
-  
-#if 1
-  /* Don't embed a drive number unnecessarily.  */
-  grub_sprintf (cmd_arg, "%s%s%s%s %s%s %s p %s %s",
-		is_force_lba? "--force-lba " : "",
-		stage2_arg? stage2_arg : "",
-		stage2_arg? " " : "",
-		stage1,
-		(installed_drive != image_drive) ? "d " : "",
-		device,
-		stage2,
-		config_filename,
-		real_config_filename);
-#else /* NOT USED */
-  /* This code was used, because we belived some BIOSes had a problem
-     that they didn't pass a booting drive correctly. It turned out,
-     however, stage1 could trash a booting drive when checking LBA support,
-     because some BIOSes modified the register %dx in INT 13H, AH=48H.
-     So it becamed unclear whether GRUB should use a pre-defined booting
-     drive or not. If the problem still exists, it would be necessary to
-     switch back to this code.  */
-  grub_sprintf (cmd_arg, "%s%s%s%s d %s %s p %s %s",
-		is_force_lba? "--force-lba " : "",
-		stage2_arg? stage2_arg : "",
-		stage2_arg? " " : "",
-		stage1,
-		device,
-		stage2,
-		config_filename,
-		real_config_filename);
-#endif /* NOT USED */
-  
-  /* Notify what will be run.  */
-  grub_printf (" Running \"install %s\"... ", cmd_arg);
+#ifdef GRUB_UTIL
+  /* Make sure that GRUB reads the same images as the OS, before
+     writing anything.  */
+  if (verify_dir
+      && (! setup_verify_file (setup_images.stage1, verify_dir)
+	  || ! setup_verify_file (setup_images.stage2, verify_dir)
+	  || (*setup_images.stage1_5
+	      && ! setup_verify_file (setup_images.stage1_5, verify_dir))))
+    goto fail;
 
-  /* Make sure that SAVED_DRIVE and SAVED_PARTITION are identical
-     with IMAGE_DRIVE and IMAGE_PARTITION, respectively.  */
-  saved_drive = image_drive;
-  saved_partition = image_partition;
-  
-  /* Run the command.  */
-  if (! install_func (cmd_arg, flags))
-    grub_printf ("succeeded\nDone.\n");
-  else
-    grub_printf ("failed\n");
+  /* Install GRUB into independent targets at the same time.  Only a
+     Stage 1.5 in the target makes a target independent, and the first
+     target installed patches the Stage 2 for it, so do that one here.
+     The jobs then write to their own drives only.  */
+  if (jobs > 1 && ntargets > 1 && ! use_curses && *setup_images.stage1_5)
+    {
+      setup_targets[0].status = setup_install (&setup_targets[0]);
+      if (setup_images.stage2_patched)
+	setup_run_jobs (ntargets, jobs);
+    }
+#endif /* GRUB_UTIL */
+
+  /* Install GRUB into the rest one by one.  */
+  for (i = 0; i < ntargets; i++)
+    if (setup_targets[i].status == SETUP_PENDING
+	|| setup_targets[i].status == SETUP_DEFERRED)
+      setup_targets[i].status = setup_install (&setup_targets[i]);
+
+  /* Write a summary if there are several targets. Clear ERRNUM first,
+     or grub_printf cannot print the numbers.  */
+  errnum = ERR_NONE;
+  if (ntargets > 1)
+    {
+      grub_printf (" Summary:\n");
+      for (i = 0; i < ntargets; i++)
+	if (setup_targets[i].status == ERR_NONE)
+	  grub_printf ("  %s: succeeded\n", setup_targets[i].name);
+	else
+	  grub_printf ("  %s: failed (Error %d: %s)\n",
+		       setup_targets[i].name, setup_targets[i].status,
+		       err_list[setup_targets[i].status]);
+    }
+
+  for (i = 0; i < ntargets; i++)
+    if (setup_targets[i].status != ERR_NONE)
+      {
+	errnum = setup_targets[i].status;
+	break;
+      }
 
  fail:
   saved_drive = tmp_drive;
@@ -4495,17 +5307,22 @@ static struct builtin builtin_setup =
   "setup",
   setup_func,
   BUILTIN_CMDLINE | BUILTIN_HELP_LIST,
-  "setup [--prefix=DIR] [--stage2=STAGE2_FILE] [--force-lba] INSTALL_DEVICE [IMAGE_DEVICE]",
+  "setup [--prefix=DIR] [--stage2=STAGE2_FILE] [--force-lba] [--verify=DIR] [--jobs=N] [--image=IMAGE_DEVICE] INSTALL_DEVICE... | INSTALL_DEVICE [IMAGE_DEVICE]",
   "Set up the installation of GRUB automatically. This command uses"
   " the more flexible command \"install\" in the backend and installs"
   " GRUB into the device INSTALL_DEVICE. If IMAGE_DEVICE is specified,"
   " then find the GRUB images in the device IMAGE_DEVICE, otherwise"
   " use the current \"root device\", which can be set by the command"
-  " \"root\". If you know that your BIOS should support LBA but GRUB"
-  " doesn't work in LBA mode, specify the option `--force-lba'."
+  " \"root\". If the option `--image' is given, GRUB is installed into"
+  " each of the devices INSTALL_DEVICE in turn, and a summary is"
+  " printed at the end. If you know that your BIOS should support LBA"
+  " but GRUB doesn't work in LBA mode, specify the option `--force-lba'."
   " If you install GRUB under the grub shell and you cannot unmount the"
   " partition where GRUB images reside, specify the option `--stage2'"
-  " to tell GRUB the file name under your OS."
+  " to tell GRUB the file name under your OS. In the grub shell, the"
+  " option `--verify' checks first that GRUB reads the images the same"
+  " as they are in the directory DIR under your OS, and the option"
+  " `--jobs' installs GRUB into up to N drives at the same time."
 };
 #endif /* ! PLATFORM_EFI */
 
@@ -4679,6 +5496,8 @@ terminal_func (char *arg, int flags)
 	      if (to > 0)
 		to--;
 	    }
+
+	  grub_idle ();
 	}
     }
 
@@ -5315,11 +6134,15 @@ struct builtin *builtin_table[] =
 #endif
   &builtin_fstest,
   &builtin_geometry,
+#ifndef NO_DECOMPRESSION
+  &builtin_gunziptest,
+#endif
   &builtin_halt,
   &builtin_help,
   &builtin_hiddenmenu,
   &builtin_hide,
 #ifdef SUPPORT_NETBOOT
+  &builtin_httpserver,
   &builtin_ifconfig,
 #endif /* SUPPORT_NETBOOT */
 #ifndef PLATFORM_EFI
@@ -5330,8 +6153,11 @@ struct builtin *builtin_table[] =
   &builtin_install,
   &builtin_ioprobe,
 #endif
+  &builtin_iostat,
   &builtin_kernel,
+  &builtin_lazymenu,
   &builtin_lock,
+  &builtin_loopback,
   &builtin_makeactive,
 #ifndef PLATFORM_EFI
   &builtin_map,
@@ -5339,22 +6165,31 @@ struct builtin *builtin_table[] =
 #ifdef USE_MD5_PASSWORDS
   &builtin_md5crypt,
 #endif /* USE_MD5_PASSWORDS */
+  &builtin_mdscan,
 #ifndef PLATFORM_EFI
   &builtin_module,
   &builtin_modulenounzip,
+#endif
+#if defined(SUPPORT_NETBOOT) || defined(PLATFORM_EFI)
+  &builtin_mtftp,
 #endif
   &builtin_pager,
   &builtin_partnew,
   &builtin_parttype,
   &builtin_password,
   &builtin_pause,
+#ifdef PLATFORM_EFI
+  &builtin_profile,
+#endif /* PLATFORM_EFI */
 #if defined(GRUB_UTIL) || defined(PLATFORM_EFI)
   &builtin_quit,
 #endif /* defined(GRUB_UTIL) || defined(PLATFORM_EFI) */
+  &builtin_ramdisk,
 #ifdef SUPPORT_NETBOOT
   &builtin_rarp,
 #endif /* SUPPORT_NETBOOT */
   &builtin_read,
+  &builtin_readahead,
   &builtin_reboot,
   &builtin_root,
   &builtin_rootnoverify,
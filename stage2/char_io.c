@@ -477,6 +477,18 @@ add_history (const char *cmdline, int no)
     num_history++;
 }
 
+/* Wait for a keypress at a prompt, letting the tasks run meanwhile.
+   Only the prompts do so, as getkey is also called in the middle of a
+   command, for instance by the pager.  */
+static int
+prompt_getkey (void)
+{
+  while (checkkey () < 0)
+    task_idle ();
+
+  return getkey ();
+}
+
 static int
 real_get_cmdline (char *prompt, char *cmdline, int maxlen,
 		  int echo_char, int readline)
@@ -765,7 +777,8 @@ real_get_cmdline (char *prompt, char *cmdline, int maxlen,
 
   cl_init ();
 
-  while ((c = ASCII_CHAR (getkey ())) != '\n' && c != '\r')
+  while ((c = ASCII_CHAR (readline ? prompt_getkey () : getkey ()))
+	 != '\n' && c != '\r')
     {
       /* If READLINE is non-zero, handle readline-like key bindings.  */
       if (readline)
@@ -1016,7 +1029,8 @@ get_cmdline (char *prompt, char *cmdline, int maxlen,
       grub_printf ("%s", prompt);
 
       /* Gather characters until a newline is gotten.  */
-      while ((c = ASCII_CHAR (getkey ())) != '\n' && c != '\r')
+      while ((c = ASCII_CHAR (readline ? prompt_getkey () : getkey ()))
+	     != '\n' && c != '\r')
 	{
 	  /* Return immediately if ESC is pressed.  */
 	  if (c == 27)
@@ -1202,6 +1216,10 @@ grub_strcmp (const char *s1, const char *s2)
 int
 getkey (void)
 {
+  /* Some terminals busy-wait in getkey, so sleep between polls.  */
+  while (current_term->checkkey () < 0)
+    grub_idle ();
+
   return current_term->getkey ();
 }
 
@@ -39,6 +39,10 @@
 /* instrumentation variables */
 void (*disk_read_hook) (int, int, int) = NULL;
 void (*disk_read_func) (int, int, int) = NULL;
+#ifndef STAGE1_5
+/* Only tell DISK_READ_FUNC where the data is, without reading it.  */
+int disk_read_map_only;
+#endif
 
 #ifndef STAGE1_5
 int print_possibilities;
@@ -57,13 +61,20 @@ struct fsys_entry fsys_table[NUM_FSYS + 1] =
   {"efitftp", efi_tftp_mount, efi_tftp_read, efi_tftp_dir, efi_tftp_close, 0},
 # endif
 # ifdef FSYS_TFTP
+  /* HTTP mounts only when selected, so it must be tried before TFTP.  */
+  {"http", http_mount, http_read, http_dir, http_close, 0},
   {"tftp", tftp_mount, tftp_read, tftp_dir, tftp_close, 0},
 # endif
 # ifdef FSYS_FAT
   {"fat", fat_mount, fat_read, fat_dir, 0, 0},
 # endif
 # ifdef FSYS_EXT2FS
+#  ifdef STAGE1_5
   {"ext2fs", ext2fs_mount, ext2fs_read, ext2fs_dir, 0, 0},
+#  else
+  {"ext2fs", ext2fs_mount, ext2fs_read, ext2fs_dir, 0, 0,
+   ext2fs_ident, ext2fs_reopen},
+#  endif
 # endif
 # ifdef FSYS_MINIX
   {"minix", minix_mount, minix_read, minix_dir, 0, 0},
@@ -134,6 +145,7 @@ int buf_drive = -1;
 int buf_track;
 struct geometry buf_geom;
 
+
 /* filesystem common variables */
 int filepos;
 int filemax;
@@ -147,6 +159,143 @@ grub_log2 (unsigned int word)
   return word;
 }
 
+#ifndef STAGE1_5
+/* Sequential read-ahead.  When a read misses the buffer exactly where
+   the previous disk read ended, rawread reads a whole window from
+   there instead of a track, and doubles the window for the next time
+   up to readahead_max bytes.  A miss anywhere else shrinks the window
+   back to RA_MIN_WINDOW.  A buffered window is marked by buf_track
+   being RA_TRACK, so whatever throws the track buffer away throws the
+   window away too.  Without LBA the BIOS cannot read across tracks,
+   so those drives keep to whole tracks.  (The grub shell keeps a file
+   descriptor in the geometry flags, and can read anything.)  */
+# define RA_TRACK	-2
+# define RA_MIN_WINDOW	0x10000
+# ifdef PLATFORM_EFI
+#  define RA_DEFAULT_MAX	0x400000
+# else
+/* The BIOS needs the buffer in low memory, where only the track
+   buffer is free.  */
+#  define RA_DEFAULT_MAX	BUFFERLEN
+# endif
+
+int readahead_max = RA_DEFAULT_MAX;
+int readahead_window = RA_MIN_WINDOW;
+struct readahead_stats readahead_stats;
+
+static char *ra_buf;
+static int ra_start, ra_len;
+static int ra_next = -1;
+
+/* Read NSEC sectors from SECTOR on DRIVE into SEGMENT, counting the
+   read in the I/O statistics of DRIVE.  */
+static int
+read_sectors (int drive, int sector, int nsec, int segment)
+{
+  struct iostat *st = iostat_get (IOSTAT_DISK, drive);
+  unsigned long long start = iostat_clock ();
+  int err;
+
+  if (st)
+    st->misses++;
+
+  err = biosdisk (BIOSDISK_READ, drive, &buf_geom, sector, nsec, segment);
+  iostat_done (st, start, nsec, nsec * buf_geom.sector_size, err);
+  return err;
+}
+
+/* Count a read of DRIVE served from the track buffer or the read-ahead
+   window.  */
+static void
+count_hit (int drive)
+{
+  struct iostat *st = iostat_get (IOSTAT_DISK, drive);
+
+  if (st)
+    st->hits++;
+}
+
+/* Return nonzero if SECTOR is in the read-ahead window, reading a new
+   window first if SECTOR continues the stream.  Zero means the track
+   buffer should be used instead.  */
+static int
+ra_lookup (int drive, int sector)
+{
+  int bits = grub_log2 (buf_geom.sector_size);
+  int buflen = BUFFERLEN, window, len;
+  char *buf = (char *) BUFFERADDR;
+
+  if (buf_track == RA_TRACK
+      && sector >= ra_start && sector < ra_start + ra_len)
+    {
+      readahead_stats.hits++;
+      count_hit (drive);
+      return 1;
+    }
+
+  if (sector != ra_next || readahead_max <= 0 || sector == 0
+#ifndef GRUB_UTIL
+      || ! (buf_geom.flags & BIOSDISK_FLAG_LBA_EXTENSION)
+#endif
+      )
+    {
+      if (readahead_window != RA_MIN_WINDOW && sector != ra_next)
+	{
+	  readahead_window = RA_MIN_WINDOW;
+	  readahead_stats.collapses++;
+	}
+      return 0;
+    }
+
+#ifdef PLATFORM_EFI
+  {
+    char *p = grub_efidisk_readahead_buffer (readahead_max);
+
+    if (p)
+      {
+	buf = p;
+	buflen = readahead_max;
+      }
+  }
+#endif
+
+  window = readahead_window;
+  if (window > readahead_max)
+    window = readahead_max;
+  if (window > buflen)
+    window = buflen;
+
+  len = window >> bits;
+  if (len > buf_geom.total_sectors - sector)
+    len = buf_geom.total_sectors - sector;
+  if (len <= 0)
+    return 0;
+
+  if (read_sectors (drive, sector, len, (int) ((unsigned long) buf >> 4)))
+    {
+      buf_track = -1;
+      ra_next = -1;
+      return 0;
+    }
+
+  ra_buf = buf;
+  ra_start = sector;
+  ra_len = len;
+  ra_next = sector + len;
+  buf_track = RA_TRACK;
+
+  readahead_stats.fills++;
+  readahead_stats.sectors += len;
+  if (readahead_window < readahead_max)
+    readahead_window <<= 1;
+
+  return 1;
+}
+#else /* STAGE1_5 */
+# define read_sectors(drive, sector, nsec, segment) \
+  biosdisk (BIOSDISK_READ, drive, &buf_geom, sector, nsec, segment)
+#endif /* STAGE1_5 */
+
 int
 rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 {
@@ -193,6 +342,24 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
       else
 	sectors_per_vtrack = buf_geom.sectors;
       
+#ifndef STAGE1_5
+      if (disk_read_func && disk_read_map_only)
+	{
+	  num_sect = slen;
+	  bufaddr = 0;
+	  goto buffered;
+	}
+
+      /* Is it in the read-ahead window, or does it continue it?  */
+      if (ra_lookup (drive, sector))
+	{
+	  num_sect = ra_start + ra_len - sector;
+	  bufaddr = (ra_buf + ((sector - ra_start) << sector_size_bits)
+		     + byte_offset);
+	  goto buffered;
+	}
+#endif /* ! STAGE1_5 */
+
       /* Get the first sector of track.  */
       soff = sector % sectors_per_vtrack;
       track = sector - soff;
@@ -216,8 +383,7 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 	      bufaddr = (char *) BUFFERADDR + byte_offset;
 	    }
 
-	  bios_err = biosdisk (BIOSDISK_READ, drive, &buf_geom,
-			       read_start, read_len, BUFFERSEG);
+	  bios_err = read_sectors (drive, read_start, read_len, BUFFERSEG);
 	  if (bios_err)
 	    {
 	      buf_track = -1;
@@ -230,9 +396,14 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 		   *  If there was an error, try to load only the
 		   *  required sector(s) rather than failing completely.
 		   */
+#ifndef STAGE1_5
+		  struct iostat *st = iostat_get (IOSTAT_DISK, drive);
+
+		  if (st && slen <= num_sect)
+		    st->retries++;
+#endif
 		  if (slen > num_sect
-		      || biosdisk (BIOSDISK_READ, drive, &buf_geom,
-				   sector, slen, BUFFERSEG))
+		      || read_sectors (drive, sector, slen, BUFFERSEG))
 		    errnum = ERR_READ;
 
 		  bufaddr = (char *) BUFFERADDR + byte_offset;
@@ -241,6 +412,10 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 	  else
 	    buf_track = track;
 
+#ifndef STAGE1_5
+	  ra_next = read_start + read_len;
+#endif
+
 	  if ((buf_track == 0 || sector == 0)
 	      && (PC_SLICE_TYPE (BUFFERADDR, 0) == PC_SLICE_TYPE_EZD
 		  || PC_SLICE_TYPE (BUFFERADDR, 1) == PC_SLICE_TYPE_EZD
@@ -263,7 +438,12 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 		}
 	    }
 	}
-	  
+#ifndef STAGE1_5
+      else
+	count_hit (drive);
+
+    buffered:
+#endif
       if (size > ((num_sect << sector_size_bits) - byte_offset))
 	size = (num_sect << sector_size_bits) - byte_offset;
 
@@ -289,7 +469,11 @@ rawread (int drive, int sector, int byte_offset, int byte_len, char *buf)
 	    }
 	}
 
-      grub_memmove (buf, bufaddr, size);
+#ifndef STAGE1_5
+      /* Nothing was read when only mapping.  */
+      if (bufaddr)
+#endif
+	grub_memmove (buf, bufaddr, size);
 
       buf += size;
       byte_len -= size;
@@ -340,35 +524,104 @@ devread (int sector, int byte_offset, int byte_len, char *buf)
 }
 
 #ifndef STAGE1_5
+/* Write SECTOR_COUNT sectors from BUF to DRIVE at SECTOR, in as few
+   calls to biosdisk as the drive takes.  Each piece is staged in the
+   track buffer, which is then kept as a read-ahead window holding what
+   was written, unless the window is elsewhere, in which case the
+   written sectors are copied into it.  Either way nothing cached goes
+   stale, and nothing has to be read again.  */
 int
-rawwrite (int drive, int sector, char *buf)
+rawwrite (int drive, int sector, int sector_count, char *buf)
 {
-  if (sector == 0)
+  int bits, max;
+
+  dentry_cache_flush ();
+
+  if (buf_drive != drive)
     {
-      if (biosdisk (BIOSDISK_READ, drive, &buf_geom, 0, 1, SCRATCHSEG))
+      if (get_diskinfo (drive, &buf_geom))
 	{
-	  errnum = ERR_WRITE;
+	  errnum = ERR_NO_DISK;
 	  return 0;
 	}
-
-      if (PC_SLICE_TYPE (SCRATCHADDR, 0) == PC_SLICE_TYPE_EZD
-	  || PC_SLICE_TYPE (SCRATCHADDR, 1) == PC_SLICE_TYPE_EZD
-	  || PC_SLICE_TYPE (SCRATCHADDR, 2) == PC_SLICE_TYPE_EZD
-	  || PC_SLICE_TYPE (SCRATCHADDR, 3) == PC_SLICE_TYPE_EZD)
-	sector = 1;
+      buf_drive = drive;
+      buf_track = -1;
     }
-  
-  memmove ((char *) SCRATCHADDR, buf, get_sector_size(drive));
-  if (biosdisk (BIOSDISK_WRITE, drive, &buf_geom,
-		sector, 1, SCRATCHSEG))
+
+  bits = grub_log2 (buf_geom.sector_size);
+  max = BUFFERLEN >> bits;
+
+  while (sector_count > 0)
     {
-      errnum = ERR_WRITE;
-      return 0;
-    }
+      int to = sector, len = sector_count;
+
+      if (len > max)
+	len = max;
 
-  if (sector - sector % buf_geom.sectors == buf_track)
-    /* Clear the cache.  */
-    buf_track = -1;
+#ifndef GRUB_UTIL
+      /* Without LBA the BIOS cannot write across tracks.  */
+      if (! (buf_geom.flags & BIOSDISK_FLAG_LBA_EXTENSION)
+	  && len > buf_geom.sectors - sector % buf_geom.sectors)
+	len = buf_geom.sectors - sector % buf_geom.sectors;
+#endif
+
+      if (sector == 0)
+	{
+	  /* An EZD disk map has sector 0 in sector 1.  */
+	  if (biosdisk (BIOSDISK_READ, drive, &buf_geom, 0, 1, SCRATCHSEG))
+	    {
+	      errnum = ERR_WRITE;
+	      return 0;
+	    }
+
+	  if (PC_SLICE_TYPE (SCRATCHADDR, 0) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (SCRATCHADDR, 1) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (SCRATCHADDR, 2) == PC_SLICE_TYPE_EZD
+	      || PC_SLICE_TYPE (SCRATCHADDR, 3) == PC_SLICE_TYPE_EZD)
+	    {
+	      to = 1;
+	      len = 1;
+	    }
+	}
+
+      if (buf_track == RA_TRACK && ra_buf != (char *) BUFFERADDR)
+	{
+	  /* Copy what overlaps the read-ahead window into it.  */
+	  int start = to > ra_start ? to : ra_start;
+	  int end = (to + len < ra_start + ra_len
+		     ? to + len : ra_start + ra_len);
+
+	  if (start < end)
+	    grub_memmove (ra_buf + ((start - ra_start) << bits),
+			  buf + ((start - to) << bits),
+			  (end - start) << bits);
+	}
+      else
+	{
+	  /* The track buffer is about to be overwritten.  */
+	  buf_track = -1;
+	}
+
+      grub_memmove ((char *) BUFFERADDR, buf, len << bits);
+      if (biosdisk (BIOSDISK_WRITE, drive, &buf_geom, to, len, BUFFERSEG))
+	{
+	  buf_track = -1;
+	  errnum = ERR_WRITE;
+	  return 0;
+	}
+
+      if (buf_track != RA_TRACK)
+	{
+	  ra_buf = (char *) BUFFERADDR;
+	  ra_start = to;
+	  ra_len = len;
+	  buf_track = RA_TRACK;
+	}
+
+      buf += len << bits;
+      sector += len;
+      sector_count -= len;
+    }
 
   return 1;
 }
@@ -388,19 +641,16 @@ devwrite (int sector, int sector_count, char *buf)
       ret = write_to_partition (device_map, current_drive, current_partition,
 				sector, sector_count, buf);
       if (ret != -1)
-	return ret;
+	{
+	  /* This went around the track buffer.  */
+	  buf_track = -1;
+	  dentry_cache_flush ();
+	  return ret;
+	}
     }
 #endif /* GRUB_UTIL && __linux__ */
-    int i;
-
-    for (i = 0; i < sector_count; i++)
-      {
-	if (! rawwrite (current_drive, part_start + sector + i,
-			buf + (i << get_sector_bits(current_drive))))
-	    return 0;
 
-      }
-    return 1;
+  return rawwrite (current_drive, part_start + sector, sector_count, buf);
 }
 
 static int
@@ -447,6 +697,29 @@ attempt_mount (void)
 
 
 #ifndef STAGE1_5
+/* Tell whether the sector MBR holds a partition table: the boot
+   signature, and entries which are active or not, one of them used.
+   The boot sector of a filesystem has code or messages there.  */
+int
+has_partition_table (char *mbr)
+{
+  int i, used = 0;
+
+  if (! PC_MBR_CHECK_SIG (mbr))
+    return 0;
+
+  for (i = 0; i < PC_SLICE_MAX; i++)
+    {
+      if (PC_SLICE_FLAG (mbr, i) != PC_SLICE_FLAG_NONE
+	  && PC_SLICE_FLAG (mbr, i) != PC_SLICE_FLAG_BOOTABLE)
+	return 0;
+      if (PC_SLICE_TYPE (mbr, i) != PC_SLICE_TYPE_NONE)
+	used = 1;
+    }
+
+  return used;
+}
+
 /* Turn on the active flag for the partition SAVED_PARTITION in the
    drive SAVED_DRIVE. If an error occurs, return zero, otherwise return
    non-zero.  */
@@ -493,7 +766,7 @@ make_saved_active (void)
 	  PC_SLICE_FLAG (mbr, part) = PC_SLICE_FLAG_BOOTABLE;
 
 	  /* Write back the MBR.  */
-	  if (! rawwrite (saved_drive, 0, mbr))
+	  if (! rawwrite (saved_drive, 0, 1, mbr))
 	    return 0;
 	}
     }
@@ -553,8 +826,7 @@ set_partition_hidden_flag (int hidden)
 	    PC_SLICE_TYPE (mbr, entry) &= ~PC_SLICE_TYPE_HIDDEN_FLAG;       
 	  
 	  /* Write back the MBR to the disk.  */
-	  buf_track = -1;
-	  if (! rawwrite (current_drive, offset, mbr))
+	  if (! rawwrite (current_drive, offset, 1, mbr))
 	    return 1;
 	  
 	  /* Succeed.  */
@@ -1092,14 +1364,20 @@ set_device (char *device)
 	  char ch = *device;
 #if defined(SUPPORT_NETBOOT) || defined(PLATFORM_EFI)
 	  if (*device == 'f' || *device == 'h'
+#ifndef STAGE1_5
+	      || *device == 'l' || *device == 'm' || *device == 'r'
+#endif
 	      || (*device == 'n' && network_ready)
 	      || (*device == 'c' && cdrom_drive != GRUB_INVALID_DRIVE))
 #else
 	  if (*device == 'f' || *device == 'h'
+#ifndef STAGE1_5
+	      || *device == 'l' || *device == 'm' || *device == 'r'
+#endif
 	      || (*device == 'c' && cdrom_drive != GRUB_INVALID_DRIVE))
 #endif /* SUPPORT_NETBOOT */
 	    {
-	      /* user has given '([fhn]', check for resp. add 'd' and
+	      /* user has given '([fhlmnr]', check for resp. add 'd' and
 		 let disk_choice handle what disks we have */
 	      if (!*(device + 1))
 		{
@@ -1114,6 +1392,9 @@ set_device (char *device)
 
 	  if ((*device == 'f'
 	       || *device == 'h'
+#ifndef STAGE1_5
+	       || *device == 'l' || *device == 'm' || *device == 'r'
+#endif
 #if defined(SUPPORT_NETBOOT) || defined(PLATFORM_EFI)
 	       || (*device == 'n' && network_ready)
 #endif
@@ -1129,6 +1410,10 @@ set_device (char *device)
 	    {
 	      if (ch == 'c' && cdrom_drive != GRUB_INVALID_DRIVE)
 		current_drive = cdrom_drive;
+#ifndef STAGE1_5
+	      else if (ch == 'r')
+		current_drive = rd_drive;
+#endif
 	      else
 		{
 		  safe_parse_maxint (&device, (int *) &current_drive);
@@ -1136,6 +1421,21 @@ set_device (char *device)
 		  disk_choice = 0;
 		  if (ch == 'h')
 		    current_drive += 0x80;
+#ifndef STAGE1_5
+		  else if (ch == 'm')
+		    {
+		      if (current_drive >= MD_MAX_ARRAYS)
+			errnum = ERR_DEV_VALUES;
+		      current_drive += MD_DRIVE;
+		    }
+		  else if (ch == 'l')
+		    {
+		      if (current_drive >= LD_MAX_DEVICES)
+			errnum = ERR_DEV_VALUES;
+		      else
+			current_drive = ld_drives[current_drive];
+		    }
+#endif
 		}
 	    }
 	}
@@ -1648,6 +1948,135 @@ print_completions (int is_filename, int is_completion)
 #endif /* STAGE1_5 */
 
 
+#ifndef STAGE1_5
+/* The path resolution cache.  An entry maps a file name on a mounted
+   filesystem either to the identity which the filesystem handed back
+   for it, so that the file can be reopened without walking the path
+   again, or to the fact that it does not exist.  Network drives are
+   left out, since the server side may change at any time, and so are
+   removable drives.  So is everything in the grub shell, where the OS
+   may create, remove or rename files behind its back.  The BIOS Stage 2
+   has little room below FSYS_BUF, so it keeps fewer entries.  */
+#ifdef PLATFORM_EFI
+# define DENTRY_CACHE_SIZE	64
+#else
+# define DENTRY_CACHE_SIZE	16
+#endif
+#define DENTRY_NAME_LEN		128
+
+static struct dentry
+{
+  unsigned long drive;
+  unsigned long partition;
+  unsigned long start;
+  int fsys_type;
+  int negative;			/* the file does not exist */
+  unsigned long ident;		/* what ident_func returned */
+  unsigned int stamp;		/* LRU time, 0 if the entry is free */
+  char name[DENTRY_NAME_LEN];
+}
+dentry_cache[DENTRY_CACHE_SIZE];
+
+static unsigned int dentry_clock;
+
+/* Forget everything, because a device has been written to or replaced,
+   or a filesystem noticed that it is not what it was.  */
+void
+dentry_cache_flush (void)
+{
+  int i;
+
+  for (i = 0; i < DENTRY_CACHE_SIZE; i++)
+    dentry_cache[i].stamp = 0;
+}
+
+/* Copy the file name at the start of FILENAME to NAME, without the
+   arguments that follow it and with runs of slashes squeezed.  Returns
+   zero if it does not fit.  */
+static int
+dentry_name (char *name, const char *filename)
+{
+  int len = 0;
+
+  while (*filename && ! isspace (*filename))
+    {
+      if (len == DENTRY_NAME_LEN - 1)
+	{
+	  name[0] = 0;
+	  return 0;
+	}
+
+      if (*filename != '/' || ! len || name[len - 1] != '/')
+	name[len++] = *filename;
+
+      filename++;
+    }
+
+  name[len] = 0;
+  return 1;
+}
+
+/* Whether lookups on the current drive may be cached.  */
+static int
+dentry_cacheable (void)
+{
+#ifdef GRUB_UTIL
+  return 0;
+#else
+  return (current_drive != NETWORK_DRIVE && current_drive != cdrom_drive
+	  && (current_drive & 0x80));
+#endif
+}
+
+/* Find the entry for NAME on the current filesystem, or NULL.  */
+static struct dentry *
+dentry_lookup (const char *name)
+{
+  struct dentry *d;
+
+  if (! dentry_cacheable ())
+    return 0;
+
+  for (d = dentry_cache; d < dentry_cache + DENTRY_CACHE_SIZE; d++)
+    if (d->stamp
+	&& d->drive == current_drive
+	&& d->partition == current_partition
+	&& d->start == part_start
+	&& d->fsys_type == fsys_type
+	&& ! grub_strcmp (d->name, name))
+      {
+	d->stamp = ++dentry_clock;
+	return d;
+      }
+
+  return 0;
+}
+
+/* Remember what opening NAME on the current filesystem gave.  */
+static void
+dentry_insert (const char *name, int negative, unsigned long ident)
+{
+  struct dentry *d, *victim = dentry_cache;
+
+  if (! dentry_cacheable ())
+    return;
+
+  for (d = dentry_cache; d < dentry_cache + DENTRY_CACHE_SIZE; d++)
+    if (d->stamp < victim->stamp)
+      victim = d;
+
+  victim->drive = current_drive;
+  victim->partition = current_partition;
+  victim->start = part_start;
+  victim->fsys_type = fsys_type;
+  victim->negative = negative;
+  victim->ident = ident;
+  victim->stamp = ++dentry_clock;
+  grub_strcpy (victim->name, name);
+}
+#endif /* ! STAGE1_5 */
+
+
 /*
  *  This is the generic file open function.
  */
@@ -1655,6 +2084,13 @@ print_completions (int is_filename, int is_completion)
 int
 grub_open (char *filename)
 {
+#ifndef STAGE1_5
+  char name[DENTRY_NAME_LEN];
+  struct dentry *d;
+  unsigned long ident;
+
+  name[0] = 0;
+#endif /* ! STAGE1_5 */
 #ifndef NO_DECOMPRESSION
   compressed_file = 0;
 #endif /* NO_DECOMPRESSION */
@@ -1747,10 +2183,37 @@ grub_open (char *filename)
 # ifndef STAGE1_5
   /* set "dir" function to open a file */
   print_possibilities = 0;
+
+  if (errnum)
+    return 0;
+
+  if (dentry_name (name, filename) && (d = dentry_lookup (name)))
+    {
+      if (d->negative)
+	{
+	  errnum = ERR_FILE_NOT_FOUND;
+	  return 0;
+	}
+
+      if (fsys_table[fsys_type].reopen_func
+	  && (*(fsys_table[fsys_type].reopen_func)) (d->ident))
+	goto found;
+
+      /* Stale; look the file up again.  */
+      d->stamp = 0;
+      errnum = ERR_NONE;
+    }
 # endif
 
   if (!errnum && (*(fsys_table[fsys_type].dir_func)) (filename))
     {
+# ifndef STAGE1_5
+      if (*name && fsys_table[fsys_type].ident_func
+	  && (*(fsys_table[fsys_type].ident_func)) (&ident))
+	dentry_insert (name, 0, ident);
+
+    found:
+# endif
 #ifndef NO_DECOMPRESSION
       return gunzip_test_header ();
 #else /* NO_DECOMPRESSION */
@@ -1758,6 +2221,16 @@ grub_open (char *filename)
 #endif /* NO_DECOMPRESSION */
     }
 
+# ifndef STAGE1_5
+  if (*name && errnum == ERR_FILE_NOT_FOUND)
+    {
+      /* grub_memmove refuses to copy while an error is pending.  */
+      errnum = ERR_NONE;
+      dentry_insert (name, 1, 0);
+      errnum = ERR_FILE_NOT_FOUND;
+    }
+# endif
+
   return 0;
 }
 
@@ -3,6 +3,22 @@
 
 #if defined(PLATFORM_EFI)
 extern int network_ready;
+extern char *grub_efidisk_readahead_buffer (int size);
+extern char *grub_efidisk_ramdisk_buffer (unsigned long size);
+
+/* A read for grub_efidisk_read_batch.  */
+struct grub_efidisk_request
+{
+  unsigned long sector;
+  int nsec;
+  char *buf;
+};
+
+extern int grub_efidisk_read_batch (int drive,
+				    struct grub_efidisk_request *reqs,
+				    int count);
+
+extern void grub_efi_stall (unsigned long microseconds);
 #endif /* defined(PLATFORM_EFI) */
 
 #endif /* EFISTUBS_H */
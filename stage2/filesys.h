@@ -64,6 +64,9 @@ int fat_dir (char *dirname);
 int ext2fs_mount (void);
 int ext2fs_read (char *buf, int len);
 int ext2fs_dir (char *dirname);
+int ext2fs_ident (unsigned long *ident);
+int ext2fs_reopen (unsigned long ident);
+void ext2fs_cache_reset (void);
 #else
 #define FSYS_EXT2FS_NUM 0
 #endif
@@ -121,8 +124,15 @@ int tftp_mount (void);
 int tftp_read (char *buf, int len);
 int tftp_dir (char *dirname);
 void tftp_close (void);
+/* HTTP comes with the TFTP support of netboot.  */
+#define FSYS_HTTP_NUM 1
+int http_mount (void);
+int http_read (char *buf, int len);
+int http_dir (char *dirname);
+void http_close (void);
 #else
 #define FSYS_TFTP_NUM 0
+#define FSYS_HTTP_NUM 0
 #endif
 
 #ifdef PLATFORM_EFI
@@ -131,6 +141,7 @@ int efi_tftp_mount (void);
 int efi_tftp_read (char *buf, int len);
 int efi_tftp_dir (char *dirname);
 void efi_tftp_close (void);
+int efi_tftp_multicast (char *arg);
 #else
 #define FSYS_EFI_TFTP_NUM 0
 #endif
@@ -149,7 +160,7 @@ int iso9660_dir (char *dirname);
 #define NUM_FSYS	\
   (FSYS_FFS_NUM + FSYS_FAT_NUM + FSYS_EXT2FS_NUM + FSYS_MINIX_NUM	\
    + FSYS_REISERFS_NUM + FSYS_VSTAFS_NUM + FSYS_JFS_NUM + FSYS_XFS_NUM	\
-   + FSYS_TFTP_NUM + FSYS_EFI_TFTP_NUM + FSYS_ISO9660_NUM + FSYS_UFS2_NUM \
+   + FSYS_TFTP_NUM + FSYS_HTTP_NUM + FSYS_EFI_TFTP_NUM + FSYS_ISO9660_NUM + FSYS_UFS2_NUM \
    + FSYS_UEFI_NUM)
 #endif
 
@@ -175,6 +186,11 @@ struct fsys_entry
   int (*dir_func) (char *dirname);
   void (*close_func) (void);
   int (*embed_func) (int *start_sector, int needed_sectors);
+  /* Optional: after a successful dir_func, return in *IDENT something
+     that identifies the open file, such as its inode number.  */
+  int (*ident_func) (unsigned long *ident);
+  /* Optional: open the file identified by IDENT, as dir_func would.  */
+  int (*reopen_func) (unsigned long ident);
 };
 
 #ifdef STAGE1_5
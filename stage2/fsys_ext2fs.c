@@ -402,6 +402,111 @@ ffz (unsigned int word)
   return word;
 }
 
+#ifndef STAGE1_5
+/* Metadata kept across grub_open calls.  FSYS_BUF is shared with every
+   other filesystem and rewritten on each mount, so this lives in memory
+   of its own, and belongs to the filesystem described by EXT2_CACHE.
+   The BIOS Stage 2 must stay below FSYS_BUF, so it keeps less: the
+   descriptors of 64 groups (8GB with 4K blocks) and 8 inodes.  */
+#if defined (PLATFORM_EFI) || defined (GRUB_UTIL)
+# define EXT2_GDT_CACHE_SIZE	16384
+# define EXT2_ICACHE_SIZE	32
+#else
+# define EXT2_GDT_CACHE_SIZE	2048
+# define EXT2_ICACHE_SIZE	8
+#endif
+
+static struct
+{
+  unsigned long drive;
+  unsigned long partition;
+  unsigned long start;
+  __u8 uuid[16];
+  __u32 wtime;
+  int gdt_valid;		/* the whole table is in EXT2_GDT */
+  unsigned int clock;		/* LRU time of the inode cache */
+}
+ext2_cache = { 0xFFFFFFFF };
+
+static char ext2_gdt[EXT2_GDT_CACHE_SIZE];
+
+/* The inode number of the file ext2fs_dir opened last.  */
+static int ext2_open_ino;
+
+static struct ext2_icache_entry
+{
+  int ino;			/* 0 if the entry is free */
+  unsigned int stamp;		/* EXT2_CACHE.CLOCK at the last use */
+  struct ext2_inode inode;
+}
+ext2_icache[EXT2_ICACHE_SIZE];
+
+static void
+ext2_icache_flush (void)
+{
+  int i;
+
+  for (i = 0; i < EXT2_ICACHE_SIZE; i++)
+    {
+      ext2_icache[i].ino = 0;
+      ext2_icache[i].stamp = 0;
+    }
+}
+
+/* Forget the filesystem the caches were filled from, so that the next
+   mount reads everything again.  */
+void
+ext2fs_cache_reset (void)
+{
+  ext2_cache.drive = 0xFFFFFFFF;
+}
+
+/* Called with a freshly mounted SUPERBLOCK.  If it is not the filesystem
+   the caches were filled from, start over: drop the inodes and read the
+   group descriptor table in one go, if it fits.  */
+static void
+ext2_cache_check (void)
+{
+  int groups, size;
+
+  if (ext2_cache.drive == current_drive
+      && ext2_cache.partition == current_partition
+      && ext2_cache.start == part_start
+      && ext2_cache.wtime == SUPERBLOCK->s_wtime
+      && ! grub_memcmp ((char *) ext2_cache.uuid,
+			(char *) SUPERBLOCK->s_uuid, 16))
+    {
+#ifdef GRUB_UTIL
+      /* A mounted filesystem changes under the grub shell without
+	 S_WTIME moving, so keep inodes only within one grub_open.  */
+      ext2_icache_flush ();
+#endif
+      return;
+    }
+
+  ext2_cache.drive = current_drive;
+  ext2_cache.partition = current_partition;
+  ext2_cache.start = part_start;
+  ext2_cache.wtime = SUPERBLOCK->s_wtime;
+  memmove (ext2_cache.uuid, SUPERBLOCK->s_uuid, 16);
+  ext2_cache.clock = 0;
+  /* Cached path lookups may refer to the old filesystem.  */
+  dentry_cache_flush ();
+  ext2_icache_flush ();
+
+  groups = ((SUPERBLOCK->s_inodes_count + SUPERBLOCK->s_inodes_per_group - 1)
+	    / SUPERBLOCK->s_inodes_per_group);
+  size = groups * EXT2_DESC_SIZE (SUPERBLOCK);
+  ext2_cache.gdt_valid
+    = (size <= EXT2_GDT_CACHE_SIZE
+       && devread ((WHICH_SUPER + SUPERBLOCK->s_first_data_block)
+		   * (EXT2_BLOCK_SIZE (SUPERBLOCK) / DEV_BSIZE),
+		   0, size, ext2_gdt));
+  /* Too big or unreadable just means reading descriptors as we go.  */
+  errnum = ERR_NONE;
+}
+#endif /* ! STAGE1_5 */
+
 /* check filesystem types and read superblock into memory buffer */
 int
 ext2fs_mount (void)
@@ -418,6 +523,10 @@ ext2fs_mount (void)
 		   (char *) SUPERBLOCK)
       || SUPERBLOCK->s_magic != EXT2_SUPER_MAGIC)
       retval = 0;
+#ifndef STAGE1_5
+  else
+    ext2_cache_check ();
+#endif
 
   return retval;
 }
@@ -762,6 +871,128 @@ int ext2_is_fast_symlink (void)
   return INODE->i_blocks == ea_blocks;
 }
 
+/* Read inode INO into the buffer known as INODE.  Returns 1 on success,
+   0 on a read error, or -1 if the inode table is out of reach.  */
+static int
+ext2_read_inode (int ino)
+{
+  int group_id;			/* which group the inode is in */
+  int group_desc;		/* fs pointer to that group */
+  int desc;			/* index within that group */
+  int ino_blk;			/* fs pointer of the inode's information */
+  struct ext4_group_desc *ext4_gdp;
+  struct ext2_inode *raw_inode;	/* inode info corresponding to ino */
+#ifndef STAGE1_5
+  struct ext2_icache_entry *entry, *victim;
+#endif
+#ifdef E2DEBUG
+  unsigned char *i;
+#endif	/* E2DEBUG */
+
+  /* reset indirect blocks! */
+  mapblock2 = mapblock1 = -1;
+
+#ifndef STAGE1_5
+  victim = ext2_icache;
+  for (entry = ext2_icache; entry < ext2_icache + EXT2_ICACHE_SIZE; entry++)
+    {
+      if (entry->ino == ino)
+	{
+	  entry->stamp = ++ext2_cache.clock;
+	  memmove ((void *) INODE, (void *) &entry->inode,
+		   sizeof (struct ext2_inode));
+	  return 1;
+	}
+
+      if (entry->stamp < victim->stamp)
+	victim = entry;
+    }
+#endif /* ! STAGE1_5 */
+
+  group_id = (ino - 1) / (SUPERBLOCK->s_inodes_per_group);
+#ifndef STAGE1_5
+  if (ext2_cache.gdt_valid)
+    ext4_gdp = (struct ext4_group_desc *) (ext2_gdt
+					   + group_id
+					   * EXT2_DESC_SIZE (SUPERBLOCK));
+  else
+#endif /* ! STAGE1_5 */
+    {
+      group_desc = group_id >> log2 (EXT2_DESC_PER_BLOCK (SUPERBLOCK));
+      desc = group_id & (EXT2_DESC_PER_BLOCK (SUPERBLOCK) - 1);
+#ifdef E2DEBUG
+      printf ("ipg=%d, dpb=%d\n", SUPERBLOCK->s_inodes_per_group,
+	      EXT2_DESC_PER_BLOCK (SUPERBLOCK));
+      printf ("group_id=%d group_desc=%d desc=%d\n", group_id, group_desc, desc);
+#endif /* E2DEBUG */
+      if (!ext2_rdfsb (
+			(WHICH_SUPER + group_desc + SUPERBLOCK->s_first_data_block),
+			(unsigned long) GROUP_DESC))
+	{
+	  return 0;
+	}
+      ext4_gdp = (struct ext4_group_desc *)( (__u8*)GROUP_DESC +
+					    desc * EXT2_DESC_SIZE(SUPERBLOCK));
+    }
+  if (EXT4_HAS_INCOMPAT_FEATURE(SUPERBLOCK, EXT4_FEATURE_INCOMPAT_64BIT)
+      && (! ext4_gdp->bg_inode_table_hi))
+    {/* 64bit itable not supported */
+      errnum = ERR_FILELENGTH;
+      return -1;
+    }
+  ino_blk = ext4_gdp->bg_inode_table +
+    (((ino - 1) % (SUPERBLOCK->s_inodes_per_group))
+     >> log2 (EXT2_INODES_PER_BLOCK (SUPERBLOCK)));
+#ifdef E2DEBUG
+  printf ("inode table fsblock=%d\n", ino_blk);
+#endif /* E2DEBUG */
+  if (!ext2_rdfsb (ino_blk, (unsigned long) INODE))
+    {
+      return 0;
+    }
+
+  raw_inode = (struct ext2_inode *)((char *)INODE +
+    ((ino - 1) & (EXT2_INODES_PER_BLOCK (SUPERBLOCK) - 1)) *
+    EXT2_INODE_SIZE (SUPERBLOCK));
+#ifdef E2DEBUG
+  printf ("ipb=%d, sizeof(inode)=%d\n",
+	  EXT2_INODES_PER_BLOCK (SUPERBLOCK), EXT2_INODE_SIZE (SUPERBLOCK));
+  printf ("inode=%x, raw_inode=%x\n", INODE, raw_inode);
+  printf ("offset into inode table block=%d\n", (int) raw_inode - (int) INODE);
+  for (i = (unsigned char *) INODE; i <= (unsigned char *) raw_inode;
+       i++)
+    {
+      printf ("%c", "0123456789abcdef"[*i >> 4]);
+      printf ("%c", "0123456789abcdef"[*i % 16]);
+      if (!((i + 1 - (unsigned char *) INODE) % 16))
+	{
+	  printf ("\n");
+	}
+      else
+	{
+	  printf (" ");
+	}
+    }
+  printf ("first word=%x\n", *((int *) raw_inode));
+#endif /* E2DEBUG */
+
+  /* copy inode to fixed location */
+  memmove ((void *) INODE, (void *) raw_inode, sizeof (struct ext2_inode));
+
+#ifdef E2DEBUG
+  printf ("first word=%x\n", *((int *) INODE));
+#endif /* E2DEBUG */
+
+#ifndef STAGE1_5
+  victim->ino = ino;
+  victim->stamp = ++ext2_cache.clock;
+  memmove ((void *) &victim->inode, (void *) INODE,
+	   sizeof (struct ext2_inode));
+#endif /* ! STAGE1_5 */
+
+  return 1;
+}
+
 /* preconditions: ext2fs_mount already executed, therefore supblk in buffer
  *   known as SUPERBLOCK
  * returns: 0 if error, nonzero iff we were able to find the file successfully
@@ -774,13 +1005,8 @@ ext2fs_dir (char *dirname)
 {
   int current_ino = EXT2_ROOT_INO;	/* start at the root */
   int updir_ino = current_ino;	/* the parent of the current directory */
-  int group_id;			/* which group the inode is in */
-  int group_desc;		/* fs pointer to that group */
-  int desc;			/* index within that group */
-  int ino_blk;			/* fs pointer of the inode's information */
+  int found;			/* result of looking up the current inode */
   int str_chk = 0;		/* used to hold the results of a string compare */
-  struct ext4_group_desc *ext4_gdp;
-  struct ext2_inode *raw_inode;	/* inode info corresponding to current_ino */
 
   char linkbuf[PATH_MAX];	/* buffer for following symbolic links */
   int link_count = 0;
@@ -793,9 +1019,6 @@ ext2fs_dir (char *dirname)
   int blk;			/* which data blk within dir entry (off div blocksize) */
   long map;			/* fs pointer of a particular block from dir entry */
   struct ext2_dir_entry *dp;	/* pointer to directory entry */
-#ifdef E2DEBUG
-  unsigned char *i;
-#endif	/* E2DEBUG */
 
   /* loop invariants:
      current_ino = inode to lookup
@@ -811,73 +1034,9 @@ ext2fs_dir (char *dirname)
 #endif /* E2DEBUG */
 
       /* look up an inode */
-      group_id = (current_ino - 1) / (SUPERBLOCK->s_inodes_per_group);
-      group_desc = group_id >> log2 (EXT2_DESC_PER_BLOCK (SUPERBLOCK));
-      desc = group_id & (EXT2_DESC_PER_BLOCK (SUPERBLOCK) - 1);
-#ifdef E2DEBUG
-      printf ("ipg=%d, dpb=%d\n", SUPERBLOCK->s_inodes_per_group,
-	      EXT2_DESC_PER_BLOCK (SUPERBLOCK));
-      printf ("group_id=%d group_desc=%d desc=%d\n", group_id, group_desc, desc);
-#endif /* E2DEBUG */
-      if (!ext2_rdfsb (
-			(WHICH_SUPER + group_desc + SUPERBLOCK->s_first_data_block),
-			(unsigned long) GROUP_DESC))
-	{
-	  return 0;
-	}
-	  ext4_gdp = (struct ext4_group_desc *)( (__u8*)GROUP_DESC +
-			  		desc * EXT2_DESC_SIZE(SUPERBLOCK));
-	  if (EXT4_HAS_INCOMPAT_FEATURE(SUPERBLOCK, EXT4_FEATURE_INCOMPAT_64BIT)
-		&& (! ext4_gdp->bg_inode_table_hi))
-	{/* 64bit itable not supported */
-	  errnum = ERR_FILELENGTH;
-	  return -1;
-	}
-      ino_blk = ext4_gdp->bg_inode_table +
-	(((current_ino - 1) % (SUPERBLOCK->s_inodes_per_group))
-	 >> log2 (EXT2_INODES_PER_BLOCK (SUPERBLOCK)));
-#ifdef E2DEBUG
-      printf ("inode table fsblock=%d\n", ino_blk);
-#endif /* E2DEBUG */
-      if (!ext2_rdfsb (ino_blk, (unsigned long) INODE))
-	{
-	  return 0;
-	}
-
-      /* reset indirect blocks! */
-      mapblock2 = mapblock1 = -1;
-
-      raw_inode = (struct ext2_inode *)((char *)INODE +
-	((current_ino - 1) & (EXT2_INODES_PER_BLOCK (SUPERBLOCK) - 1)) *
-	EXT2_INODE_SIZE (SUPERBLOCK));
-#ifdef E2DEBUG
-      printf ("ipb=%d, sizeof(inode)=%d\n",
-	      EXT2_INODES_PER_BLOCK (SUPERBLOCK), EXT2_INODE_SIZE (SUPERBLOCK));
-      printf ("inode=%x, raw_inode=%x\n", INODE, raw_inode);
-      printf ("offset into inode table block=%d\n", (int) raw_inode - (int) INODE);
-      for (i = (unsigned char *) INODE; i <= (unsigned char *) raw_inode;
-	   i++)
-	{
-	  printf ("%c", "0123456789abcdef"[*i >> 4]);
-	  printf ("%c", "0123456789abcdef"[*i % 16]);
-	  if (!((i + 1 - (unsigned char *) INODE) % 16))
-	    {
-	      printf ("\n");
-	    }
-	  else
-	    {
-	      printf (" ");
-	    }
-	}
-      printf ("first word=%x\n", *((int *) raw_inode));
-#endif /* E2DEBUG */
-
-      /* copy inode to fixed location */
-      memmove ((void *) INODE, (void *) raw_inode, sizeof (struct ext2_inode));
-
-#ifdef E2DEBUG
-      printf ("first word=%x\n", *((int *) INODE));
-#endif /* E2DEBUG */
+      found = ext2_read_inode (current_ino);
+      if (found <= 0)
+	return found;
 
       /* If we've got a symbolic link, then chase it. */
       if (S_ISLNK (INODE->i_mode))
@@ -969,6 +1128,9 @@ ext2fs_dir (char *dirname)
 	    }
 
 	  filemax = (INODE->i_size);
+#ifndef STAGE1_5
+	  ext2_open_ino = current_ino;
+#endif
 	  return 1;
 	}
 
@@ -1090,4 +1252,26 @@ ext2fs_dir (char *dirname)
   /* never get here */
 }
 
+#ifndef STAGE1_5
+/* Identify the file ext2fs_dir just opened, for the path cache.  */
+int
+ext2fs_ident (unsigned long *ident)
+{
+  *ident = ext2_open_ino;
+  return 1;
+}
+
+/* Open the file whose inode number is IDENT, as ext2fs_dir would have.  */
+int
+ext2fs_reopen (unsigned long ident)
+{
+  if (ext2_read_inode (ident) <= 0 || !S_ISREG (INODE->i_mode))
+    return 0;
+
+  ext2_open_ino = ident;
+  filemax = (INODE->i_size);
+  return 1;
+}
+#endif /* ! STAGE1_5 */
+
 #endif /* FSYS_EXT2_FS */
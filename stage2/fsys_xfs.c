@@ -291,23 +291,46 @@ next_extent (void)
 }
 
 /*
- * Name lies - the function reads only first 100 bytes
+ * Read LEN bytes at byte OFF from the start of directory block BLK,
+ * where BLK counts file system blocks from the start of the directory
+ * and may lie beyond the 2GB that filepos can address.
  */
-static void
-xfs_dabread (void)
+static int
+xfs_daread (xfs_dablk_t blk, int off, int len, char *buf)
 {
 	xad_t *xad;
-	xfs_fileoff_t offset;;
+	xfs_fileoff_t offset;
+	int toread;
 
-	init_extents ();
-	while ((xad = next_extent ())) {
-		offset = xad->offset;
-		if (isinxt (xfs.dablk, offset, xad->len)) {
-			devread (fsb2daddr (xad->start + xfs.dablk - offset),
-				 0, 100, dirbuf);
-			break;
+	blk += off >> xfs.blklog;
+	off &= xfs.bsize - 1;
+	while (len > 0) {
+		toread = (len > xfs.bsize - off) ? xfs.bsize - off : len;
+		init_extents ();
+		while ((xad = next_extent ())) {
+			offset = xad->offset;
+			if (isinxt (blk, offset, xad->len))
+				break;
 		}
+		if (xad == NULL
+		    || !devread (fsb2daddr (xad->start + blk - offset),
+				 off, toread, buf))
+			return 0;
+		buf += toread;
+		len -= toread;
+		blk++;
+		off = 0;
 	}
+	return 1;
+}
+
+/*
+ * Name lies - the function reads only first 100 bytes
+ */
+static void
+xfs_dabread (void)
+{
+	xfs_daread (xfs.dablk, 0, 100, dirbuf);
 }
 
 static inline xfs_ino_t
@@ -432,7 +455,7 @@ first_dentry (xfs_ino_t *ino)
 			xfs.dirmax = le32 (tail->count) - le32 (tail->stale);
 #undef tail
 		} else {
-			xfs.dablk = (1ULL << 35) >> xfs.blklog;
+			xfs.dablk = XFS_DIR2_LEAF_OFFSET >> xfs.blklog;
 #define h		((xfs_dir2_leaf_hdr_t *)dirbuf)
 #define n		((xfs_da_intnode_t *)dirbuf)
 			for (;;) {
@@ -455,6 +478,155 @@ first_dentry (xfs_ino_t *ino)
 	return next_dentry (ino);
 }
 
+/*
+ * The directory name hash, as in xfs_da_hashname ()
+ */
+static xfs_dahash_t
+da_hashname (char *name, int namelen)
+{
+	unsigned char *p = (unsigned char *)name;
+	xfs_dahash_t hash;
+
+#define rol32(x,y)	(((x) << (y)) | ((x) >> (32 - (y))))
+	for (hash = 0; namelen >= 4; namelen -= 4, p += 4)
+		hash = (p[0] << 21) ^ (p[1] << 14) ^ (p[2] << 7) ^ p[3]
+		       ^ rol32 (hash, 7 * 4);
+
+	switch (namelen) {
+	case 3:
+		return (p[0] << 14) ^ (p[1] << 7) ^ p[2] ^ rol32 (hash, 7 * 3);
+	case 2:
+		return (p[0] << 7) ^ p[1] ^ rol32 (hash, 7 * 2);
+	case 1:
+		return p[0] ^ rol32 (hash, 7 * 1);
+	}
+#undef rol32
+	return hash;
+}
+
+/*
+ * Leaf and node blocks both hold arrays of 8-byte entries led by a
+ * hash value and sorted on it.  Find the first of the COUNT entries at
+ * byte BASE of block BLK whose hash is not below HASH.
+ */
+static int
+da_lower_bound (xfs_dablk_t blk, int base, int count, xfs_dahash_t hash)
+{
+	xfs_dahash_t hashval;
+	int lo = 0, hi = count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) >> 1;
+		if (!xfs_daread (blk, base + (mid << 3),
+				 sizeof(hashval), (char *)&hashval))
+			return count;
+		if (le32 (hashval) < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Look NAME up through the hash index of a block, leaf or node
+ * directory, so that only the data entries carrying its hash are read.
+ * Returns 1 and sets *INO if found, 0 if not, or -1 if the directory
+ * has to be scanned with first_dentry ()/next_dentry () instead.
+ */
+static int
+xfs_lookup (char *name, int namelen, xfs_ino_t *ino)
+{
+	struct xfs_da_node_hdr h;
+	xfs_dir2_block_tail_t tail;
+	xfs_dir2_leaf_entry_t e;
+	xfs_uint32_t magic;
+	xfs_dahash_t hash;
+	xfs_dablk_t blk;
+	int base, count, i, off;
+	unsigned int addr;
+
+	if (icore.di_format != XFS_DINODE_FMT_EXTENTS
+	    && icore.di_format != XFS_DINODE_FMT_BTREE)
+		return -1;
+
+	hash = da_hashname (name, namelen);
+
+	if (!xfs_daread (0, 0, sizeof(magic), (char *)&magic))
+		return -1;
+	if (magic == le32 (XFS_DIR2_BLOCK_MAGIC)) {
+		/* The leaf entries sit right below the block tail */
+		blk = 0;
+		base = xfs.dirbsize - sizeof(tail);
+		if (!xfs_daread (blk, base, sizeof(tail), (char *)&tail))
+			return -1;
+		count = le32 (tail.count);
+		base -= count * sizeof(e);
+		h.info.forw = 0;
+	} else {
+		blk = XFS_DIR2_LEAF_OFFSET >> xfs.blklog;
+		for (;;) {
+			if (!xfs_daread (blk, 0, sizeof(h), (char *)&h))
+				return -1;
+			if (h.info.magic == le16 (XFS_DIR2_LEAF1_MAGIC)
+			    || h.info.magic == le16 (XFS_DIR2_LEAFN_MAGIC))
+				break;
+			if (h.info.magic != le16 (XFS_DA_NODE_MAGIC))
+				return -1;
+			/* Descend into the first child whose hash covers
+			   ours, or into the last one */
+			count = le16 (h.count);
+			if (count == 0)
+				return 0;
+			i = da_lower_bound (blk, sizeof(h), count, hash);
+			if (i == count)
+				i--;
+			if (!xfs_daread (blk, sizeof(h) + (i << 3)
+					 + offsetof(struct xfs_da_node_entry,
+						    before),
+					 sizeof(blk), (char *)&blk))
+				return -1;
+			blk = le32 (blk);
+		}
+		base = sizeof(xfs_dir2_leaf_hdr_t);
+		count = le16 (h.count);
+	}
+
+	/* A hash run may continue into the next leaf of a node directory */
+	for (i = da_lower_bound (blk, base, count, hash); ; i++) {
+		if (i == count) {
+			if (h.info.forw == 0
+			    || h.info.magic != le16 (XFS_DIR2_LEAFN_MAGIC))
+				return 0;
+			blk = le32 (h.info.forw);
+			if (!xfs_daread (blk, 0, sizeof(h), (char *)&h))
+				return 0;
+			count = le16 (h.count);
+			i = -1;
+			continue;
+		}
+		if (!xfs_daread (blk, base + (i << 3), sizeof(e), (char *)&e)
+		    || le32 (e.hashval) != hash)
+			return 0;
+		addr = le32 (e.address);
+		if (addr == XFS_DIR2_NULL_DATAPTR)
+			continue;
+
+		/* The data entry: inumber, namelen, then the name */
+		off = (addr << 3) & (xfs.bsize - 1);
+		if (!xfs_daread (addr >> (xfs.blklog - 3), off, 9, dirbuf)
+		    || ((xfs_dir2_data_entry_t *)dirbuf)->namelen != namelen)
+			continue;
+		*ino = le64 (((xfs_dir2_data_entry_t *)dirbuf)->inumber);
+		if (!xfs_daread (addr >> (xfs.blklog - 3), off + 9,
+				 namelen, dirbuf))
+			continue;
+		dirbuf[namelen] = 0;
+		if (substring (name, dirbuf) == 0)
+			return 1;
+	}
+}
+
 int
 xfs_mount (void)
 {
@@ -595,6 +767,25 @@ xfs_dir (char *dirname)
 		for (rest = dirname; (ch = *rest) && !isspace (ch) && ch != '/'; rest++);
 		*rest = 0;
 
+#ifndef STAGE1_5
+		if (print_possibilities)
+			n = -1;
+		else
+#endif
+		n = xfs_lookup (dirname, rest - dirname, &new_ino);
+		if (n == 0) {
+			if (!errnum)
+				errnum = ERR_FILE_NOT_FOUND;
+			*rest = ch;
+			return 0;
+		}
+		if (n > 0) {
+			parent_ino = ino;
+			ino = new_ino;
+			*(dirname = rest) = ch;
+			continue;
+		}
+
 		name = first_dentry (&new_ino);
 		for (;;) {
 			cmp = (!*dirname) ? -1 : substring (dirname, name);
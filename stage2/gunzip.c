@@ -1239,4 +1239,39 @@ gunzip_read (char *buf, int len)
   return ret;
 }
 
+
+/* Return the CRC-32 of the uncompressed data, as recorded at the end of
+   the current compressed file.  */
+unsigned int
+gunzip_stored_crc (void)
+{
+  return gzip_crc;
+}
+
+
+/* Continue the CRC-32 CRC, as used by gzip, over LEN bytes at BUF.
+   Start with a CRC of 0.  */
+unsigned int
+gunzip_crc32 (unsigned int crc, const char *buf, int len)
+{
+  static unsigned int crc_table[256];
+  int i, j;
+
+  if (! crc_table[1])
+    for (i = 0; i < 256; i++)
+      {
+	unsigned int c = i;
+
+	for (j = 0; j < 8; j++)
+	  c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+	crc_table[i] = c;
+      }
+
+  crc = ~crc;
+  while (len-- > 0)
+    crc = crc_table[(crc ^ *(const unsigned char *) buf++) & 0xff] ^ (crc >> 8);
+
+  return ~crc;
+}
+
 #endif /* ! NO_DECOMPRESSION */
@@ -0,0 +1,232 @@
+/* iostat.c - count disk and network reads and their latencies */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2004  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Reads are timed with the time stamp counter, which costs next to
+   nothing, and only converted to microseconds when the counters are
+   printed.  */
+
+#include <shared.h>
+#include "efistubs.h"
+
+/* Drives and servers with counters.  Each takes 200 bytes, and the BIOS
+   Stage 2 has little room below FSYS_BUF.  */
+#if defined (PLATFORM_EFI) || defined (GRUB_UTIL)
+# define IOSTAT_MAX	16
+#else
+# define IOSTAT_MAX	4
+#endif
+
+static struct iostat iostats[IOSTAT_MAX];
+static int iostat_count;
+static struct iostat *iostat_last;
+
+/* Time stamp counter cycles per microsecond, 0 if not measured yet.  */
+static unsigned long iostat_cycles;
+
+unsigned long long
+iostat_clock (void)
+{
+  unsigned int lo, hi;
+
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((unsigned long long) hi << 32) | lo;
+}
+
+/* Return the counters for the drive or server ID, or NULL if there is
+   no room for them.  */
+struct iostat *
+iostat_get (int kind, unsigned long id)
+{
+  struct iostat *st = iostat_last;
+
+  if (st && st->kind == kind && st->id == id)
+    return st;
+
+  for (st = iostats; st < iostats + iostat_count; st++)
+    if (st->kind == kind && st->id == id)
+      return iostat_last = st;
+
+  if (iostat_count == IOSTAT_MAX)
+    return 0;
+
+  iostat_count++;
+  grub_memset ((char *) st, 0, sizeof (*st));
+  st->kind = kind;
+  st->id = id;
+  return iostat_last = st;
+}
+
+/* Count a read of SECTORS sectors, or BYTES bytes, which was started
+   at the clock value START and returned ERR.  */
+void
+iostat_done (struct iostat *st, unsigned long long start,
+	     unsigned long sectors, unsigned long bytes, int err)
+{
+  unsigned long long cycles;
+  int bucket = 0;
+
+  if (! st)
+    return;
+
+  cycles = iostat_clock () - start;
+  while ((cycles >>= 1) && bucket < IOSTAT_BUCKETS - 1)
+    bucket++;
+
+  st->requests++;
+  st->latency[bucket]++;
+  if (err)
+    {
+      st->errors++;
+      return;
+    }
+
+  st->sectors += sectors;
+  st->bytes += bytes;
+}
+
+void
+iostat_reset (void)
+{
+  iostat_count = 0;
+  iostat_last = 0;
+  grub_memset ((char *) &readahead_stats, 0, sizeof (readahead_stats));
+}
+
+/* Measure how fast the time stamp counter runs.  */
+static void
+iostat_calibrate (void)
+{
+  unsigned long long start;
+#ifdef PLATFORM_EFI
+  start = iostat_clock ();
+  grub_efi_stall (20000);
+  iostat_cycles = (iostat_clock () - start) / 20000;
+#else
+  int ticks = currticks ();
+
+  /* Start at the edge of a timer tick, and count two of them, which
+     take 109863 microseconds at 18.2 ticks per second.  */
+  while (currticks () == ticks)
+    ;
+  start = iostat_clock ();
+  ticks = currticks ();
+  while (currticks () - ticks < 2)
+    ;
+  iostat_cycles = (iostat_clock () - start) / 109863;
+#endif
+
+  if (! iostat_cycles)
+    iostat_cycles = 1;
+}
+
+/* Convert CYCLES of the time stamp counter into microseconds.  */
+unsigned long
+iostat_microseconds (unsigned long long cycles)
+{
+  if (! iostat_cycles)
+    iostat_calibrate ();
+
+  return cycles / iostat_cycles;
+}
+
+/* Print the latency histogram of ST, merging the buckets which are too
+   short to tell apart in microseconds.  */
+static void
+print_latency (struct iostat *st)
+{
+  unsigned long count = 0;
+  int i;
+
+  grub_printf ("    latency:");
+  for (i = 0; i < IOSTAT_BUCKETS; i++)
+    {
+      unsigned long long us = (2ULL << i) / iostat_cycles;
+
+      count += st->latency[i];
+      if (! count
+	  || (i < IOSTAT_BUCKETS - 1
+	      && (2ULL << (i + 1)) / iostat_cycles == us))
+	continue;
+
+      if (i == IOSTAT_BUCKETS - 1)
+	grub_printf (" more %lu", count);
+      else if (us < 10000)
+	grub_printf (" <%luus %lu", (unsigned long) us, count);
+      else
+	grub_printf (" <%lums %lu", (unsigned long) (us / 1000), count);
+      count = 0;
+    }
+  grub_printf ("\n");
+}
+
+void
+iostat_print (void)
+{
+  struct iostat *st;
+
+  if (! iostat_count)
+    {
+      grub_printf (" Nothing has been read yet.\n");
+      return;
+    }
+
+  if (! iostat_cycles)
+    iostat_calibrate ();
+
+  for (st = iostats; st < iostats + iostat_count; st++)
+    {
+      if (st->kind == IOSTAT_SERVER)
+	{
+	  unsigned char *ip = (unsigned char *) &st->id;
+
+	  grub_printf (" %d.%d.%d.%d: %lu packets, %lu KB\n",
+		       ip[0], ip[1], ip[2], ip[3], st->requests,
+		       (unsigned long) (st->bytes >> 10));
+	}
+      else
+	{
+	  if (MD_DRIVE_P (st->id))
+	    grub_printf (" (md%d)", (int) st->id - MD_DRIVE);
+	  else if (RD_DRIVE_P (st->id))
+	    grub_printf (" (rd)");
+	  else if (LD_DRIVE_P (st->id))
+	    grub_printf (" (ld%d)", (int) (st->id & 0x7F) - LD_FLOPPY_DRIVE);
+	  else if (st->id & 0x80)
+	    grub_printf (" (hd%d)", (int) st->id - 0x80);
+	  else
+	    grub_printf (" (fd%d)", (int) st->id);
+
+	  grub_printf (": %lu reads, %lu sectors, %lu KB\n",
+		       st->requests, st->sectors,
+		       (unsigned long) (st->bytes >> 10));
+	  grub_printf ("    %lu buffer hits, %lu misses\n",
+		       st->hits, st->misses);
+	}
+
+      if (st->retries || st->errors)
+	grub_printf ("    %lu retries, %lu errors\n", st->retries, st->errors);
+#ifdef GRUB_UTIL
+      if (st->modeled)
+	grub_printf ("    modeled media time: %lu ms\n",
+		     (unsigned long) (st->modeled / 1000));
+#endif
+      print_latency (st);
+    }
+}
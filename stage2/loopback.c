@@ -0,0 +1,318 @@
+/* loopback.c - drives read from files where they lie on their disks */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2004  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* The command loopback makes a disk image or an ISO stored as a file
+   into one of the drives (ld0) to (ld3).  The file is walked once, with
+   disk_read_hook telling where each of its sectors lies on the disk but
+   nothing read, and the runs of sectors found are kept.  A read of the
+   drive then goes straight to the disk holding the file, without going
+   through its filesystem again and without copying the image anywhere.
+
+   Like (rd), a drive holding a partition table is a hard disk and any
+   other a floppy.  Files which do not start their sectors on sector
+   boundaries, such as the tails that ReiserFS packs together, cannot be
+   used.  */
+
+#include <shared.h>
+
+#define LD_SECTOR_SIZE		512
+
+/* The runs of sectors each drive can have.  The BIOS Stage 2 has
+   little room below FSYS_BUF, so it allows fewer.  */
+#if defined (PLATFORM_EFI) || defined (GRUB_UTIL)
+# define LD_MAX_EXTENTS		128
+#else
+# define LD_MAX_EXTENTS		32
+#endif
+
+struct ld_extent
+{
+  unsigned long start;		/* the first sector in the file */
+  unsigned long disk;		/* where it is on the drive below */
+  unsigned long length;
+};
+
+struct ld_device
+{
+  unsigned long drive;		/* the drive holding the file */
+  unsigned long partition;
+  struct geometry geom;
+  unsigned long size;		/* in sectors */
+  int nextents;
+  struct ld_extent extents[LD_MAX_EXTENTS];
+};
+
+static struct ld_device ld_devices[LD_MAX_DEVICES];
+
+/* The numbers of the drives, LD_DRIVE or LD_FLOPPY_DRIVE plus their
+   index.  */
+int ld_drives[LD_MAX_DEVICES] =
+{
+  LD_DRIVE, LD_DRIVE + 1, LD_DRIVE + 2, LD_DRIVE + 3
+};
+
+/* The drive being set up, and how many bytes of its file have been
+   found so far.  */
+static struct ld_device *ld_mapping;
+static unsigned long ld_mapped;
+
+/* The disk_read_hook of the file being set up: add SECTOR to the runs
+   of sectors, and refuse data which is not at the start of a sector or
+   which follows a partial one.  */
+static void
+ld_map_sector (int sector, int offset, int length)
+{
+  struct ld_device *ld = ld_mapping;
+  unsigned long start = ld_mapped / LD_SECTOR_SIZE;
+  struct ld_extent *e;
+
+  if (offset || ld_mapped % LD_SECTOR_SIZE)
+    {
+      errnum = ERR_UNALIGNED;
+      return;
+    }
+
+  ld_mapped += length;
+  if (ld->nextents)
+    {
+      e = &ld->extents[ld->nextents - 1];
+      if (e->disk + e->length == (unsigned long) sector)
+	{
+	  e->length++;
+	  return;
+	}
+    }
+
+  if (ld->nextents == LD_MAX_EXTENTS)
+    {
+      errnum = ERR_WONT_FIT;
+      return;
+    }
+
+  e = &ld->extents[ld->nextents++];
+  e->start = start;
+  e->disk = sector;
+  e->length = 1;
+}
+
+/* Make FILE into the drive (ldNUM), in place of what it was before, or
+   remove the drive if FILE is empty.  */
+int
+ld_setup (int num, char *file)
+{
+  struct ld_device *ld = &ld_devices[num];
+  char *mbr = (char *) SCRATCHADDR;
+
+  ld->size = 0;
+  ld->nextents = 0;
+  ld_drives[num] = LD_DRIVE + num;
+  /* Nothing cached from the file it was before holds any more.  */
+  if (buf_drive == LD_DRIVE + num || buf_drive == LD_FLOPPY_DRIVE + num)
+    buf_drive = -1;
+  dentry_cache_flush ();
+
+  if (! *file)
+    return 1;
+
+  /* The sectors must be those on the disk.  */
+  no_decompression = 1;
+  grub_open (file);
+  no_decompression = 0;
+  if (errnum)
+    return 0;
+
+  if (current_drive == NETWORK_DRIVE)
+    {
+      grub_close ();
+      errnum = ERR_DEV_VALUES;
+      return 0;
+    }
+
+  ld->drive = current_drive;
+  ld->partition = current_partition;
+  if (get_diskinfo (current_drive, &ld->geom))
+    errnum = ERR_NO_DISK;
+  else if (ld->geom.sector_size != LD_SECTOR_SIZE)
+    errnum = ERR_DEV_VALUES;
+  else if (! filemax)
+    errnum = ERR_FILELENGTH;
+
+  /* Read the whole file without reading it: every read goes to the
+     scratch area, and would overflow it if anything were copied.  */
+  ld_mapping = ld;
+  ld_mapped = 0;
+  disk_read_hook = ld_map_sector;
+  disk_read_map_only = 1;
+  while (! errnum && grub_read (mbr, LD_SECTOR_SIZE) > 0)
+    ;
+  disk_read_map_only = 0;
+  disk_read_hook = 0;
+  grub_close ();
+
+  if (! errnum && ld_mapped != (unsigned long) filemax)
+    errnum = ERR_UNALIGNED;
+  if (errnum)
+    {
+      ld->nextents = 0;
+      return 0;
+    }
+
+  ld->size = (ld_mapped + LD_SECTOR_SIZE - 1) / LD_SECTOR_SIZE;
+  if (ld_biosdisk (BIOSDISK_READ, LD_DRIVE + num, &ld->geom, 0, 1,
+		   SCRATCHSEG))
+    {
+      ld->size = 0;
+      ld->nextents = 0;
+      errnum = ERR_READ;
+      return 0;
+    }
+
+  if (! has_partition_table (mbr))
+    ld_drives[num] = LD_FLOPPY_DRIVE + num;
+
+  return 1;
+}
+
+static void
+ld_print_drive (unsigned long drive, unsigned long partition)
+{
+  if (MD_DRIVE_P (drive))
+    grub_printf ("(md%d", (int) drive - MD_DRIVE);
+  else if (RD_DRIVE_P (drive))
+    grub_printf ("(rd");
+  else if (LD_DRIVE_P (drive))
+    grub_printf ("(ld%d", (int) (drive & 0x7F) - LD_FLOPPY_DRIVE);
+  else if (drive & 0x80)
+    grub_printf ("(hd%d", (int) drive - 0x80);
+  else
+    grub_printf ("(fd%d", (int) drive);
+
+  if ((partition & 0xFF0000) != 0xFF0000)
+    grub_printf (",%d", (int) (partition >> 16) & 0xFF);
+  grub_printf (")");
+}
+
+/* Print the drives set up and where their files are.  */
+void
+ld_print (void)
+{
+  int i, found = 0;
+
+  for (i = 0; i < LD_MAX_DEVICES; i++)
+    {
+      struct ld_device *ld = &ld_devices[i];
+
+      if (! ld->size)
+	continue;
+
+      found = 1;
+      grub_printf (" (ld%d): %s, %lu sectors in %d pieces on ", i,
+		   ld_drives[i] & 0x80 ? "hard disk" : "floppy",
+		   ld->size, ld->nextents);
+      ld_print_drive (ld->drive, ld->partition);
+      grub_printf ("\n");
+    }
+
+  if (! found)
+    grub_printf (" No loopback drive is set up.\n");
+}
+
+static struct ld_device *
+ld_get (int drive)
+{
+  struct ld_device *ld = &ld_devices[(drive & 0x7F) - LD_FLOPPY_DRIVE];
+
+  if (! ld->size || drive != ld_drives[ld - ld_devices])
+    return 0;
+
+  return ld;
+}
+
+int
+ld_get_diskinfo (int drive, struct geometry *geometry)
+{
+  struct ld_device *ld = ld_get (drive);
+
+  if (! ld)
+    return 1;
+
+  geometry->total_sectors = ld->size;
+  geometry->sector_size = LD_SECTOR_SIZE;
+  geometry->flags = BIOSDISK_FLAG_LBA_EXTENSION;
+  geometry->sectors = 63;
+  geometry->heads = 255;
+  geometry->cylinders = ld->size / 63 / 255;
+  if (! geometry->cylinders)
+    geometry->cylinders = 1;
+  return 0;
+}
+
+int
+ld_biosdisk (int subfunc, int drive, struct geometry *geometry,
+	     int sector, int nsec, int segment)
+{
+  struct ld_device *ld = ld_get (drive);
+  int low, high, len, err;
+
+  if (! ld || sector < 0 || sector + nsec > ld->size)
+    return BIOSDISK_ERROR_GEOMETRY;
+
+  /* The last run starting at or before SECTOR.  */
+  low = 0;
+  high = ld->nextents - 1;
+  while (low < high)
+    {
+      int mid = (low + high + 1) / 2;
+
+      if (ld->extents[mid].start <= (unsigned long) sector)
+	low = mid;
+      else
+	high = mid - 1;
+    }
+
+  /* GRUB's buffer may hold sectors of the file's drive.  */
+  if (subfunc == BIOSDISK_WRITE && buf_drive == ld->drive)
+    buf_drive = -1;
+
+  while (nsec > 0)
+    {
+      struct ld_extent *e = &ld->extents[low++];
+      unsigned long skip = sector - e->start;
+      struct iostat *st = iostat_get (IOSTAT_DISK, ld->drive);
+      unsigned long long start;
+
+      len = e->length - skip;
+      if (len > nsec)
+	len = nsec;
+
+      start = iostat_clock ();
+      err = biosdisk (subfunc, ld->drive, &ld->geom, e->disk + skip, len,
+		      segment);
+      iostat_done (st, start, len, len * LD_SECTOR_SIZE, err);
+      if (err)
+	return err;
+
+      sector += len;
+      nsec -= len;
+      segment += (len * LD_SECTOR_SIZE) >> 4;
+    }
+
+  return 0;
+}
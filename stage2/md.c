@@ -0,0 +1,475 @@
+/* md.c - read Linux md RAID1 mirrors as one drive */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2004  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Each member of a RAID1 array holds a complete copy of the data, so a
+   filesystem on one can be read through the plain (hdN,M) device.  The
+   drives (md0) to (md3) instead read the array through all of its
+   members: a large read is cut into one piece per member, so that a
+   kernel or an initrd comes off all disks at once, and a piece that
+   cannot be read from one member is read from another.
+
+   Members are found by their superblocks: version 0.90 and 1.0 at the
+   end of the device, 1.1 and 1.2 near its start.  Members with fewer
+   events than the others of their array missed some writes and are
+   left out, and so are spares and members still being rebuilt.  */
+
+#include <shared.h>
+#include <filesys.h>
+
+#define MD_MAGIC		0xa92b4efc
+#define MD_MAX_MEMBERS		4
+
+/* Superblock offsets are in these units, so other members are left
+   alone.  */
+#define MD_SECTOR_SIZE		512
+
+/* Do not cut reads into pieces smaller than this many sectors.  */
+#define MD_PIECE		64
+
+/* We read a superblock piecewise: its first MD_SB_HEAD bytes, then
+   whatever else is needed within its first MD_SB_SIZE.  */
+#define MD_SB_HEAD		256
+#define MD_SB_SIZE		4096
+
+/* mdp_super_t, version 0.90.  */
+#define MD_SB0_LEVEL		28
+#define MD_SB0_SIZE		32	/* in kilobytes */
+#define MD_SB0_RAID_DISKS	40
+#define MD_SB0_UUID0		20
+#define MD_SB0_UUID1		52
+#define MD_SB0_EVENTS_LO	156
+#define MD_SB0_EVENTS_HI	160
+#define MD_SB0_THIS_DISK	3968	/* mdp_disk_t of this member */
+#define MD_SB0_RESERVED		128	/* sectors at the end of a member */
+
+/* mdp_disk_t.  */
+#define MD_DISK_RAID_DISK	12
+#define MD_DISK_STATE		16
+#define MD_DISK_SIZE		20
+#define MD_DISK_FAULTY		(1 << 0)
+#define MD_DISK_ACTIVE		(1 << 1)
+#define MD_DISK_SYNC		(1 << 2)
+
+/* struct mdp_superblock_1.  */
+#define MD_SB1_FEATURES		8
+#define MD_SB1_UUID		16
+#define MD_SB1_LEVEL		72
+#define MD_SB1_SIZE		80
+#define MD_SB1_DATA_OFFSET	128
+#define MD_SB1_SUPER_OFFSET	144
+#define MD_SB1_DEV_NUMBER	160
+#define MD_SB1_EVENTS		200
+#define MD_SB1_DEV_ROLES	256
+#define MD_SB1_FEATURE_RECOVERY	2
+#define MD_SB1_ROLE_SPARE	0xfffe	/* and above: spare or faulty */
+
+#define SB32(off)	(*(unsigned int *) (md_sb + (off)))
+#define SB64(off)	(*(unsigned long long *) (md_sb + (off)))
+
+struct md_member
+{
+  unsigned long drive;
+  unsigned long partition;
+  unsigned long start;		/* the first data sector on DRIVE */
+  struct geometry geom;
+  int failed;
+};
+
+static struct md_array
+{
+  unsigned char uuid[16];
+  unsigned long long events;
+  unsigned long size;		/* in sectors */
+  int nmembers;
+  int next;			/* the member to read from next */
+  struct md_member members[MD_MAX_MEMBERS];
+}
+md_arrays[MD_MAX_ARRAYS];
+
+static int md_narrays = -1;	/* not scanned yet */
+static int md_task = -1;	/* the scan in the background */
+
+static unsigned char md_sb[MD_SB_HEAD];
+
+/* Read LEN bytes at OFF in the superblock at SECTOR on DRIVE into BUF.  */
+static int
+md_read_sb (unsigned long drive, unsigned long sector, int off, int len,
+	    void *buf)
+{
+  if (rawread (drive, sector + off / MD_SECTOR_SIZE, off % MD_SECTOR_SIZE,
+	       len, (char *) buf))
+    return 1;
+
+  errnum = ERR_NONE;
+  return 0;
+}
+
+/* Add the member with data from START on DRIVE, in PARTITION, whose
+   superblock says it belongs to the array UUID of SIZE sectors and has
+   seen EVENTS updates.  */
+static void
+md_add (unsigned char *uuid, unsigned long long events, unsigned long size,
+	unsigned long drive, unsigned long partition, unsigned long start,
+	struct geometry *geom)
+{
+  struct md_array *md;
+  struct md_member *m;
+
+  for (md = md_arrays; md < md_arrays + md_narrays; md++)
+    if (! grub_memcmp ((char *) md->uuid, (char *) uuid, 16))
+      break;
+
+  if (md == md_arrays + md_narrays)
+    {
+      if (md_narrays == MD_MAX_ARRAYS)
+	return;
+
+      md_narrays++;
+      grub_memmove (md->uuid, uuid, 16);
+      md->events = events;
+      md->size = size;
+      md->nmembers = 0;
+      md->next = 0;
+    }
+  else if (events < md->events)
+    return;
+  else if (events > md->events)
+    {
+      /* The members found so far are stale.  */
+      md->events = events;
+      md->size = size;
+      md->nmembers = 0;
+    }
+
+  if (md->nmembers == MD_MAX_MEMBERS)
+    return;
+
+  m = &md->members[md->nmembers++];
+  m->drive = drive;
+  m->partition = partition;
+  m->start = start;
+  m->geom = *geom;
+  m->failed = 0;
+}
+
+/* Look for a RAID1 superblock in PARTITION on DRIVE, which is LEN
+   sectors from START.  */
+static void
+md_probe (unsigned long drive, unsigned long partition,
+	  unsigned long start, unsigned long len, struct geometry *geom)
+{
+  unsigned long offsets[4];
+  unsigned char uuid[16];
+  int i;
+
+  if (geom->sector_size != MD_SECTOR_SIZE || len < 2 * MD_SB0_RESERVED)
+    return;
+
+#ifndef GRUB_UTIL
+  /* Pieces of a read may cross tracks, which needs LBA.  */
+  if (! (geom->flags & BIOSDISK_FLAG_LBA_EXTENSION))
+    return;
+#endif
+
+  offsets[0] = (len & ~(MD_SB0_RESERVED - 1)) - MD_SB0_RESERVED;
+  offsets[1] = (len - 16) & ~7;		/* 1.0 */
+  offsets[2] = 0;			/* 1.1 */
+  offsets[3] = 8;			/* 1.2 */
+
+  for (i = 0; i < 4; i++)
+    {
+      if (! md_read_sb (drive, start + offsets[i], 0, sizeof (md_sb), md_sb)
+	  || SB32 (0) != MD_MAGIC)
+	continue;
+
+      if (i == 0 && SB32 (4) == 0)
+	{
+	  unsigned int disk[MD_DISK_SIZE / 4], state;
+
+	  if (SB32 (MD_SB0_LEVEL) != 1
+	      || ! md_read_sb (drive, start + offsets[i], MD_SB0_THIS_DISK,
+			       sizeof (disk), disk))
+	    continue;
+
+	  /* Spares, faulty members and members being rebuilt.  */
+	  state = disk[MD_DISK_STATE / 4];
+	  if ((state & (MD_DISK_FAULTY | MD_DISK_ACTIVE | MD_DISK_SYNC))
+	      != (MD_DISK_ACTIVE | MD_DISK_SYNC)
+	      || disk[MD_DISK_RAID_DISK / 4] >= SB32 (MD_SB0_RAID_DISKS))
+	    continue;
+
+	  grub_memmove (uuid, md_sb + MD_SB0_UUID0, 4);
+	  grub_memmove (uuid + 4, md_sb + MD_SB0_UUID1, 12);
+	  md_add (uuid,
+		  ((unsigned long long) SB32 (MD_SB0_EVENTS_HI) << 32)
+		  | SB32 (MD_SB0_EVENTS_LO),
+		  SB32 (MD_SB0_SIZE) * 2, drive, partition, start, geom);
+	}
+      else if (i > 0 && SB32 (4) == 1
+	       && SB64 (MD_SB1_SUPER_OFFSET) == offsets[i])
+	{
+	  unsigned int role = SB32 (MD_SB1_DEV_NUMBER);
+	  unsigned short role_state;
+
+	  if (SB32 (MD_SB1_LEVEL) != 1
+	      || (SB32 (MD_SB1_FEATURES) & MD_SB1_FEATURE_RECOVERY)
+	      || SB64 (MD_SB1_DATA_OFFSET) + SB64 (MD_SB1_SIZE) > len)
+	    continue;
+
+	  if (role < (MD_SB_SIZE - MD_SB1_DEV_ROLES) / 2
+	      && md_read_sb (drive, start + offsets[i],
+			     MD_SB1_DEV_ROLES + 2 * role, 2, &role_state)
+	      && role_state >= MD_SB1_ROLE_SPARE)
+	    continue;
+
+	  md_add (md_sb + MD_SB1_UUID, SB64 (MD_SB1_EVENTS),
+		  SB64 (MD_SB1_SIZE), drive, partition,
+		  start + SB64 (MD_SB1_DATA_OFFSET), geom);
+	}
+
+      /* One device has one superblock.  */
+      return;
+    }
+}
+
+/* Find the RAID1 arrays on all hard disks, and return how many there
+   are.  In a task, let GRUB go on after each disk.  */
+static int
+md_scan_drives (void)
+{
+  unsigned long drive;
+  unsigned long old_drive = current_drive;
+
+  md_narrays = 0;
+
+  for (drive = 0x80; drive < 0x80 + MAX_HD_NUM; drive++)
+    {
+      unsigned long part = 0xFFFFFF;
+      unsigned long start, len, offset, ext_offset, gpt_offset;
+      int type, entry, gpt_count, gpt_size, found = 0;
+      struct geometry geom;
+
+      /* Members have 512-byte sectors, and one fits in SCRATCHADDR,
+	 which nothing else uses until we yield.  */
+      if (get_diskinfo (drive, &geom)
+	  || geom.sector_size != MD_SECTOR_SIZE)
+	continue;
+
+      /* rawread takes the sector size from the current drive.  */
+      current_drive = drive;
+
+      while (next_partition (drive, 0xFFFFFF, &part, &type,
+			     &start, &len, &offset, &entry,
+			     &ext_offset, &gpt_offset,
+			     &gpt_count, &gpt_size, (char *) SCRATCHADDR))
+	{
+	  if (type != PC_SLICE_TYPE_NONE
+	      && ! IS_PC_SLICE_TYPE_BSD (type)
+	      && ! IS_PC_SLICE_TYPE_EXTENDED (type))
+	    {
+	      md_probe (drive, part, start, len, &geom);
+	      found = 1;
+	    }
+
+	  errnum = ERR_NONE;
+	}
+
+      /* Whole disks are members only if they are not partitioned.  */
+      errnum = ERR_NONE;
+      if (! found)
+	md_probe (drive, 0xFFFFFF, 0, geom.total_sectors, &geom);
+
+      task_yield ();
+    }
+
+  current_drive = old_drive;
+  errnum = ERR_NONE;
+  return md_narrays;
+}
+
+static void
+md_scan_task (void)
+{
+  md_scan_drives ();
+}
+
+/* Look for the arrays while GRUB waits for input, so that they are
+   likely known by the time they are needed.  */
+void
+md_scan_background (void)
+{
+  if (md_narrays < 0 && md_task < 0)
+    md_task = task_spawn (md_scan_task);
+}
+
+int
+md_scan (void)
+{
+  /* Finish any scan in the background first, as both would fill in
+     the same arrays.  */
+  task_wait (md_task);
+  md_task = -1;
+
+  return md_scan_drives ();
+}
+
+static struct md_array *
+md_get (int drive)
+{
+  task_wait (md_task);
+  md_task = -1;
+
+  if (md_narrays < 0)
+    md_scan ();
+
+  if (drive - MD_DRIVE >= md_narrays)
+    return 0;
+
+  return &md_arrays[drive - MD_DRIVE];
+}
+
+/* Print the arrays found and their members.  */
+void
+md_print (void)
+{
+  int i, j;
+
+  for (i = 0; i < md_narrays; i++)
+    {
+      struct md_array *md = &md_arrays[i];
+
+      grub_printf (" (md%d): %d sectors on", i, (int) md->size);
+      for (j = 0; j < md->nmembers; j++)
+	{
+	  struct md_member *m = &md->members[j];
+
+	  grub_printf (" (hd%d", (int) m->drive - 0x80);
+	  if ((m->partition & 0xFF0000) != 0xFF0000)
+	    grub_printf (",%d", (int) (m->partition >> 16) & 0xFF);
+	  grub_printf (m->failed ? ") (failed)" : ")");
+	}
+      grub_printf ("\n");
+    }
+}
+
+int
+md_get_diskinfo (int drive, struct geometry *geometry)
+{
+  struct md_array *md = md_get (drive);
+
+  if (! md || ! md->nmembers)
+    return 1;
+
+  geometry->total_sectors = md->size;
+  geometry->sector_size = MD_SECTOR_SIZE;
+  geometry->flags = BIOSDISK_FLAG_LBA_EXTENSION;
+  geometry->sectors = 63;
+  geometry->heads = 255;
+  geometry->cylinders = md->size / 63 / 255;
+  return 0;
+}
+
+/* Read NSEC sectors from SECTOR of the array MD into SEGMENT, from the
+   member NEXT if it works and otherwise from any that does.  */
+static int
+md_read_piece (struct md_array *md, int next, int sector, int nsec,
+	       int segment)
+{
+  struct iostat *st = iostat_get (IOSTAT_DISK, MD_DRIVE + (md - md_arrays));
+  int i, err = -1;
+
+  for (i = 0; i < md->nmembers; i++)
+    {
+      struct md_member *m = &md->members[(next + i) % md->nmembers];
+      struct iostat *mst;
+      unsigned long long start;
+
+      if (m->failed)
+	continue;
+
+      mst = iostat_get (IOSTAT_DISK, m->drive);
+      start = iostat_clock ();
+      err = biosdisk (BIOSDISK_READ, m->drive, &m->geom,
+		      m->start + sector, nsec, segment);
+      iostat_done (mst, start, nsec, nsec * MD_SECTOR_SIZE, err);
+      if (! err)
+	return 0;
+
+      /* Try the next member.  */
+      m->failed = 1;
+      if (st)
+	st->retries++;
+    }
+
+  return err;
+}
+
+int
+md_biosdisk (int subfunc, int drive, struct geometry *geometry,
+	     int sector, int nsec, int segment)
+{
+  struct md_array *md = md_get (drive);
+  int i, pieces, len, err, written = 0;
+
+  if (! md || ! md->nmembers
+      || sector < 0 || sector + nsec > md->size)
+    return BIOSDISK_ERROR_GEOMETRY;
+
+  if (subfunc == BIOSDISK_WRITE)
+    {
+      /* Keep all copies the same.  */
+      for (i = 0; i < md->nmembers; i++)
+	{
+	  struct md_member *m = &md->members[i];
+
+	  if (! m->failed
+	      && ! biosdisk (BIOSDISK_WRITE, m->drive, &m->geom,
+			     m->start + sector, nsec, segment))
+	    written++;
+	}
+
+      return written ? 0 : -1;
+    }
+
+  /* One piece per member, but not too small ones, and the first piece
+     from the member after the one that started the last read, so that
+     small reads are spread too.  */
+  pieces = (nsec + MD_PIECE - 1) / MD_PIECE;
+  if (pieces > md->nmembers)
+    pieces = md->nmembers;
+  len = (nsec + pieces - 1) / pieces;
+
+  for (i = 0; nsec > 0; i++)
+    {
+      if (len > nsec)
+	len = nsec;
+
+      err = md_read_piece (md, md->next + i, sector, len, segment);
+      if (err)
+	return err;
+
+      sector += len;
+      nsec -= len;
+      segment += (len * MD_SECTOR_SIZE) >> 4;
+    }
+
+  md->next = (md->next + 1) % md->nmembers;
+  return 0;
+}
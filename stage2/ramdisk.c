@@ -0,0 +1,250 @@
+/* ramdisk.c - a drive served from an image loaded into memory */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2004  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* The command ramdisk loads a disk image, decompressing it if it is
+   gzipped, and the drive (rd) then reads and writes that copy.  An
+   image with a partition table is a hard disk, with its partitions as
+   (rd,0) and so on, and an image of a floppy or of a lone filesystem
+   is a floppy, because GRUB only mounts the whole of a floppy.
+
+   On a PC the image goes at the top of the upper memory, which is then
+   lowered to keep GRUB and the kernels it loads out of it.  The int13
+   handler serves the image to chain-loaded systems as well, and its
+   int15 handler hides the memory from them.  On EFI the image is in
+   pages from the firmware.  */
+
+#include <shared.h>
+#include "efistubs.h"
+
+#define RD_SECTOR_SIZE	512
+
+/* The number of the drive (rd), RD_DRIVE or RD_FLOPPY_DRIVE.  */
+int rd_drive = RD_DRIVE;
+
+static char *rd_image;
+static unsigned long rd_sectors;
+static struct geometry rd_geom;
+
+#ifndef PLATFORM_EFI
+/* The upper memory before the image was put at its top.  */
+static unsigned long rd_old_mem_upper;
+#endif
+
+/* The geometries of floppy images, by their size.  Anything else is
+   taken for a hard disk.  */
+static struct
+{
+  unsigned long sectors;
+  int heads;
+  int spt;
+}
+rd_floppies[] =
+{
+  { 720, 2, 9 },
+  { 1440, 2, 9 },
+  { 2400, 2, 15 },
+  { 2880, 2, 18 },
+  { 5760, 2, 36 },
+};
+
+static void
+rd_unload (void)
+{
+  if (! rd_image)
+    return;
+
+#ifdef PLATFORM_EFI
+  grub_efidisk_ramdisk_buffer (0);
+#else
+  mbi.mem_upper = saved_mem_upper = rd_old_mem_upper;
+#endif
+
+  rd_image = 0;
+  rd_sectors = 0;
+  if (RD_DRIVE_P (buf_drive))
+    buf_drive = -1;
+  dentry_cache_flush ();
+}
+
+static void
+rd_set_geometry (void)
+{
+  unsigned int i;
+
+  rd_geom.heads = 255;
+  rd_geom.sectors = 63;
+  for (i = 0; i < sizeof (rd_floppies) / sizeof (rd_floppies[0]); i++)
+    if (rd_floppies[i].sectors == rd_sectors)
+      {
+	rd_geom.heads = rd_floppies[i].heads;
+	rd_geom.sectors = rd_floppies[i].spt;
+      }
+
+  rd_geom.cylinders = rd_sectors / (rd_geom.heads * rd_geom.sectors);
+  if (! rd_geom.cylinders)
+    rd_geom.cylinders = 1;
+  rd_geom.total_sectors = rd_sectors;
+  rd_geom.sector_size = RD_SECTOR_SIZE;
+  rd_geom.flags = BIOSDISK_FLAG_LBA_EXTENSION;
+}
+
+
+/* Load FILE as the RAM disk, in place of any loaded before.  */
+int
+rd_load (char *file)
+{
+  unsigned long size;
+  char *image;
+
+  rd_unload ();
+
+  if (! grub_open (file))
+    return 0;
+
+  size = (filemax + RD_SECTOR_SIZE - 1) & ~(RD_SECTOR_SIZE - 1);
+  if (! size)
+    {
+      grub_close ();
+      errnum = ERR_FILELENGTH;
+      return 0;
+    }
+
+#ifdef PLATFORM_EFI
+  image = grub_efidisk_ramdisk_buffer (size);
+  if (! image)
+    {
+      grub_close ();
+      errnum = ERR_WONT_FIT;
+      return 0;
+    }
+  rd_image = image;
+  grub_memset (image + size - RD_SECTOR_SIZE, 0, RD_SECTOR_SIZE);
+  grub_read (image, -1);
+#else
+  {
+    unsigned long addr;
+    int len, n;
+
+    /* Leave at least half of the upper memory for the rest.  */
+    if (size > (mbi.mem_upper << 10) / 2)
+      {
+	grub_close ();
+	errnum = ERR_WONT_FIT;
+	return 0;
+      }
+
+    addr = (((mbi.mem_upper + 0x400) << 10) - size) & ~0xfff;
+    image = (char *) RAW_ADDR (addr);
+    rd_image = image;
+    rd_old_mem_upper = mbi.mem_upper;
+    grub_memset (image + size - RD_SECTOR_SIZE, 0, RD_SECTOR_SIZE);
+
+    /* The decompressor allocates from the top of the upper memory, so
+       a compressed file is read once that has been lowered below the
+       image.  GRUB refuses to write above it then: copy the data
+       through the scratch area.  */
+    if (! compressed_file)
+      grub_read (image, -1);
+
+    mbi.mem_upper = saved_mem_upper = (addr >> 10) - 0x400;
+
+    if (compressed_file)
+      for (len = 0; (n = grub_read ((char *) SCRATCHADDR, 0x200)) > 0;
+	   len += n)
+	grub_memcpy (image + len, (char *) SCRATCHADDR, n);
+  }
+#endif
+
+  grub_close ();
+  if (errnum)
+    {
+      rd_unload ();
+      return 0;
+    }
+
+  rd_sectors = size / RD_SECTOR_SIZE;
+  rd_set_geometry ();
+  rd_drive = RD_FLOPPY_DRIVE;
+  if (rd_geom.heads == 255 && has_partition_table (rd_image))
+    rd_drive = RD_DRIVE;
+
+  return 1;
+}
+
+void
+rd_print (void)
+{
+  if (! rd_image)
+    {
+      grub_printf (" No RAM disk is loaded.\n");
+      return;
+    }
+
+  grub_printf (" (rd): %s, %lu sectors (%lu KB), %lu heads,"
+	       " %lu sectors per track\n",
+	       rd_drive == RD_DRIVE ? "hard disk" : "floppy",
+	       rd_sectors, rd_sectors / 2, rd_geom.heads, rd_geom.sectors);
+}
+
+/* Fill PARAMS for the int13 handler.  Return zero if there is no RAM
+   disk.  */
+int
+rd_get_params (struct rd_params *params)
+{
+  if (! rd_image)
+    return 0;
+
+  params->addr = (unsigned long) rd_image;
+  params->sectors = rd_sectors;
+  params->heads = rd_geom.heads;
+  params->spt = rd_geom.sectors;
+  params->drive = rd_drive;
+  return 1;
+}
+
+int
+rd_get_diskinfo (int drive, struct geometry *geometry)
+{
+  if (! rd_image || drive != rd_drive)
+    return -1;
+
+  *geometry = rd_geom;
+  return 0;
+}
+
+int
+rd_biosdisk (int subfunc, int drive, struct geometry *geometry,
+	     int sector, int nsec, int segment)
+{
+  char *buf = (char *) ((unsigned long) segment << 4);
+  char *image = rd_image + (unsigned long) sector * RD_SECTOR_SIZE;
+
+  if (! rd_image || drive != rd_drive || sector < 0 || sector + nsec > rd_sectors)
+    return BIOSDISK_ERROR_GEOMETRY;
+
+  /* The image is above the upper memory on a PC, where grub_memmove
+     refuses to write.  */
+  if (subfunc == BIOSDISK_WRITE)
+    grub_memcpy (image, buf, nsec * RD_SECTOR_SIZE);
+  else
+    grub_memmove (buf, image, nsec * RD_SECTOR_SIZE);
+
+  return 0;
+}
@@ -129,6 +129,21 @@ extern void *grub_scratch_mem;
 #define MENU_BUF		(UNIQUE_BUF + UNIQUE_BUFLEN)
 #define MENU_BUFLEN		(0x8000 + PASSWORD_BUF - MENU_BUF)
 
+/* Low memory from here up to LINUX_OLD_REAL_MODE_ADDR is not used while
+   Stage 2 runs, so it holds buffers too large for the Stage 2 image.  */
+
+/* The descriptor rings and packet buffers of the network card.  */
+#define NIC_BUF			RAW_ADDR (0x80000)
+#define NIC_BUFLEN		0x8000
+
+/* The stacks of background tasks.  */
+#define TASK_STACK_BUF		RAW_ADDR (0x88000)
+#define TASK_STACK_BUFLEN	0x4000
+
+/* The datagram being put together from IP fragments.  */
+#define IP_REASM_BUF		RAW_ADDR (0x8C000)
+#define IP_REASM_BUFLEN		0x4000
+
 /* The size of the drive map.  */
 #define DRIVE_MAP_SIZE		128
 
@@ -191,6 +206,29 @@ extern void *grub_scratch_mem;
 /* Not bad, perhaps.  */
 #define NETWORK_DRIVE	0x20
 
+/* The RAID1 arrays (md0) to (md3), read through all of their members.  */
+#define MD_DRIVE	0x40
+#define MD_MAX_ARRAYS	4
+#define MD_DRIVE_P(drive) \
+  ((drive) >= MD_DRIVE && (drive) < MD_DRIVE + MD_MAX_ARRAYS)
+
+/* The RAM disk (rd), an image loaded into memory.  It is a hard disk
+   when the image has a partition table, and a floppy otherwise, since
+   GRUB only looks for a filesystem on the whole of a floppy.  */
+#define RD_DRIVE	0xFE
+#define RD_FLOPPY_DRIVE	0x7F
+#define RD_DRIVE_P(drive) \
+  ((drive) == RD_DRIVE || (drive) == RD_FLOPPY_DRIVE)
+
+/* The loopback drives (ld0) to (ld3), files read where they are on
+   their drives.  Like (rd), each is a hard disk or a floppy.  */
+#define LD_DRIVE	0xF0
+#define LD_FLOPPY_DRIVE	0x70
+#define LD_MAX_DEVICES	4
+#define LD_DRIVE_P(drive) \
+  (((drive) & 0x7F) >= LD_FLOPPY_DRIVE \
+   && ((drive) & 0x7F) < LD_FLOPPY_DRIVE + LD_MAX_DEVICES)
+
 /*
  *  GRUB specific information
  *    (in LSB order)
@@ -605,6 +643,10 @@ extern char *device_map_file;
 extern struct geometry *disks;
 /* Assign DRIVE to a device name DEVICE.  */
 extern void assign_device_name (int drive, const char *device);
+/* Run FUNC (DATA) in a child process.  */
+extern int job_start (int (*func) (void *), void *data);
+/* Wait for a child process started by job_start.  */
+extern int job_wait (int *status);
 #endif
 
 #ifndef STAGE1_5
@@ -644,6 +686,7 @@ extern int compressed_file;
 /* instrumentation variables */
 extern void (*disk_read_hook) (int, int, int);
 extern void (*disk_read_func) (int, int, int);
+extern int disk_read_map_only;
 
 #ifndef STAGE1_5
 /* The flag for debug mode.  */
@@ -691,6 +734,54 @@ extern int buf_drive;
 extern int buf_track;
 extern struct geometry buf_geom;
 
+#ifndef STAGE1_5
+/* Sequential read-ahead in rawread.  */
+struct readahead_stats
+{
+  int fills;			/* windows read from the disk */
+  int sectors;			/* sectors read into them */
+  int hits;			/* reads served from a window */
+  int collapses;		/* streams broken by a random read */
+};
+
+extern int readahead_max;
+extern int readahead_window;
+extern struct readahead_stats readahead_stats;
+
+/* I/O counters, kept per drive and per network server.  */
+#define IOSTAT_DISK	0
+#define IOSTAT_SERVER	1
+
+/* Latencies are counted by the log2 of the time stamp counter cycles
+   they took.  */
+#define IOSTAT_BUCKETS	40
+
+struct iostat
+{
+  int kind;			/* IOSTAT_DISK or IOSTAT_SERVER */
+  unsigned long id;		/* the drive, or the server's IP address */
+  unsigned long requests;	/* reads sent to the device */
+  unsigned long sectors;
+  unsigned long long bytes;
+  unsigned long hits;		/* reads served from a buffer */
+  unsigned long misses;		/* reads that went to the device */
+  unsigned long retries;
+  unsigned long errors;
+  unsigned long latency[IOSTAT_BUCKETS];
+#ifdef GRUB_UTIL
+  unsigned long long modeled;	/* microseconds of slow media modeled */
+#endif
+};
+
+unsigned long long iostat_clock (void);
+struct iostat *iostat_get (int kind, unsigned long id);
+void iostat_done (struct iostat *st, unsigned long long start,
+		  unsigned long sectors, unsigned long bytes, int err);
+void iostat_print (void);
+void iostat_reset (void);
+unsigned long iostat_microseconds (unsigned long long cycles);
+#endif /* ! STAGE1_5 */
+
 /* these are the current file position and maximum file position */
 extern int filepos;
 extern int filemax;
@@ -736,8 +827,19 @@ void grub_reboot (void) __attribute__ ((noreturn));
    APM even if it is available.  */
 void grub_halt (int no_apm) __attribute__ ((noreturn));
 
-/* Copy MAP to the drive map and set up int13_handler.  */
-void set_int13_handler (unsigned short *map);
+/* The RAM disk as the int13 handler serves it.  */
+struct rd_params
+{
+  unsigned int addr;
+  unsigned int sectors;
+  unsigned int heads;
+  unsigned int spt;
+  unsigned int drive;
+};
+
+/* Copy MAP to the drive map and set up int13_handler, which also
+   serves the RAM disk RD and hides its memory, if RD is not NULL.  */
+void set_int13_handler (unsigned short *map, struct rd_params *rd);
 
 /* Set up int15_handler.  */
 void set_int15_handler (void);
@@ -809,6 +911,19 @@ int get_code_end (void);
 int getrtsecs (void);
 int currticks (void);
 
+/* Wait until an input event or the next timer tick, to avoid burning
+   the CPU in polling loops.  */
+void grub_idle (void);
+
+#ifndef STAGE1_5
+/* Background tasks, which run while GRUB waits for input.  */
+int task_spawn (void (*func) (void));
+void task_yield (void);
+int task_run (void);
+void task_wait (int task);
+void task_idle (void);
+#endif
+
 /* Clear the screen. */
 void cls (void);
 
@@ -847,6 +962,33 @@ void stop_floppy (void);
 int get_sector_size (int drive);
 int get_sector_bits (int drive);
 
+#ifndef STAGE1_5
+/* Linux md RAID1 arrays.  */
+int md_scan (void);
+void md_scan_background (void);
+void md_print (void);
+int md_get_diskinfo (int drive, struct geometry *geometry);
+int md_biosdisk (int subfunc, int drive, struct geometry *geometry,
+		 int sector, int nsec, int segment);
+
+/* The RAM disk.  */
+extern int rd_drive;
+int rd_load (char *file);
+void rd_print (void);
+int rd_get_params (struct rd_params *params);
+int rd_get_diskinfo (int drive, struct geometry *geometry);
+int rd_biosdisk (int subfunc, int drive, struct geometry *geometry,
+		 int sector, int nsec, int segment);
+
+/* The loopback drives.  */
+extern int ld_drives[LD_MAX_DEVICES];
+int ld_setup (int num, char *file);
+void ld_print (void);
+int ld_get_diskinfo (int drive, struct geometry *geometry);
+int ld_biosdisk (int subfunc, int drive, struct geometry *geometry,
+		 int sector, int nsec, int segment);
+#endif
+
 /* Command-line interface functions. */
 #ifndef STAGE1_5
 
@@ -892,6 +1034,7 @@ kernel_t;
 extern kernel_t kernel_type;
 extern int show_menu;
 extern int grub_timeout;
+extern int lazy_menu;
 
 void init_builtins (void);
 void init_config (void);
@@ -974,12 +1117,15 @@ void grub_putstr (const char *str);
 /* Compression support. */
 int gunzip_test_header (void);
 int gunzip_read (char *buf, int len);
+unsigned int gunzip_stored_crc (void);
+unsigned int gunzip_crc32 (unsigned int crc, const char *buf, int len);
 #endif /* NO_DECOMPRESSION */
 
 int rawread (int drive, int sector, int byte_offset, int byte_len, char *buf);
 int devread (int sector, int byte_offset, int byte_len, char *buf);
-int rawwrite (int drive, int sector, char *buf);
+int rawwrite (int drive, int sector, int sector_count, char *buf);
 int devwrite (int sector, int sector_len, char *buf);
+void dentry_cache_flush (void);
 
 /* Parse a device string and initialize the global parameters. */
 char *set_device (char *device);
@@ -994,6 +1140,9 @@ int next_partition (unsigned long drive, unsigned long dest,
                    unsigned long *gpt_offset, int *gpt_count,
                    int *gpt_size, char *buf);
 
+/* Tell whether the sector MBR holds a PC partition table.  */
+int has_partition_table (char *mbr);
+
 /* Sets device to the one represented by the SAVED_* parameters. */
 int make_saved_active (void);
 
@@ -1059,6 +1208,9 @@ void grub_set_config_file (char *path_name);
 int grub_save_saved_default (int new_default);
 extern int check_device (const char *device);
 extern void assign_device_name (int drive, const char *device);
+int grub_efi_profile_start (int hz);
+void grub_efi_profile_stop (void);
+void grub_efi_profile_dump (int count);
 #endif
 int grub_load_linux (char *kernel, char *arg);
 int grub_load_initrd (char *initrd);
@@ -95,6 +95,42 @@ get_entry (char *list, int num, int nested)
   return list;
 }
 
+/* Fill INDEX with where each of the NUM entries in LIST starts, and
+   INDEX[NUM] with where the list ends, so that the menu can get to any
+   entry without walking the list with get_entry.  */
+static void
+index_entries (char **index, char *list, int num, int nested)
+{
+  int i;
+
+  for (i = 0; i < num; i++)
+    {
+      index[i] = list;
+      do
+	{
+	  while (*(list++));
+	}
+      while (nested && *(list++));
+    }
+
+  index[num] = list;
+}
+
+/* Where the menu keeps its index: past the space above HEAP that the
+   menu editor uses.  It must be made again whenever the list or the
+   heap may have changed.  */
+#define MENU_INDEX(heap) \
+  ((char **) (((unsigned long) (heap) + 2 * (NEW_HEAPSIZE + 1) \
+	       + sizeof (char *) - 1) & ~(sizeof (char *) - 1)))
+
+/* The first character of the placeholder stored in the config area
+   instead of the commands of an entry when the command `lazymenu' is
+   used. It is followed by the offset of the commands in the
+   configuration file, in decimal.  */
+#define LAZY_ENTRY_MAGIC	'\001'
+
+static char *load_config_entry (char *entry, char **heap);
+
 /* Print an entry in a line of the menu box.  */
 static void
 print_entry (int y, int highlight, char *entry)
@@ -129,7 +165,8 @@ print_entry (int y, int highlight, char *entry)
 
 /* Print entries in the menu box.  */
 static void
-print_entries (int y, int size, int first, int entryno, char *menu_entries)
+print_entries (int y, int size, int first, int entryno, char **index,
+	       int num_entries)
 {
   int i;
   
@@ -140,22 +177,13 @@ print_entries (int y, int size, int first, int entryno, char *menu_entries)
   else
     grub_putchar (' ');
 
-  menu_entries = get_entry (menu_entries, first, 0);
-
   for (i = 0; i < size; i++)
-    {
-      print_entry (y + i + 1, entryno == i, menu_entries);
-
-      while (*menu_entries)
-	menu_entries++;
-
-      if (*(menu_entries - 1))
-	menu_entries++;
-    }
+    print_entry (y + i + 1, entryno == i,
+		 first + i < num_entries ? index[first + i] : "");
 
   gotoxy (77, y + size);
 
-  if (*menu_entries)
+  if (first + size < num_entries)
     grub_putchar (DISP_DOWN);
   else
     grub_putchar (' ');
@@ -164,7 +192,7 @@ print_entries (int y, int size, int first, int entryno, char *menu_entries)
 }
 
 static void
-print_entries_raw (int size, int first, char *menu_entries)
+print_entries_raw (int size, int first, char **index)
 {
   int i;
 
@@ -179,7 +207,7 @@ print_entries_raw (int size, int first, char *menu_entries)
       /* grub's printf can't %02d so ... */
       if (i < 10)
 	grub_putchar (' ');
-      grub_printf ("%d: %s\n", i, get_entry (menu_entries, i, 0));
+      grub_printf ("%d: %s\n", i, index[i]);
     }
 
   for (i = 0; i < LINE_LENGTH; i++)
@@ -235,6 +263,7 @@ run_menu (char *menu_entries, char *config_entries, int num_entries,
 {
   int c, time1, time2 = -1, first_entry = 0;
   char *cur_entry = 0;
+  char **menu_index, **config_index;
   struct term_entry *prev_term = NULL;
 
   if (grub_verbose)
@@ -245,6 +274,12 @@ run_menu (char *menu_entries, char *config_entries, int num_entries,
    */
 
 restart:
+  menu_index = MENU_INDEX (heap);
+  index_entries (menu_index, menu_entries, num_entries, 0);
+  config_index = menu_index + num_entries + 1;
+  if (config_entries)
+    index_entries (config_index, config_entries, num_entries, 1);
+
   /* Dumb terminal always use all entries for display 
      invariant for TERM_DUMB: first_entry == 0  */
   if (! (current_term->flags & TERM_DUMB))
@@ -310,9 +345,11 @@ restart:
 	      /* Print a message.  */
 	      if (print_message)
 		grub_printf ("\rBooting %s in %d seconds...",
-		             get_entry(menu_entries, first_entry + entryno, 0),
+		             menu_index[first_entry + entryno],
 		             grub_timeout);
 	    }
+
+	  task_idle ();
 	}
     }
 
@@ -323,7 +360,7 @@ restart:
       setcursor (0);
 
       if (current_term->flags & TERM_DUMB)
-	print_entries_raw (num_entries, first_entry, menu_entries);
+	print_entries_raw (num_entries, first_entry, menu_index);
       else
 	print_border (3, 12);
 
@@ -355,7 +392,7 @@ restart:
       if (current_term->flags & TERM_DUMB)
 	grub_printf ("\n\nThe selected entry is %d ", entryno);
       else
-	print_entries (3, 12, first_entry, entryno, menu_entries);
+	print_entries (3, 12, first_entry, entryno, menu_index, num_entries);
     }
 
   /* XX using RT clock now, need to initialize value */
@@ -433,20 +470,16 @@ restart:
 		  if (entryno > 0)
 		    {
 		      print_entry (4 + entryno, 0,
-				   get_entry (menu_entries,
-					      first_entry + entryno,
-					      0));
+				   menu_index[first_entry + entryno]);
 		      entryno--;
 		      print_entry (4 + entryno, 1,
-				   get_entry (menu_entries,
-					      first_entry + entryno,
-					      0));
+				   menu_index[first_entry + entryno]);
 		    }
 		  else if (first_entry > 0)
 		    {
 		      first_entry--;
-		      print_entries (3, 12, first_entry, entryno,
-				     menu_entries);
+		      print_entries (3, 12, first_entry, entryno, menu_index,
+				     num_entries);
 		    }
 		}
 	    }
@@ -460,19 +493,16 @@ restart:
 		  if (entryno < 11)
 		    {
 		      print_entry (4 + entryno, 0,
-				   get_entry (menu_entries,
-					      first_entry + entryno,
-					      0));
+				   menu_index[first_entry + entryno]);
 		      entryno++;
 		      print_entry (4 + entryno, 1,
-				   get_entry (menu_entries,
-					      first_entry + entryno,
-					      0));
+				   menu_index[first_entry + entryno]);
 		  }
 		else if (num_entries > 12 + first_entry)
 		  {
 		    first_entry++;
-		    print_entries (3, 12, first_entry, entryno, menu_entries);
+		    print_entries (3, 12, first_entry, entryno, menu_index,
+				   num_entries);
 		  }
 		}
 	    }
@@ -487,7 +517,8 @@ restart:
 		  if (entryno < 0)
 		    entryno = 0;
 		}
-	      print_entries (3, 12, first_entry, entryno, menu_entries);
+	      print_entries (3, 12, first_entry, entryno, menu_index,
+			     num_entries);
 	    }
 	  else if (c == 3)
 	    {
@@ -500,7 +531,8 @@ restart:
 		    first_entry = 0;
 		  entryno = num_entries - first_entry - 1;
 		}
-	      print_entries (3, 12, first_entry, entryno, menu_entries);
+	      print_entries (3, 12, first_entry, entryno, menu_index,
+			     num_entries);
 	    }
 
 	  if (config_entries)
@@ -514,9 +546,7 @@ restart:
 		{
 		  if (! (current_term->flags & TERM_DUMB))
 		    print_entry (4 + entryno, 0,
-				 get_entry (menu_entries,
-					    first_entry + entryno,
-					    0));
+				 menu_index[first_entry + entryno]);
 
 		  /* insert after is almost exactly like insert before */
 		  if (c == 'o')
@@ -531,9 +561,7 @@ restart:
 		      c = 'O';
 		    }
 
-		  cur_entry = get_entry (menu_entries,
-					 first_entry + entryno,
-					 0);
+		  cur_entry = menu_index[first_entry + entryno];
 
 		  if (c == 'O')
 		    {
@@ -549,9 +577,7 @@ restart:
 		    }
 		  else if (num_entries > 0)
 		    {
-		      char *ptr = get_entry(menu_entries,
-					    first_entry + entryno + 1,
-					    0);
+		      char *ptr = menu_index[first_entry + entryno + 1];
 
 		      grub_memmove (cur_entry, ptr,
 				    heap - ptr);
@@ -565,15 +591,18 @@ restart:
 			first_entry--;
 		    }
 
+		  menu_index = MENU_INDEX (heap);
+		  index_entries (menu_index, menu_entries, num_entries, 0);
+
 		  if (current_term->flags & TERM_DUMB)
 		    {
 		      grub_printf ("\n\n");
-		      print_entries_raw (num_entries, first_entry,
-					 menu_entries);
+		      print_entries_raw (num_entries, first_entry, menu_index);
 		      grub_printf ("\n");
 		    }
 		  else
-		    print_entries (3, 12, first_entry, entryno, menu_entries);
+		    print_entries (3, 12, first_entry, entryno, menu_index,
+				   num_entries);
 		}
 
 	      cur_entry = menu_entries;
@@ -650,17 +679,16 @@ restart:
 		  if (config_entries)
 		    {
 		      new_heap = heap;
-		      cur_entry = get_entry (config_entries,
-					     first_entry + entryno,
-					     1);
+		      cur_entry = load_config_entry (config_index[first_entry
+								  + entryno],
+						     &new_heap);
+		      new_heap = heap;
 		    }
 		  else
 		    {
 		      /* safe area! */
 		      new_heap = heap + NEW_HEAPSIZE + 1;
-		      cur_entry = get_entry (menu_entries,
-					     first_entry + entryno,
-					     0);
+		      cur_entry = menu_index[first_entry + entryno];
 		    }
 
 		  do
@@ -732,8 +760,10 @@ restart:
 		  char * start;
 
 		  entry_copy = new_heap = heap;
-		  cur_entry = get_entry (config_entries, first_entry + entryno,
-					 1);
+		  cur_entry = load_config_entry (config_index[first_entry
+							      + entryno],
+						 &new_heap);
+		  new_heap = heap;
 		  
 		  do
 		    {
@@ -822,6 +852,9 @@ restart:
 #endif
 	    }
 	}
+      else
+	/* No key yet, so sleep until something happens.  */
+	task_idle ();
     }
   
   /* Attempt to boot an entry.  */
@@ -848,6 +881,8 @@ restart:
   
   while (1)
     {
+      char *script_heap = heap;
+
       if (config_entries)
 	verbose_printf ("  Booting \'%s\'\n\n",
 		get_entry (menu_entries, first_entry + entryno, 0));
@@ -855,12 +890,14 @@ restart:
 	verbose_printf ("  Booting command-list\n\n");
 
       if (! cur_entry)
-	cur_entry = get_entry (config_entries, first_entry + entryno, 1);
+	cur_entry = load_config_entry (get_entry (config_entries,
+						  first_entry + entryno, 1),
+				       &script_heap);
 
       /* Set CURRENT_ENTRYNO for the command "savedefault".  */
       current_entryno = first_entry + entryno;
       
-      if (run_script (cur_entry, heap))
+      if (run_script (cur_entry, script_heap))
 	{
 	  if (fallback_entryno >= 0)
 	    {
@@ -891,24 +928,64 @@ restart:
 }
 
 
+/* The buffer for reading the configuration file. Calling grub_read
+   for every byte is slow, since each call goes down to the filesystem
+   driver.  */
+#define CONFIG_READ_BUFLEN	512
+static char config_read_buf[CONFIG_READ_BUFLEN];
+static int config_read_pos;
+static int config_read_len;
+/* The offset in the configuration file of the next byte returned by
+   read_config_char.  */
+static int config_offset;
+
+/* The drive and the partition on which the configuration file was
+   opened, to read the entries indexed by the lazy menu parser.  */
+static unsigned long config_drive;
+static unsigned long config_partition;
+
+/* Make the next read start at OFFSET in the configuration file, which
+   must be the current file position.  */
+static void
+reset_config_reader (int offset)
+{
+  config_read_pos = 0;
+  config_read_len = 0;
+  config_offset = offset;
+}
+
+static int
+read_config_char (char *c, int read_from_file)
+{
+  if (! read_from_file)
+    return read_from_preset_menu (c, 1);
+
+  if (config_read_pos == config_read_len)
+    {
+      config_read_pos = 0;
+      config_read_len = grub_read (config_read_buf, CONFIG_READ_BUFLEN);
+      if (config_read_len <= 0)
+	{
+	  config_read_len = 0;
+	  return 0;
+	}
+    }
+
+  *c = config_read_buf[config_read_pos++];
+  config_offset++;
+  return 1;
+}
+
 static int
 get_line_from_config (char *cmdline, int maxlen, int read_from_file)
 {
   int pos = 0, literal = 0, comment = 0;
-  char c;  /* since we're loading it a byte at a time! */
+  char c;
   
   while (1)
     {
-      if (read_from_file)
-	{
-	  if (! grub_read (&c, 1))
-	    break;
-	}
-      else
-	{
-	  if (! read_from_preset_menu (&c, 1))
-	    break;
-	}
+      if (! read_config_char (&c, read_from_file))
+	break;
 
       /* Skip all carriage returns.  */
       if (c == '\r')
@@ -965,6 +1042,63 @@ get_line_from_config (char *cmdline, int maxlen, int read_from_file)
   return pos;
 }
 
+/* Return the commands of ENTRY in the config area. If ENTRY is only a
+   placeholder recorded by the lazy menu parser, read the commands from
+   the configuration file into *HEAP first, and advance *HEAP past
+   them.  */
+static char *
+load_config_entry (char *entry, char **heap)
+{
+  unsigned long old_drive = saved_drive;
+  unsigned long old_partition = saved_partition;
+  char *ptr = entry + 1;
+  char *start = *heap;
+  int offset = 0;
+
+  if (*entry != LAZY_ENTRY_MAGIC)
+    return entry;
+
+  safe_parse_maxint (&ptr, &offset);
+
+  /* The commands of the previous entry may have changed the root
+     device, so use the device the menu was read from.  */
+  saved_drive = config_drive;
+  saved_partition = config_partition;
+
+  ptr = start;
+  if (grub_open (config_file))
+    {
+      grub_seek (offset);
+      reset_config_reader (offset);
+
+      while (get_line_from_config (ptr, NEW_HEAPSIZE, 1))
+	{
+	  struct builtin *builtin = find_command (ptr);
+
+	  if (! builtin)
+	    continue;
+
+	  if (builtin->flags & BUILTIN_TITLE)
+	    break;
+
+	  while (*ptr++)
+	    ;
+	}
+
+      grub_close ();
+    }
+
+  print_error ();
+  errnum = ERR_NONE;
+
+  saved_drive = old_drive;
+  saved_partition = old_partition;
+
+  *ptr++ = 0;
+  *heap = ptr;
+  return start;
+}
+
 
 /* This is the starting function in C.  */
 void
@@ -986,6 +1120,12 @@ cmain (void)
       init_config ();
     }
   
+#ifndef GRUB_UTIL
+  /* Look for RAID1 arrays while the menu waits.  The grub shell scans
+     only when asked, since the disks it sees may be in use by the OS.  */
+  md_scan_background ();
+#endif
+
   /* Initialize the environment for restarting Stage 2.  */
   grub_setjmp (restart_env);
   
@@ -1013,6 +1153,7 @@ cmain (void)
 		 STATE 1:  In a title command.
 		 STATE >1: In a entry after a title command.  */
 	      int state = 0, prev_config_len = 0, prev_menu_len = 0;
+	      int title_offset = 0;
 	      char *cmdline;
 
 	      /* Try the preset menu first. This will succeed at most once,
@@ -1029,6 +1170,9 @@ cmain (void)
 
 	      /* This is necessary, because the menu must be overrided.  */
 	      reset ();
+	      reset_config_reader (0);
+	      config_drive = saved_drive;
+	      config_partition = saved_partition;
 	      
 	      cmdline = (char *) CMDLINE_BUF;
 	      while (get_line_from_config (cmdline, NEW_HEAPSIZE,
@@ -1070,6 +1214,9 @@ cmain (void)
 		      ptr = skip_to (1, cmdline);
 		      while ((menu_entries[menu_len++] = *(ptr++)) != 0)
 			;
+
+		      /* The commands start after the title line.  */
+		      title_offset = config_offset;
 		    }
 		  else if (! state)
 		    {
@@ -1084,6 +1231,16 @@ cmain (void)
 			/* Ignored.  */
 			continue;
 		    }
+		  else if (lazy_menu && ! is_preset)
+		    {
+		      /* Only record where the commands of this entry
+			 start, and read them when the entry is used.  */
+		      if (state++ == 1)
+			config_len += grub_sprintf (config_entries
+						    + config_len,
+						    "%c%d", LAZY_ENTRY_MAGIC,
+						    title_offset) + 1;
+		    }
 		  else
 		    {
 		      char *ptr = cmdline;
@@ -0,0 +1,232 @@
+/* task.c - run background jobs while GRUB waits */
+/*
+ *  GRUB  --  GRand Unified Bootloader
+ *  Copyright (C) 2004  Free Software Foundation, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* GRUB spends much of its time waiting for a key or for the menu to
+   time out.  A task is a job with a stack of its own which runs in that
+   time instead: task_idle, called where the menu and the command-line
+   prompts wait for a key, runs each task until it calls task_yield,
+   which should be often enough for the keyboard to stay responsive.
+
+   Tasks run only there, so they never interrupt a command half way.
+   That is why getkey itself only halts: commands call it too, as the
+   pager does between two screens of output.
+   Each has its own ERRNUM, CURRENT_DRIVE and CURRENT_PARTITION, but the
+   rest of GRUB is shared: a task must not use a filesystem, as that
+   would change the file that the main program has open.  */
+
+#include <shared.h>
+
+#ifdef GRUB_UTIL
+# include <ucontext.h>
+#endif
+
+/* Firmware services on EFI may need much stack.  The BIOS Stage 2 must
+   stay below FSYS_BUF, so there the stacks live in TASK_STACK_BUF
+   instead of in struct task.  */
+#if defined (PLATFORM_EFI) || defined (GRUB_UTIL)
+# define TASK_MAX		4
+# define TASK_STACK_SIZE	0x20000
+# define TASK_STACK(t)		((t)->stack)
+#else
+# define TASK_STACK_SIZE	0x2000
+# define TASK_MAX		(TASK_STACK_BUFLEN / TASK_STACK_SIZE)
+# define TASK_STACK(t)		((char *) TASK_STACK_BUF \
+				 + ((t) - tasks) * TASK_STACK_SIZE)
+#endif
+
+#define TASK_FREE	0
+#define TASK_NEW	1
+#define TASK_READY	2
+
+struct task
+{
+  int state;
+  void (*func) (void);
+#ifdef GRUB_UTIL
+  ucontext_t context;
+#else
+  grub_jmp_buf env;
+#endif
+  int errnum;
+  unsigned long drive;
+  unsigned long partition;
+#if defined (PLATFORM_EFI) || defined (GRUB_UTIL)
+  char stack[TASK_STACK_SIZE] __attribute__ ((aligned (16)));
+#endif
+};
+
+static struct task tasks[TASK_MAX];
+
+/* The task running, or NULL for the main program.  */
+static struct task *task_current;
+
+#ifdef GRUB_UTIL
+static ucontext_t task_main_context;
+#else
+static grub_jmp_buf task_main_env;
+#endif
+
+/* Start FUNC as a task, and return its number, or -1 if there are too
+   many.  */
+int
+task_spawn (void (*func) (void))
+{
+  int i;
+
+  for (i = 0; i < TASK_MAX; i++)
+    if (tasks[i].state == TASK_FREE)
+      {
+	tasks[i].state = TASK_NEW;
+	tasks[i].func = func;
+	tasks[i].errnum = ERR_NONE;
+	tasks[i].drive = current_drive;
+	tasks[i].partition = current_partition;
+	return i;
+      }
+
+  return -1;
+}
+
+/* Exchange the globals of the main program with those of the task T.  */
+static void
+task_swap_globals (struct task *t)
+{
+  int err = errnum;
+  unsigned long drive = current_drive;
+  unsigned long partition = current_partition;
+
+  errnum = t->errnum;
+  current_drive = t->drive;
+  current_partition = t->partition;
+  t->errnum = err;
+  t->drive = drive;
+  t->partition = partition;
+}
+
+static void
+task_start (void)
+{
+  task_current->func ();
+  task_current->state = TASK_FREE;
+
+#ifndef GRUB_UTIL
+  grub_longjmp (task_main_env, 1);
+#endif
+}
+
+/* Run the task T until it yields or ends.  */
+static void
+task_switch (struct task *t)
+{
+  task_current = t;
+  task_swap_globals (t);
+
+#ifdef GRUB_UTIL
+  if (t->state == TASK_NEW)
+    {
+      getcontext (&t->context);
+      t->context.uc_stack.ss_sp = t->stack;
+      t->context.uc_stack.ss_size = TASK_STACK_SIZE;
+      t->context.uc_link = &task_main_context;
+      makecontext (&t->context, task_start, 0);
+      t->state = TASK_READY;
+    }
+
+  swapcontext (&task_main_context, &t->context);
+#else
+  if (! grub_setjmp (task_main_env))
+    {
+      char *top = TASK_STACK (t) + TASK_STACK_SIZE;
+
+      if (t->state == TASK_READY)
+	grub_longjmp (t->env, 1);
+
+      /* Call task_start on the new stack, from which it never
+	 returns.  */
+      t->state = TASK_READY;
+# ifdef __x86_64__
+      asm volatile ("movq %0, %%rsp\n\tcall *%1"
+		    : : "r" (top), "r" (task_start) : "memory");
+# else
+      asm volatile ("movl %0, %%esp\n\tcall *%1"
+		    : : "r" (top), "r" (task_start) : "memory");
+# endif
+    }
+#endif
+
+  task_swap_globals (t);
+  task_current = 0;
+}
+
+/* Let the main program go on.  Does nothing outside a task.  */
+void
+task_yield (void)
+{
+  struct task *t = task_current;
+
+  if (! t)
+    return;
+
+#ifdef GRUB_UTIL
+  swapcontext (&t->context, &task_main_context);
+#else
+  if (! grub_setjmp (t->env))
+    grub_longjmp (task_main_env, 1);
+#endif
+}
+
+/* Run each task until it yields, and return how many there were.  */
+int
+task_run (void)
+{
+  int i, ran = 0;
+
+  if (task_current)
+    return 0;
+
+  for (i = 0; i < TASK_MAX; i++)
+    if (tasks[i].state != TASK_FREE)
+      {
+	task_switch (&tasks[i]);
+	ran++;
+      }
+
+  return ran;
+}
+
+/* Run the task TASK until it ends.  */
+void
+task_wait (int task)
+{
+  if (task < 0 || task_current)
+    return;
+
+  while (tasks[task].state != TASK_FREE)
+    task_switch (&tasks[task]);
+}
+
+/* Let the tasks run, or if there are none, wait for an input event or
+   the next timer tick.  */
+void
+task_idle (void)
+{
+  if (! task_run ())
+    grub_idle ();
+}
@@ -258,6 +258,18 @@ typedef	xfs_uint16_t	xfs_dir2_data_off_t;
  */
 typedef	xfs_off_t		xfs_dir2_off_t;
 
+/*
+ * Address of a data entry, in 8-byte units from the start of the
+ * directory.  Zero marks a stale leaf entry.
+ */
+typedef	xfs_uint32_t		xfs_dir2_dataptr_t;
+#define	XFS_DIR2_NULL_DATAPTR	((xfs_dir2_dataptr_t)0)
+
+/*
+ * Byte offset of the first leaf block, above the data space.
+ */
+#define	XFS_DIR2_LEAF_OFFSET	(1ULL << 35)
+
 /* those are from xfs_da_btree.h */
 /*========================================================================
  * Directory Structure when greater than XFS_LBSIZE(mp) bytes.
@@ -271,6 +283,7 @@ typedef	xfs_off_t		xfs_dir2_off_t;
  */
 #define	XFS_DIR2_LEAF1_MAGIC	0xd2f1	/* magic number: v2 dirlf single blks */
 #define	XFS_DIR2_LEAFN_MAGIC	0xd2ff	/* magic number: v2 dirlf multi blks */
+#define	XFS_DA_NODE_MAGIC	0xfebe	/* magic number: non-leaf blocks */
 
 typedef struct xfs_da_blkinfo {
 	xfs_dablk_t forw;			/* previous block in list */
@@ -380,6 +393,14 @@ typedef struct xfs_dir2_leaf_hdr {
 	xfs_uint16_t		stale;		/* count of stale entries */
 } xfs_dir2_leaf_hdr_t;
 
+/*
+ * Leaf block entry, sorted by hash value.
+ */
+typedef struct xfs_dir2_leaf_entry {
+	xfs_dahash_t		hashval;	/* hash value of name */
+	xfs_dir2_dataptr_t	address;	/* address of data entry */
+} xfs_dir2_leaf_entry_t;
+
 
 /* those are from xfs_dir2_block.h */
 /*